@@ -0,0 +1,86 @@
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGN (sizeof(max_align_t))
+
+struct ArenaBlock {
+  ArenaBlock *next;
+  size_t cap;
+  max_align_t data[];
+};
+
+static ArenaBlock *newBlock(Arena *arena, size_t cap) {
+  ArenaBlock *block = malloc(sizeof(ArenaBlock) + cap);
+  if (!block) {
+    perror("");
+    exit(0);
+  }
+  block->next = NULL;
+  block->cap = cap;
+  ++arena->numBlockAlloc;
+  return block;
+}
+
+void *arenaAlloc(Arena *arena, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  if (!arena->curr || arena->offset + size > arena->curr->cap) {
+    // reuse the following block if it is large enough, otherwise put a new
+    // one in front of it
+    ArenaBlock *next = arena->curr ? arena->curr->next : arena->first;
+    if (!next || size > next->cap) {
+      size_t blockSize = arena->blockSize ? arena->blockSize : ARENA_BLOCK_SIZE;
+      ArenaBlock *block = newBlock(arena, size > blockSize ? size : blockSize);
+      block->next = next;
+      if (arena->curr)
+        arena->curr->next = block;
+      else
+        arena->first = block;
+      next = block;
+    }
+    arena->curr = next;
+    arena->offset = 0;
+  }
+  void *ptr = (char *)arena->curr->data + arena->offset;
+  arena->offset += size;
+  arena->used += size;
+  if (arena->used > arena->peak)
+    arena->peak = arena->used;
+  return ptr;
+}
+
+char *arenaStrndup(Arena *arena, const char *str, size_t len) {
+  char *copy = arenaAlloc(arena, len + 1);
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+ArenaMark arenaMark(const Arena *arena) {
+  ArenaMark mark = {arena->curr, arena->offset, arena->used};
+  return mark;
+}
+
+void arenaRelease(Arena *arena, ArenaMark mark) {
+  arena->curr = mark.curr;
+  arena->offset = mark.offset;
+  arena->used = mark.used;
+}
+
+void arenaReset(Arena *arena) {
+  arena->curr = NULL;
+  arena->offset = 0;
+  arena->used = 0;
+}
+
+void arenaDestroy(Arena *arena) {
+  while (arena->first) {
+    ArenaBlock *next = arena->first->next;
+    free(arena->first);
+    arena->first = next;
+  }
+  arenaReset(arena);
+}
@@ -0,0 +1,43 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// bump allocator for everything that lives as long as one command line
+// memory is handed out from a chain of blocks that is kept across resets,
+// so after warm-up a command line costs no malloc() at all
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+  ArenaBlock *first, *curr;
+  size_t offset;        // bytes used in curr
+  size_t used, peak;    // bytes handed out since the last reset, max of used
+  size_t numBlockAlloc; // malloc() calls made for blocks
+  size_t blockSize;     // 0 for 64KB, smaller for many small arenas
+} Arena;
+
+// uninitialized memory aligned for any type, never returns NULL
+void *arenaAlloc(Arena *arena, size_t size);
+
+// exact-length copy of str[0, len) plus '\0'
+char *arenaStrndup(Arena *arena, const char *str, size_t len);
+
+// position to go back to with arenaRelease()
+typedef struct {
+  ArenaBlock *curr;
+  size_t offset, used;
+} ArenaMark;
+
+ArenaMark arenaMark(const Arena *arena);
+
+// O(1), releases everything allocated since mark, e.g. by one loop iteration
+void arenaRelease(Arena *arena, ArenaMark mark);
+
+// O(1), releases everything allocated since the last reset
+void arenaReset(Arena *arena);
+
+// return all blocks to the system
+void arenaDestroy(Arena *arena);
+
+#endif
@@ -0,0 +1,731 @@
+// myshell_bench: performance suite for myshell, optionally against bash and
+// dash, so that regressions show up as numbers instead of impressions
+//
+// myshell_bench [-q] [-c] [-s shell] [-o result.json]
+//   -q  quick run, a tenth of the iterations
+//   -c  also run every workload with bash and dash if they are installed
+//   -s  shell to test, defaults to myshell next to this binary
+//   -o  write the results as JSON
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../client/request.h"
+
+#define PROMPT "myshell $ " // PS1 of every shell under test
+#define TIMEOUT_MS 20000    // a shell that is silent this long has hung
+#define MAX_BENCH 20
+#define MAX_SHELL 3
+
+typedef struct {
+  const char *name;
+  const char *path;
+  const char *interactiveArg[5]; // extra args to get a prompt on a tty
+} Shell;
+
+typedef struct {
+  char name[32];
+  const char *unit;
+  size_t numSample;
+  double p50, p90, p99, min, max, mean;
+} BenchResult;
+
+typedef struct {
+  const Shell *shell;
+  BenchResult bench[MAX_BENCH];
+  size_t numBench;
+} ShellResult;
+
+static int iterScale = 1; // divisor of the iteration counts, 10 for -q
+static char clientPath[PATH_MAX]; // myshell_client, next to this binary
+static char scriptPath[] = "/tmp/myshell_bench_XXXXXX";
+static char globDirPath[] = "/tmp/myshell_bench_glob_XXXXXX";
+static int hasGlobDir;
+#define GLOB_DIR_FILES 100000 // one in ten is a .log
+// tee workload: the source file, and the file tee writes, on tmpfs if
+// there is one so that the disk does not set the pace
+static char teeSrcPath[64], teeOutPath[72];
+#define TEE_SRC_SIZE (256L << 20)
+#define TEE_SRC_REPEAT 8 // the stream is the source this many times
+
+static double nowUs(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec * 1e6 + (double)now.tv_nsec / 1e3;
+}
+
+static size_t iterations(size_t base) {
+  size_t n = base / (size_t)iterScale;
+  return n ? n : 1;
+}
+
+// ==========
+// statistics
+// ==========
+static int cmpDouble(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of sorted samples
+static double percentile(const double *sorted, size_t n, double p) {
+  size_t rank = (size_t)(p / 100.0 * (double)n + 0.5);
+  return sorted[rank == 0 ? 0 : rank > n ? n - 1 : rank - 1];
+}
+
+static void addResult(ShellResult *result, const char *name,
+                      const char *unit, double *samples, size_t n) {
+  if (n == 0 || result->numBench == MAX_BENCH)
+    return;
+  BenchResult *bench = &result->bench[result->numBench++];
+  snprintf(bench->name, sizeof(bench->name), "%s", name);
+  bench->unit = unit;
+  bench->numSample = n;
+  qsort(samples, n, sizeof(double), &cmpDouble);
+  bench->p50 = percentile(samples, n, 50);
+  bench->p90 = percentile(samples, n, 90);
+  bench->p99 = percentile(samples, n, 99);
+  bench->min = samples[0];
+  bench->max = samples[n - 1];
+  bench->mean = 0;
+  for (size_t i = 0; i < n; ++i)
+    bench->mean += samples[i];
+  bench->mean /= (double)n;
+  printf("  %-16s %10.1f %10.1f %10.1f %10.1f %10.1f  %-5s n=%zu\n", name,
+         bench->p50, bench->p90, bench->p99, bench->min, bench->max, unit, n);
+  fflush(stdout);
+}
+
+// ==========
+// shell processes
+// ==========
+static void setBenchEnv(void) {
+  setenv("PS1", PROMPT, 1);
+  setenv("TERM", "dumb", 1);
+  unsetenv("PROMPT_COMMAND");
+  unsetenv("ENV"); // dash -i would source it
+  setenv("HISTFILE", "/dev/null", 1); // keep the user's history out of it
+}
+
+// run shell on a pty, the master side is returned in *masterFd
+static pid_t startOnPty(const Shell *shell, int *masterFd) {
+  int fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (fd == -1 || grantpt(fd) == -1 || unlockpt(fd) == -1) {
+    perror("pty");
+    exit(1);
+  }
+  const char *slaveName = ptsname(fd);
+  pid_t pid = fork();
+  if (pid == 0) {
+    setsid();
+    int slaveFd = open(slaveName, O_RDWR);
+    if (slaveFd == -1)
+      _exit(127);
+    struct termios term;
+    tcgetattr(slaveFd, &term);
+    term.c_lflag &= ~(tcflag_t)ECHO; // only the output of the shell itself
+    tcsetattr(slaveFd, TCSANOW, &term);
+    dup2(slaveFd, 0);
+    dup2(slaveFd, 1);
+    dup2(slaveFd, 2);
+    if (slaveFd > 2)
+      close(slaveFd);
+    const char *shellArgv[6] = {shell->name};
+    for (size_t i = 0; shell->interactiveArg[i]; ++i)
+      shellArgv[i + 1] = shell->interactiveArg[i];
+    execv(shell->path, (char **)shellArgv);
+    _exit(127);
+  }
+  *masterFd = fd;
+  return pid;
+}
+
+// read until the prompt shows up
+// returns -1 on timeout or if the shell went away
+static int waitPrompt(int masterFd) {
+  static char buf[65536];
+  size_t len = 0, lenPrompt = strlen(PROMPT);
+  while (1) {
+    struct pollfd pfd = {masterFd, POLLIN, 0};
+    if (poll(&pfd, 1, TIMEOUT_MS) <= 0)
+      return -1;
+    // keep the tail, the prompt may arrive in pieces
+    if (len > sizeof(buf) / 2) {
+      memmove(buf, buf + len - lenPrompt, lenPrompt);
+      len = lenPrompt;
+    }
+    ssize_t lenRead = read(masterFd, buf + len, sizeof(buf) - len - 1);
+    if (lenRead <= 0)
+      return -1;
+    len += (size_t)lenRead;
+    buf[len] = '\0';
+    if (memmem(buf, len, PROMPT, lenPrompt))
+      return 0;
+  }
+}
+
+static void stopShell(pid_t pid, int fd) {
+  close(fd); // hangup for the pty, EOF for a pipe
+  kill(pid, SIGTERM);
+  kill(pid, SIGHUP);
+  waitpid(pid, NULL, 0);
+}
+
+// prompt-to-prompt latency of line, in microseconds
+static void benchPrompt(ShellResult *result, const char *name,
+                        const char *line, size_t numIter) {
+  int masterFd;
+  pid_t pid = startOnPty(result->shell, &masterFd);
+  double *samples = malloc(sizeof(double) * numIter);
+  size_t n = 0;
+  size_t lenLine = strlen(line);
+  if (waitPrompt(masterFd) == 0) {
+    // warm up caches of both the shell and the kernel
+    for (size_t i = 0; i < numIter / 10 + 1; ++i)
+      if (write(masterFd, line, lenLine) != (ssize_t)lenLine ||
+          waitPrompt(masterFd) == -1)
+        break;
+    for (; n < numIter; ++n) {
+      double start = nowUs();
+      if (write(masterFd, line, lenLine) != (ssize_t)lenLine ||
+          waitPrompt(masterFd) == -1)
+        break;
+      samples[n] = nowUs() - start;
+    }
+  }
+  if (n < numIter)
+    printf("  %-16s failed after %zu iterations\n", name, n);
+  addResult(result, name, "us", samples, n);
+  free(samples);
+  stopShell(pid, masterFd);
+}
+
+// run path with argv, stdin and stdout on /dev/null
+// returns the wall time in microseconds, or -1 if it failed
+static double runArgv(const char *path, const char *const *argv) {
+  double start = nowUs();
+  pid_t pid = fork();
+  if (pid == 0) {
+    int nullFd = open("/dev/null", O_RDWR);
+    dup2(nullFd, 0);
+    dup2(nullFd, 1);
+    execv(path, (char **)argv);
+    _exit(127);
+  }
+  int status;
+  if (pid == -1 || waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+      WEXITSTATUS(status) == 127)
+    return -1;
+  return nowUs() - start;
+}
+
+// run the shell on scriptPath
+static double runScript(const Shell *shell) {
+  const char *argv[] = {shell->name, scriptPath, NULL};
+  return runArgv(shell->path, argv);
+}
+
+static void writeScript(const char *text, size_t len) {
+  FILE *file = fopen(scriptPath, "w");
+  if (!file || fwrite(text, 1, len, file) != len || fclose(file) != 0) {
+    perror(scriptPath);
+    exit(1);
+  }
+}
+
+// ==========
+// workloads
+// ==========
+// long lines of quoted words, given to the true builtin of every shell
+static void benchParse(ShellResult *result) {
+  size_t numLine = 200, lenLine = 0;
+  char *script = malloc(numLine * 20000);
+  for (size_t i = 0; i < numLine; ++i) {
+    size_t lenStart = lenLine;
+    lenLine += (size_t)sprintf(script + lenLine, "true");
+    while (lenLine - lenStart < 16000)
+      lenLine += (size_t)sprintf(script + lenLine,
+                                 " \"double quoted %zu\" 'single quoted' "
+                                 "\"with \\\"escapes\\\"\" plain_word%zu",
+                                 i, lenLine);
+    script[lenLine++] = '\n';
+  }
+  writeScript(script, lenLine);
+  free(script);
+  size_t numIter = iterations(50), n = 0;
+  double samples[50];
+  for (; n < numIter; ++n) {
+    double us = runScript(result->shell);
+    if (us < 0)
+      break;
+    samples[n] = (double)lenLine / us; // bytes per us is MB/s
+  }
+  addResult(result, "parse_quoted", "MB/s", samples, n);
+}
+
+// multi-MB here-docs read by cat, bash and dash spill large bodies to temp
+// files, myshell hands over a sealed memfd
+static void benchHereDoc(ShellResult *result) {
+  size_t numDoc = 4, numLine = 40000, lenScript = 0, lenBody = 0;
+  char *script = malloc(numDoc * (numLine * 100 + 64));
+  for (size_t d = 0; d < numDoc; ++d) {
+    lenScript += (size_t)sprintf(script + lenScript,
+                                 "/bin/cat <<EOF > /dev/null\n");
+    for (size_t i = 0; i < numLine; ++i) {
+      memset(script + lenScript, 'x', 99);
+      script[lenScript + 99] = '\n';
+      lenScript += 100;
+      lenBody += 100;
+    }
+    lenScript += (size_t)sprintf(script + lenScript, "EOF\n");
+  }
+  writeScript(script, lenScript);
+  free(script);
+  size_t numIter = iterations(30), n = 0;
+  double samples[30];
+  for (; n < numIter; ++n) {
+    double us = runScript(result->shell);
+    if (us < 0)
+      break;
+    samples[n] = (double)lenBody / us;
+  }
+  addResult(result, "heredoc_4mb", "MB/s", samples, n);
+}
+
+// $(pwd) on every line, per line, myshell runs it without a fork
+static void benchCmdSubBuiltin(ShellResult *result) {
+  size_t numLine = 2000, lenScript = 0;
+  static const char line[] = "echo $(pwd) > /dev/null\n";
+  char *script = malloc(numLine * sizeof(line));
+  for (size_t i = 0; i < numLine; ++i) {
+    memcpy(script + lenScript, line, sizeof(line) - 1);
+    lenScript += sizeof(line) - 1;
+  }
+  writeScript(script, lenScript);
+  free(script);
+  size_t numIter = iterations(30), n = 0;
+  double samples[30];
+  for (; n < numIter; ++n) {
+    double us = runScript(result->shell);
+    if (us < 0)
+      break;
+    samples[n] = us / (double)numLine;
+  }
+  addResult(result, "cmdsub_builtin", "us", samples, n);
+}
+
+// 4MB of output of a child captured by $(...)
+static void benchCmdSubCapture(ShellResult *result) {
+  size_t numSub = 4, lenOut = 4000000, lenScript = 0;
+  char script[512];
+  for (size_t i = 0; i < numSub; ++i)
+    lenScript += (size_t)sprintf(
+        script + lenScript,
+        "echo \"$(/bin/head -c %zu /dev/zero | /bin/tr '\\0' x)\" "
+        "> /dev/null\n",
+        lenOut);
+  writeScript(script, lenScript);
+  size_t numIter = iterations(30), n = 0;
+  double samples[30];
+  for (; n < numIter; ++n) {
+    double us = runScript(result->shell);
+    if (us < 0)
+      break;
+    samples[n] = (double)(numSub * lenOut) / us;
+  }
+  addResult(result, "cmdsub_4mb", "MB/s", samples, n);
+}
+
+static void removeGlobDir(void) {
+  char path[PATH_MAX];
+  for (size_t i = 0; i < GLOB_DIR_FILES; ++i) {
+    snprintf(path, sizeof(path), "%s/f%06zu.%s", globDirPath, i,
+             i % 10 == 0 ? "log" : "dat");
+    unlink(path);
+  }
+  rmdir(globDirPath);
+}
+
+// the directory for the glob workloads, filled once for all shells
+static void makeGlobDir(void) {
+  if (!mkdtemp(globDirPath)) {
+    perror(globDirPath);
+    return;
+  }
+  char path[PATH_MAX];
+  for (size_t i = 0; i < GLOB_DIR_FILES; ++i) {
+    snprintf(path, sizeof(path), "%s/f%06zu.%s", globDirPath, i,
+             i % 10 == 0 ? "log" : "dat");
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd == -1) {
+      perror(path);
+      removeGlobDir();
+      return;
+    }
+    close(fd);
+  }
+  hasGlobDir = 1;
+}
+
+// numGlob globs of the 100k directory in one script, per glob, myshell
+// reads the directory once and matches the other globs against its cache
+static void benchGlob(ShellResult *result, const char *name, size_t numGlob) {
+  char line[PATH_MAX + 32], *script = malloc(numGlob * sizeof(line));
+  size_t lenScript = 0;
+  snprintf(line, sizeof(line), "true %s/*.log\n", globDirPath);
+  for (size_t i = 0; i < numGlob; ++i)
+    lenScript += (size_t)sprintf(script + lenScript, "%s", line);
+  writeScript(script, lenScript);
+  free(script);
+  size_t numIter = iterations(30), n = 0;
+  double samples[30];
+  for (; n < numIter; ++n) {
+    double us = runScript(result->shell);
+    if (us < 0)
+      break;
+    samples[n] = us / 1000 / (double)numGlob;
+  }
+  addResult(result, name, "ms", samples, n);
+}
+
+static void makeTeeSrc(void) {
+  const char *dir = access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp";
+  snprintf(teeSrcPath, sizeof(teeSrcPath), "%s/myshell_bench_tee_XXXXXX",
+           dir);
+  int fd = mkstemp(teeSrcPath);
+  if (fd == -1 || ftruncate(fd, TEE_SRC_SIZE) == -1) {
+    perror(teeSrcPath);
+    if (fd != -1) {
+      close(fd);
+      unlink(teeSrcPath);
+    }
+    teeSrcPath[0] = '\0';
+    return;
+  }
+  close(fd);
+  snprintf(teeOutPath, sizeof(teeOutPath), "%s.out", teeSrcPath);
+}
+
+// a 2GB stream through tee into a file and the next stage, both ends are
+// /bin/cat for every shell, so only tee differs: a builtin in myshell that
+// moves the data with tee(2) and splice(), coreutils tee in the others
+static void benchTee(ShellResult *result) {
+  char script[2048] = "/bin/cat";
+  for (size_t i = 0; i < TEE_SRC_REPEAT; ++i) {
+    strcat(script, " ");
+    strcat(script, teeSrcPath);
+  }
+  size_t lenScript = strlen(script);
+  lenScript += (size_t)sprintf(script + lenScript,
+                               " | tee %s | /bin/cat > /dev/null\n",
+                               teeOutPath);
+  writeScript(script, lenScript);
+  size_t numIter = iterations(10), n = 0;
+  double samples[10];
+  for (; n < numIter; ++n) {
+    double us = runScript(result->shell);
+    if (us < 0)
+      break;
+    samples[n] = (double)(TEE_SRC_SIZE * TEE_SRC_REPEAT) / us;
+  }
+  unlink(teeOutPath);
+  addResult(result, "tee_2gb", "MB/s", samples, n);
+}
+
+// start and reap many short background jobs, per job
+static void benchBgChurn(ShellResult *result) {
+  size_t numJob = 200, lenScript = 0;
+  char *script = malloc(numJob * 16 + 16);
+  for (size_t i = 0; i < numJob; ++i)
+    lenScript += (size_t)sprintf(script + lenScript, "/bin/true &\n");
+  lenScript += (size_t)sprintf(script + lenScript, "wait\n");
+  writeScript(script, lenScript);
+  free(script);
+  size_t numIter = iterations(30), n = 0;
+  double samples[30];
+  for (; n < numIter; ++n) {
+    double us = runScript(result->shell);
+    if (us < 0)
+      break;
+    samples[n] = us / (double)numJob;
+  }
+  addResult(result, "bg_churn", "us", samples, n);
+}
+
+// latency of /bin/true as a command line of its own, with a cold start of
+// the shell by -c, and for myshell also from a warm helper of
+// myshell --server, through myshell_client and straight over the socket
+static void benchColdStart(ShellResult *result) {
+  const char *argv[] = {result->shell->name, "-c", "/bin/true", NULL};
+  size_t numIter = iterations(500), n = 0;
+  double *samples = malloc(sizeof(double) * numIter);
+  runArgv(result->shell->path, argv);
+  for (; n < numIter; ++n)
+    if ((samples[n] = runArgv(result->shell->path, argv)) < 0)
+      break;
+  addResult(result, "cold_c_true", "us", samples, n);
+  free(samples);
+}
+
+static void benchServer(ShellResult *result) {
+  char sockPath[64];
+  snprintf(sockPath, sizeof(sockPath), "/tmp/myshell_bench_%d.sock",
+           (int)getpid());
+  pid_t pid = fork();
+  if (pid == 0) {
+    int nullFd = open("/dev/null", O_RDWR);
+    dup2(nullFd, 0);
+    dup2(nullFd, 1);
+    execl(result->shell->path, result->shell->name, "--server", sockPath,
+          (char *)NULL);
+    _exit(127);
+  }
+  const char *argv[] = {"myshell_client", sockPath, "/bin/true", NULL};
+  // until the server listens
+  for (size_t i = 0; i < TIMEOUT_MS / 10 && runArgv(clientPath, argv) < 0;
+       ++i)
+    usleep(10000);
+  size_t numIter = iterations(500), n = 0;
+  double *samples = malloc(sizeof(double) * numIter);
+  for (; n < numIter; ++n)
+    if ((samples[n] = runArgv(clientPath, argv)) < 0)
+      break;
+  addResult(result, "server_true", "us", samples, n);
+  // the round trip alone, as a program that talks to the server itself
+  // pays it
+  int nullFd = open("/dev/null", O_RDWR | O_CLOEXEC);
+  const int stdFds[3] = {nullFd, nullFd, nullFd};
+  ServerReply reply;
+  for (n = 0; n < numIter; ++n) {
+    double start = nowUs();
+    if (runOnServer(sockPath, "/bin/true", stdFds, &reply) == -1 ||
+        reply.status != 0)
+      break;
+    samples[n] = nowUs() - start;
+  }
+  addResult(result, "server_rt_true", "us", samples, n);
+  close(nullFd);
+  free(samples);
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+}
+
+// resident set of the shell after 10k mostly builtin commands from a pipe
+static void benchRss(ShellResult *result) {
+  size_t numIter = iterations(5), n = 0;
+  double samples[5];
+  for (; n < numIter; ++n) {
+    int inPipe[2], outPipe[2];
+    if (pipe2(inPipe, O_CLOEXEC) == -1 || pipe2(outPipe, O_CLOEXEC) == -1)
+      break;
+    pid_t pid = fork();
+    if (pid == 0) {
+      dup2(inPipe[0], 0);
+      dup2(outPipe[1], 1);
+      execl(result->shell->path, result->shell->name, (char *)NULL);
+      _exit(127);
+    }
+    close(inPipe[0]);
+    close(outPipe[1]);
+    static const char *cmds[] = {"true\n", "echo hello world > /dev/null\n",
+                                 "cd /tmp\n", "pwd > /dev/null\n"};
+    FILE *shellIn = fdopen(inPipe[1], "w");
+    for (size_t i = 0; i < 10000; ++i)
+      fputs(i % 10 == 9 ? "/bin/true\n" : cmds[i % 4], shellIn);
+    fputs("echo ready\n", shellIn);
+    fflush(shellIn);
+    char buf[64];
+    struct pollfd pfd = {outPipe[0], POLLIN, 0};
+    ssize_t lenRead = poll(&pfd, 1, TIMEOUT_MS) == 1
+                          ? read(outPipe[0], buf, sizeof(buf))
+                          : -1;
+    double rssKb = -1;
+    char statusPath[64], line[256];
+    snprintf(statusPath, sizeof(statusPath), "/proc/%d/status", (int)pid);
+    FILE *status = lenRead > 0 ? fopen(statusPath, "r") : NULL;
+    while (status && fgets(line, sizeof(line), status))
+      if (strncmp(line, "VmRSS:", 6) == 0)
+        rssKb = atof(line + 6);
+    if (status)
+      fclose(status);
+    fclose(shellIn);
+    close(outPipe[0]);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    if (rssKb < 0)
+      break;
+    samples[n] = rssKb;
+  }
+  addResult(result, "rss_10k", "kB", samples, n);
+}
+
+static void runSuite(ShellResult *result) {
+  printf("%s (%s)\n  %-16s %10s %10s %10s %10s %10s\n", result->shell->name,
+         result->shell->path, "benchmark", "p50", "p90", "p99", "min",
+         "max");
+  benchPrompt(result, "empty_command", "\n", iterations(2000));
+  benchPrompt(result, "spawn_true", "/bin/true\n", iterations(1000));
+  static const size_t numStages[] = {2, 16, 64, 128};
+  static const size_t numIter[] = {500, 100, 30, 15};
+  for (size_t i = 0; i < sizeof(numStages) / sizeof(numStages[0]); ++i) {
+    char line[2048] = "/bin/true", name[32];
+    for (size_t j = 1; j < numStages[i]; ++j)
+      strcat(line, " | /bin/true");
+    strcat(line, "\n");
+    snprintf(name, sizeof(name), "pipeline_%zu", numStages[i]);
+    benchPrompt(result, name, line, iterations(numIter[i]));
+  }
+  benchParse(result);
+  benchHereDoc(result);
+  benchCmdSubBuiltin(result);
+  benchCmdSubCapture(result);
+  if (hasGlobDir) {
+    benchGlob(result, "glob_100k", 1);
+    benchGlob(result, "glob_100k_x20", 20);
+  }
+  if (teeSrcPath[0])
+    benchTee(result);
+  benchBgChurn(result);
+  benchColdStart(result);
+  if (strcmp(result->shell->name, "myshell") == 0 &&
+      access(clientPath, X_OK) == 0)
+    benchServer(result);
+  benchRss(result);
+}
+
+// ==========
+// output
+// ==========
+static void writeJson(const char *jsonPath, const ShellResult *results,
+                      size_t numResult) {
+  FILE *file = strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w");
+  if (!file) {
+    perror(jsonPath);
+    exit(1);
+  }
+  struct utsname uts;
+  uname(&uts);
+  fprintf(file,
+          "{\"version\":1,\"time\":%ld,\"kernel\":\"%s\",\"machine\":\"%s\","
+          "\"cpus\":%ld,\"quick\":%s,\"shells\":[",
+          (long)time(NULL), uts.release, uts.machine,
+          sysconf(_SC_NPROCESSORS_ONLN), iterScale > 1 ? "true" : "false");
+  for (size_t i = 0; i < numResult; ++i) {
+    const ShellResult *result = &results[i];
+    fprintf(file, "%s{\"name\":\"%s\",\"path\":\"%s\",\"benchmarks\":[",
+            i ? "," : "", result->shell->name, result->shell->path);
+    for (size_t j = 0; j < result->numBench; ++j) {
+      const BenchResult *bench = &result->bench[j];
+      fprintf(file,
+              "%s{\"name\":\"%s\",\"unit\":\"%s\",\"n\":%zu,\"p50\":%.3f,"
+              "\"p90\":%.3f,\"p99\":%.3f,\"min\":%.3f,\"max\":%.3f,"
+              "\"mean\":%.3f}",
+              j ? "," : "", bench->name, bench->unit, bench->numSample,
+              bench->p50, bench->p90, bench->p99, bench->min, bench->max,
+              bench->mean);
+    }
+    fprintf(file, "]}");
+  }
+  fprintf(file, "]}\n");
+  if (file != stdout)
+    fclose(file);
+}
+
+// ==========
+// main
+// ==========
+static const char *findInPath(const char *name, char *buf) {
+  const char *pathEnv = getenv("PATH");
+  while (pathEnv && *pathEnv) {
+    size_t lenDir = strcspn(pathEnv, ":");
+    snprintf(buf, PATH_MAX, "%.*s/%s", (int)lenDir, pathEnv, name);
+    if (lenDir && access(buf, X_OK) == 0)
+      return buf;
+    pathEnv += lenDir + (pathEnv[lenDir] == ':');
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  int isCompare = 0;
+  const char *jsonPath = NULL, *shellPath = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "qcs:o:")) != -1) {
+    if (opt == 'q')
+      iterScale = 10;
+    else if (opt == 'c')
+      isCompare = 1;
+    else if (opt == 's')
+      shellPath = optarg;
+    else if (opt == 'o')
+      jsonPath = optarg;
+    else {
+      fprintf(stderr,
+              "usage: %s [-q] [-c] [-s shell] [-o result.json]\n", argv[0]);
+      return 2;
+    }
+  }
+  // myshell is built next to this binary
+  static char myshellPath[PATH_MAX], bashPath[PATH_MAX], dashPath[PATH_MAX];
+  if (!shellPath) {
+    ssize_t len = readlink("/proc/self/exe", myshellPath, PATH_MAX - 16);
+    if (len <= 0) {
+      perror("/proc/self/exe");
+      return 1;
+    }
+    myshellPath[len] = '\0';
+    strcpy(strrchr(myshellPath, '/') + 1, "myshell");
+    shellPath = myshellPath;
+  }
+  snprintf(clientPath, sizeof(clientPath), "%s", shellPath);
+  char *baseName = strrchr(clientPath, '/');
+  strcpy(baseName ? baseName + 1 : clientPath, "myshell_client");
+  if (access(shellPath, X_OK) == -1) {
+    perror(shellPath);
+    return 1;
+  }
+  Shell shells[MAX_SHELL] = {{"myshell", shellPath, {NULL}}};
+  size_t numShell = 1;
+  if (isCompare && findInPath("bash", bashPath))
+    shells[numShell++] = (Shell){
+        "bash", bashPath, {"--norc", "--noprofile", "--noediting", "-i"}};
+  if (isCompare && findInPath("dash", dashPath))
+    shells[numShell++] = (Shell){"dash", dashPath, {"-i", NULL}};
+  setBenchEnv();
+  signal(SIGPIPE, SIG_IGN); // a shell that died shows up as a failed run
+  int scriptFd = mkstemp(scriptPath);
+  if (scriptFd == -1) {
+    perror(scriptPath);
+    return 1;
+  }
+  close(scriptFd);
+  makeGlobDir();
+  makeTeeSrc();
+  ShellResult results[MAX_SHELL];
+  memset(results, 0, sizeof(results));
+  for (size_t i = 0; i < numShell; ++i) {
+    results[i].shell = &shells[i];
+    runSuite(&results[i]);
+  }
+  unlink(scriptPath);
+  if (hasGlobDir)
+    removeGlobDir();
+  if (teeSrcPath[0])
+    unlink(teeSrcPath);
+  if (jsonPath)
+    writeJson(jsonPath, results, numShell);
+  return 0;
+}
@@ -0,0 +1,844 @@
+#include "builtin.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "history.h"
+#include "jobs.h"
+#include "parallel.h"
+#include "pathcache.h"
+#include "trace.h"
+#include "vars.h"
+#include "zerocopy.h"
+
+#define BUILTIN_TABLE_SIZE 64 // power of 2, well above the number of builtins
+
+static char lastDir[PATH_MAX], lastDirTmp[PATH_MAX]; // for cd -
+
+// ==========
+// cd, pwd
+// ==========
+static int cdBuiltin(char **cmdArgv) {
+  char cwdTmp[PATH_MAX];
+  if (!cmdArgv[1] || strcmp(cmdArgv[1], "~") == 0) // cd || cd ~
+  {
+    const char *homeDir = getVar("HOME");
+    if (!homeDir) {
+      printf("cd: HOME not set\n");
+      return 1;
+    }
+    if (chdir(homeDir) == -1) {
+      perror("");
+      return 1;
+    }
+    strcpy(lastDir, lastDirTmp);
+    if (!getcwd(lastDirTmp, PATH_MAX))
+      strcpy(lastDirTmp, lastDir);
+  } else if (strcmp(cmdArgv[1], "-") == 0) // cd -
+  {
+    if (!getcwd(cwdTmp, PATH_MAX) || chdir(lastDir) == -1) {
+      perror("");
+      return 1;
+    }
+    printf("%s\n", lastDir);
+    strcpy(lastDirTmp, lastDir);
+    strcpy(lastDir, cwdTmp);
+  } else // cd dirName
+  {
+    if (chdir(cmdArgv[1]) == -1) {
+      printf("%s: No such file or directory\n", cmdArgv[1]);
+      return 1;
+    }
+    if (!getcwd(cwdTmp, PATH_MAX)) {
+      perror("");
+      return 1;
+    }
+    strcpy(lastDir, lastDirTmp);
+    strcpy(lastDirTmp, cwdTmp);
+  }
+  return 0;
+}
+
+static int pwdBuiltin(char **cmdArgv) {
+  (void)cmdArgv;
+  char cwdTmp[PATH_MAX];
+  if (!getcwd(cwdTmp, PATH_MAX)) {
+    perror("");
+    return 1;
+  }
+  printf("%s\n", cwdTmp);
+  return 0;
+}
+
+// ==========
+// true, false
+// ==========
+static int trueBuiltin(char **cmdArgv) {
+  (void)cmdArgv;
+  return 0;
+}
+
+static int falseBuiltin(char **cmdArgv) {
+  (void)cmdArgv;
+  return 1;
+}
+
+// ==========
+// echo, printf
+// ==========
+// print the escape sequence starting at str[0] == '\\'
+// returns the number of chars used, or -1 for \c (stop all output)
+static int putEscape(const char *str) {
+  static const char *escChar = "\\\\a\ab\be\033f\fn\nr\rt\tv\v";
+  const char *found = str[1] ? strchr(escChar, str[1]) : NULL;
+  // only look at the letters, which sit at even positions
+  if (found && (found - escChar) % 2 == 0) {
+    putchar(found[1]);
+    return 2;
+  }
+  if (str[1] == 'c')
+    return -1;
+  if (str[1] >= '0' && str[1] <= '7') {
+    // \0nnn as in echo -e, or \nnn as in printf
+    int i = str[1] == '0' ? 2 : 1, value = 0;
+    for (int end = i + 3; i < end && str[i] >= '0' && str[i] <= '7'; ++i)
+      value = value * 8 + (str[i] - '0');
+    putchar(value);
+    return i;
+  }
+  if (str[1] == 'x' && isxdigit((unsigned char)str[2])) {
+    int i = 2, value = 0;
+    for (; i < 4 && isxdigit((unsigned char)str[i]); ++i)
+      value = value * 16 + (isdigit((unsigned char)str[i])
+                                ? str[i] - '0'
+                                : tolower((unsigned char)str[i]) - 'a' + 10);
+    putchar(value);
+    return i;
+  }
+  putchar('\\');
+  return 1;
+}
+
+// returns -1 if \c stopped the output
+static int putEscapedStr(const char *str) {
+  while (*str) {
+    if (*str != '\\') {
+      putchar(*str++);
+      continue;
+    }
+    int lenEsc = putEscape(str);
+    if (lenEsc == -1)
+      return -1;
+    str += lenEsc;
+  }
+  return 0;
+}
+
+// echo [-neE] args
+static int echoBuiltin(char **cmdArgv) {
+  int hasNewline = 1, hasEscape = 0;
+  size_t i = 1;
+  for (; cmdArgv[i] && cmdArgv[i][0] == '-' && cmdArgv[i][1]; ++i) {
+    // only words made of known options are options
+    if (strspn(cmdArgv[i] + 1, "neE") != strlen(cmdArgv[i] + 1))
+      break;
+    for (const char *opt = cmdArgv[i] + 1; *opt; ++opt) {
+      if (*opt == 'n')
+        hasNewline = 0;
+      else
+        hasEscape = *opt == 'e';
+    }
+  }
+  for (size_t first = i; cmdArgv[i]; ++i) {
+    if (i > first)
+      putchar(' ');
+    if (!hasEscape)
+      fputs(cmdArgv[i], stdout);
+    else if (putEscapedStr(cmdArgv[i]) == -1)
+      return 0;
+  }
+  if (hasNewline)
+    putchar('\n');
+  return 0;
+}
+
+// numeric printf arguments, 'c gives the value of c
+static int isCharArg(const char *arg) {
+  return arg[0] == '\'' || arg[0] == '\"';
+}
+
+static int parseIntArg(const char *arg, long long *value) {
+  *value = 0;
+  if (!arg)
+    return 0;
+  if (isCharArg(arg)) {
+    *value = (unsigned char)arg[1];
+    return 0;
+  }
+  char *end;
+  errno = 0;
+  *value = strtoll(arg, &end, 0);
+  if (!arg[0] || *end || errno) {
+    printf("printf: %s: invalid number\n", arg);
+    return 1;
+  }
+  return 0;
+}
+
+static int parseFloatArg(const char *arg, double *value) {
+  *value = 0;
+  if (!arg)
+    return 0;
+  if (isCharArg(arg)) {
+    *value = (unsigned char)arg[1];
+    return 0;
+  }
+  char *end;
+  *value = strtod(arg, &end);
+  if (!arg[0] || *end) {
+    printf("printf: %s: invalid number\n", arg);
+    return 1;
+  }
+  return 0;
+}
+
+// printf format [arguments], the format is reused while arguments remain
+static int printfBuiltin(char **cmdArgv) {
+  if (!cmdArgv[1]) {
+    printf("printf: usage: printf format [arguments]\n");
+    return 2;
+  }
+  const char *format = cmdArgv[1];
+  char **args = cmdArgv + 2;
+  int status = 0;
+  while (1) {
+    char **argsBefore = args;
+    for (const char *p = format; *p;) {
+      if (*p == '\\') {
+        int lenEsc = putEscape(p);
+        if (lenEsc == -1)
+          return status;
+        p += lenEsc;
+        continue;
+      }
+      if (*p != '%') {
+        putchar(*p++);
+        continue;
+      }
+      if (p[1] == '%') {
+        putchar('%');
+        p += 2;
+        continue;
+      }
+      // copy flags, width and precision, then add a length and conversion
+      char spec[40];
+      size_t lenSpec = 0;
+      spec[lenSpec++] = *p++;
+      while (*p && strchr("-+ #0", *p) && lenSpec < 8)
+        spec[lenSpec++] = *p++;
+      while (isdigit((unsigned char)*p) && lenSpec < 16)
+        spec[lenSpec++] = *p++;
+      if (*p == '.') {
+        spec[lenSpec++] = *p++;
+        while (isdigit((unsigned char)*p) && lenSpec < 24)
+          spec[lenSpec++] = *p++;
+      }
+      char conv = *p;
+      if (!conv || !strchr("sbcdiuoxXfeEgG", conv)) {
+        printf("printf: %%%c: invalid format character\n", conv);
+        return 1;
+      }
+      ++p;
+      const char *arg = *args ? *args++ : NULL;
+      if (conv == 'b') {
+        if (arg && putEscapedStr(arg) == -1)
+          return status;
+        continue;
+      }
+      if (conv == 's' || conv == 'c') {
+        spec[lenSpec++] = conv;
+        spec[lenSpec] = '\0';
+        if (conv == 's')
+          printf(spec, arg ? arg : "");
+        else if (arg && arg[0])
+          printf(spec, arg[0]);
+        continue;
+      }
+      if (strchr("feEgG", conv)) {
+        double value;
+        status |= parseFloatArg(arg, &value);
+        spec[lenSpec++] = conv;
+        spec[lenSpec] = '\0';
+        printf(spec, value);
+        continue;
+      }
+      long long value;
+      status |= parseIntArg(arg, &value);
+      spec[lenSpec++] = 'l';
+      spec[lenSpec++] = 'l';
+      spec[lenSpec++] = conv;
+      spec[lenSpec] = '\0';
+      if (conv == 'd' || conv == 'i')
+        printf(spec, value);
+      else
+        printf(spec, (unsigned long long)value);
+    }
+    // stop once all arguments are used, or if the format takes none
+    if (!*args || args == argsBefore)
+      break;
+  }
+  return status;
+}
+
+// ==========
+// test, [
+// ==========
+typedef struct {
+  char **args;
+  int pos, num;
+  int hasError;
+} TestParser;
+
+static int isIntArg(const char *arg, long long *value) {
+  char *end;
+  errno = 0;
+  *value = strtoll(arg, &end, 10);
+  return arg[0] && !*end && !errno;
+}
+
+static int testBinary(TestParser *tp, const char *left, const char *op,
+                      const char *right) {
+  if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+    return strcmp(left, right) == 0;
+  if (strcmp(op, "!=") == 0)
+    return strcmp(left, right) != 0;
+  long long leftValue, rightValue;
+  if (!isIntArg(left, &leftValue) || !isIntArg(right, &rightValue)) {
+    printf("test: %s: integer expression expected\n",
+           isIntArg(left, &leftValue) ? right : left);
+    tp->hasError = 1;
+    return 0;
+  }
+  if (strcmp(op, "-eq") == 0)
+    return leftValue == rightValue;
+  if (strcmp(op, "-ne") == 0)
+    return leftValue != rightValue;
+  if (strcmp(op, "-lt") == 0)
+    return leftValue < rightValue;
+  if (strcmp(op, "-le") == 0)
+    return leftValue <= rightValue;
+  if (strcmp(op, "-gt") == 0)
+    return leftValue > rightValue;
+  return leftValue >= rightValue; // -ge
+}
+
+static int isBinaryOp(const char *arg) {
+  static const char *binaryOps[] = {"=",   "==",  "!=",  "-eq", "-ne",
+                                    "-lt", "-le", "-gt", "-ge", NULL};
+  for (size_t i = 0; binaryOps[i]; ++i) {
+    if (strcmp(arg, binaryOps[i]) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+static int isUnaryOp(const char *arg) {
+  return arg[0] == '-' && arg[1] && !arg[2] &&
+         strchr("bcdefghLnprsStwxz", arg[1]);
+}
+
+static int testUnary(char op, const char *arg) {
+  struct stat st;
+  switch (op) {
+  case 'z':
+    return arg[0] == '\0';
+  case 'n':
+    return arg[0] != '\0';
+  case 't':
+    return isatty(atoi(arg));
+  case 'r':
+    return access(arg, R_OK) == 0;
+  case 'w':
+    return access(arg, W_OK) == 0;
+  case 'x':
+    return access(arg, X_OK) == 0;
+  case 'h':
+  case 'L':
+    return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+  }
+  if (stat(arg, &st) == -1)
+    return 0;
+  switch (op) {
+  case 'b':
+    return S_ISBLK(st.st_mode);
+  case 'c':
+    return S_ISCHR(st.st_mode);
+  case 'd':
+    return S_ISDIR(st.st_mode);
+  case 'f':
+    return S_ISREG(st.st_mode);
+  case 'g':
+    return (st.st_mode & S_ISGID) != 0;
+  case 'p':
+    return S_ISFIFO(st.st_mode);
+  case 's':
+    return st.st_size > 0;
+  case 'S':
+    return S_ISSOCK(st.st_mode);
+  default: // e
+    return 1;
+  }
+}
+
+static int testOr(TestParser *tp);
+
+static int testPrimary(TestParser *tp) {
+  if (tp->pos >= tp->num) {
+    tp->hasError = 1;
+    return 0;
+  }
+  char **args = tp->args;
+  int pos = tp->pos;
+  // arg op arg comes first, so that "test -n = -n" compares strings
+  if (pos + 2 < tp->num && isBinaryOp(args[pos + 1])) {
+    tp->pos += 3;
+    return testBinary(tp, args[pos], args[pos + 1], args[pos + 2]);
+  }
+  if (strcmp(args[pos], "(") == 0 && pos + 1 < tp->num) {
+    ++tp->pos;
+    int result = testOr(tp);
+    if (tp->pos >= tp->num || strcmp(args[tp->pos], ")") != 0)
+      tp->hasError = 1;
+    ++tp->pos;
+    return result;
+  }
+  if (isUnaryOp(args[pos]) && pos + 1 < tp->num) {
+    tp->pos += 2;
+    return testUnary(args[pos][1], args[pos + 1]);
+  }
+  ++tp->pos;
+  return args[pos][0] != '\0';
+}
+
+static int testNot(TestParser *tp) {
+  if (tp->pos + 1 < tp->num && strcmp(tp->args[tp->pos], "!") == 0) {
+    ++tp->pos;
+    return !testNot(tp);
+  }
+  return testPrimary(tp);
+}
+
+static int testAnd(TestParser *tp) {
+  int result = testNot(tp);
+  while (tp->pos < tp->num && strcmp(tp->args[tp->pos], "-a") == 0) {
+    ++tp->pos;
+    result = testNot(tp) && result;
+  }
+  return result;
+}
+
+static int testOr(TestParser *tp) {
+  int result = testAnd(tp);
+  while (tp->pos < tp->num && strcmp(tp->args[tp->pos], "-o") == 0) {
+    ++tp->pos;
+    result = testAnd(tp) || result;
+  }
+  return result;
+}
+
+static int runTest(char **args, int numArgs) {
+  if (numArgs == 0)
+    return 1;
+  TestParser tp = {args, 0, numArgs, 0};
+  int result = testOr(&tp);
+  if (!tp.hasError && tp.pos != tp.num) {
+    printf("test: too many arguments\n");
+    return 2;
+  }
+  return tp.hasError ? 2 : !result;
+}
+
+static int testBuiltin(char **cmdArgv) {
+  int numArgs = 0;
+  while (cmdArgv[numArgs + 1])
+    ++numArgs;
+  return runTest(cmdArgv + 1, numArgs);
+}
+
+static int bracketBuiltin(char **cmdArgv) {
+  int numArgs = 0;
+  while (cmdArgv[numArgs + 1])
+    ++numArgs;
+  if (numArgs == 0 || strcmp(cmdArgv[numArgs], "]") != 0) {
+    printf("[: missing `]'\n");
+    return 2;
+  }
+  return runTest(cmdArgv + 1, numArgs - 1);
+}
+
+// ==========
+// cat
+// ==========
+// for options a builtin does not know, run the program of the same name
+static int runExternal(char **cmdArgv) {
+  const char *cmdPath = lookupCmdPath(cmdArgv[0]);
+  StageIo io = {-1, -1, NULL, 0, 0, -1};
+  pid_t pid;
+  int status;
+  if (!cmdPath || launchCmd(cmdPath, cmdArgv, &io, &pid) != 0) {
+    printf("%s: command not found\n", cmdArgv[0]);
+    return 127;
+  }
+  if (waitpid(pid, &status, 0) == -1)
+    return 1;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// inFd is the regular file of outFd, at or after where outFd writes, so
+// copying would read what it writes until the disk is full
+static int isInputOutput(int inFd, int outFd) {
+  struct stat inSt, outSt;
+  if (fstat(inFd, &inSt) == -1 || fstat(outFd, &outSt) == -1 ||
+      !S_ISREG(inSt.st_mode) || !S_ISREG(outSt.st_mode) ||
+      inSt.st_dev != outSt.st_dev || inSt.st_ino != outSt.st_ino)
+    return 0;
+  int flags = fcntl(outFd, F_GETFL);
+  return (flags != -1 && (flags & O_APPEND)) ||
+         lseek(outFd, 0, SEEK_CUR) <= lseek(inFd, 0, SEEK_CUR);
+}
+
+// cat [-u] [file|-]..., the data never passes through user space unless
+// no in-kernel path fits the fds
+static int catBuiltin(char **cmdArgv) {
+  size_t i = 1;
+  for (; cmdArgv[i] && cmdArgv[i][0] == '-' && cmdArgv[i][1]; ++i) {
+    if (strcmp(cmdArgv[i], "--") == 0) {
+      ++i;
+      break;
+    }
+    if (strcmp(cmdArgv[i], "-u") != 0) // already unbuffered
+      return runExternal(cmdArgv);
+  }
+  char *stdinArgv[] = {"-", NULL};
+  char **files = cmdArgv[i] ? cmdArgv + i : stdinArgv;
+  int status = 0;
+  for (i = 0; files[i]; ++i) {
+    int fd = strcmp(files[i], "-") == 0 ? 0
+                                         : open(files[i], O_RDONLY | O_CLOEXEC);
+    if (fd != -1 && isInputOutput(fd, 1)) {
+      fprintf(stderr, "cat: %s: input file is output file\n", files[i]);
+      if (fd != 0)
+        close(fd);
+      status = 1;
+      continue;
+    }
+    if (fd != -1 && copyFdAll(fd, 1) != -1) {
+      if (fd != 0)
+        close(fd);
+      continue;
+    }
+    int err = errno;
+    if (fd > 0)
+      close(fd);
+    if (err == EINTR) // ctrl+c
+      return 130;
+    fprintf(stderr, "cat: %s: %s\n", files[i], strerror(err));
+    status = 1;
+  }
+  return status;
+}
+
+// ==========
+// tee
+// ==========
+// tee [-a] [-i] [file...], stdin to stdout and every file, through tee(2)
+// and splice() when stdin is a pipe
+static int teeBuiltin(char **cmdArgv) {
+  int isAppend = 0, isIgnoreInt = 0;
+  size_t i = 1;
+  for (; cmdArgv[i] && cmdArgv[i][0] == '-' && cmdArgv[i][1]; ++i) {
+    if (strcmp(cmdArgv[i], "--") == 0) {
+      ++i;
+      break;
+    }
+    for (const char *c = cmdArgv[i] + 1; *c; ++c) {
+      if (*c == 'a')
+        isAppend = 1;
+      else if (*c == 'i')
+        isIgnoreInt = 1;
+      else
+        return runExternal(cmdArgv);
+    }
+  }
+  char **files = cmdArgv + i;
+  size_t numFiles = 0;
+  while (files[numFiles])
+    ++numFiles;
+  // stdout first, the files after it, the last fd takes the data
+  int *outFds = malloc(sizeof(int) * (numFiles + 1));
+  int *errs = malloc(sizeof(int) * (numFiles + 1));
+  const char **names = malloc(sizeof(char *) * (numFiles + 1));
+  if (!outFds || !errs || !names) {
+    perror("");
+    exit(0);
+  }
+  int status = 0;
+  size_t numOut = 1;
+  outFds[0] = 1;
+  names[0] = "standard output";
+  for (i = 0; i < numFiles; ++i) {
+    int fd = open(files[i],
+                  O_WRONLY | O_CREAT | O_CLOEXEC |
+                      (isAppend ? O_APPEND : O_TRUNC),
+                  0666);
+    if (fd == -1) {
+      fprintf(stderr, "tee: %s: %s\n", files[i], strerror(errno));
+      status = 1;
+      continue;
+    }
+    outFds[numOut] = fd;
+    names[numOut++] = files[i];
+  }
+  struct sigaction ignoreInt = {0}, oldInt;
+  ignoreInt.sa_handler = SIG_IGN;
+  if (isIgnoreInt)
+    sigaction(SIGINT, &ignoreInt, &oldInt);
+  fflush(stdout);
+  if (teeFdAll(0, outFds, errs, numOut) == -1) {
+    if (errno == EINTR) // ctrl+c
+      status = 130;
+    else if (errno == EPIPE)
+      status = 128 + SIGPIPE;
+    else {
+      fprintf(stderr, "tee: standard input: %s\n", strerror(errno));
+      status = 1;
+    }
+  }
+  if (isIgnoreInt)
+    sigaction(SIGINT, &oldInt, NULL);
+  for (i = 0; i < numOut; ++i) {
+    if (errs[i]) {
+      fprintf(stderr, "tee: %s: %s\n", names[i], strerror(errs[i]));
+      status = status ? status : 1;
+    }
+    if (i > 0)
+      close(outFds[i]);
+  }
+  free(outFds);
+  free(errs);
+  free(names);
+  return status;
+}
+
+// ==========
+// set
+// ==========
+// size with an optional K or M suffix, in bytes
+// returns -1 if str is not a size
+static long parseSize(const char *str) {
+  char *end;
+  errno = 0;
+  long size = strtol(str, &end, 10);
+  if (end == str || errno || size < 0)
+    return -1;
+  long unit = 1;
+  if (*end == 'k' || *end == 'K')
+    unit = 1024;
+  else if (*end == 'm' || *end == 'M')
+    unit = 1024 * 1024;
+  if (unit != 1)
+    ++end;
+  if (*end || size > LONG_MAX / unit)
+    return -1;
+  return size * unit;
+}
+
+static void printOptions(void) {
+  if (getPipeSize())
+    printf("pipesize\t%zu\n", getPipeSize());
+  else
+    printf("pipesize\tdefault\n");
+  printf("trace\t%s\n", tracePath() ? tracePath() : "off");
+}
+
+static int isOptionName(const char *option, size_t lenName, const char *name) {
+  return lenName == strlen(name) && strncmp(option, name, lenName) == 0;
+}
+
+// set -o                  list the options
+// set -o pipesize=SIZE    buffer size of the pipes between stages
+// set +o pipesize         back to the kernel default
+// set -o trace=FILE       append trace events of this shell to FILE, and
+//                         export MYSHELL_TRACE so that child shells do too
+// set +o trace            write them out and stop, and unset MYSHELL_TRACE
+static int setBuiltin(char **cmdArgv) {
+  if (!cmdArgv[1] || (strcmp(cmdArgv[1], "-o") == 0 && !cmdArgv[2])) {
+    printOptions();
+    return 0;
+  }
+  int status = 0;
+  for (size_t i = 1; cmdArgv[i]; i += 2) {
+    int isOn = strcmp(cmdArgv[i], "-o") == 0;
+    if ((!isOn && strcmp(cmdArgv[i], "+o") != 0) || !cmdArgv[i + 1]) {
+      printf("set: usage: set [-o option[=value]] [+o option]\n");
+      return 2;
+    }
+    const char *option = cmdArgv[i + 1];
+    size_t lenName = strcspn(option, "=");
+    if (isOptionName(option, lenName, "trace")) {
+      const char *path = option[lenName] ? option + lenName + 1 : "";
+      char absPath[PATH_MAX];
+      if (!isOn) {
+        traceStop();
+        unsetVar("MYSHELL_TRACE");
+      } else if (!*path) {
+        printf("set: %s: file name required\n", option);
+        status = 1;
+      } else if (traceStart(path) == -1) {
+        printf("set: %s: %s\n", path, strerror(errno));
+        status = 1;
+      } else // absolute, for children in other directories
+        setVar("MYSHELL_TRACE", strlen("MYSHELL_TRACE"),
+               realpath(path, absPath) ? absPath : path, 1);
+      continue;
+    }
+    if (!isOptionName(option, lenName, "pipesize")) {
+      printf("set: %.*s: invalid option name\n", (int)lenName, option);
+      status = 1;
+      continue;
+    }
+    long size = 0;
+    if (isOn && (!option[lenName] ||
+                 (size = parseSize(option + lenName + 1)) == -1)) {
+      printf("set: %s: invalid size\n", option);
+      status = 1;
+      continue;
+    }
+    if (setPipeSize((size_t)size) == -1) {
+      printf("set: %s: %s\n", option, strerror(errno));
+      status = 1;
+    }
+  }
+  return status;
+}
+
+// ==========
+// registry
+// ==========
+static const Builtin builtinArr[] = {
+    {"exit", &exitBuiltin, 0},
+    {"cd", &cdBuiltin, 0},
+    {"pwd", &pwdBuiltin, 1},
+    {"jobs", &jobsBuiltin, 0},
+    {"wait", &waitBuiltin, 0},
+    {"fg", &fgBuiltin, 0},
+    {"bg", &bgBuiltin, 0},
+    {"kill", &killBuiltin, 0},
+    {"stop", &stopBuiltin, 0},
+    {"disown", &disownBuiltin, 0},
+    {"hash", &hashBuiltin, 0},
+    {"echo", &echoBuiltin, 1},
+    {"printf", &printfBuiltin, 1},
+    {"true", &trueBuiltin, 1},
+    {"false", &falseBuiltin, 1},
+    {"test", &testBuiltin, 1},
+    {"[", &bracketBuiltin, 1},
+    {"cat", &catBuiltin, 0},
+    {"tee", &teeBuiltin, 0},
+    {"set", &setBuiltin, 0},
+    {"break", &breakBuiltin, 0},
+    {"continue", &continueBuiltin, 0},
+    {"history", &historyBuiltin, 0},
+    {"parallel", &parallelBuiltin, 0},
+    {"export", &exportBuiltin, 0},
+    {"unset", &unsetBuiltin, 0},
+};
+
+// open addressing, filled once by initBuiltins()
+static const Builtin *builtinTable[BUILTIN_TABLE_SIZE];
+
+static size_t hashBuiltinName(const char *name) {
+  uint32_t h = 2166136261u; // FNV-1a
+  for (; *name; ++name) {
+    h ^= (unsigned char)*name;
+    h *= 16777619u;
+  }
+  return h & (BUILTIN_TABLE_SIZE - 1);
+}
+
+void initBuiltins(void) {
+  for (size_t i = 0; i < sizeof(builtinArr) / sizeof(builtinArr[0]); ++i) {
+    size_t slot = hashBuiltinName(builtinArr[i].name);
+    while (builtinTable[slot])
+      slot = (slot + 1) & (BUILTIN_TABLE_SIZE - 1);
+    builtinTable[slot] = &builtinArr[i];
+  }
+  initCdDir();
+}
+
+void initCdDir(void) {
+  if (!getcwd(lastDir, PATH_MAX)) {
+    perror("");
+    exit(1);
+  }
+  strcpy(lastDirTmp, lastDir);
+}
+
+const Builtin *findBuiltin(const char *name) {
+  size_t slot = hashBuiltinName(name);
+  while (builtinTable[slot]) {
+    if (strcmp(builtinTable[slot]->name, name) == 0)
+      return builtinTable[slot];
+    slot = (slot + 1) & (BUILTIN_TABLE_SIZE - 1);
+  }
+  return NULL;
+}
+
+const char *builtinName(size_t idx) {
+  return idx < sizeof(builtinArr) / sizeof(builtinArr[0])
+             ? builtinArr[idx].name
+             : NULL;
+}
+
+// fd is moved above the fds of the command line and closed on exec, -1 if
+// it was not open
+static int saveFd(int fd) { return fcntl(fd, F_DUPFD_CLOEXEC, 10); }
+
+static void restoreFd(int savedFd, int fd) {
+  if (savedFd == -1) {
+    close(fd);
+    return;
+  }
+  dup2(savedFd, fd);
+  close(savedFd);
+}
+
+int runBuiltin(const Builtin *builtin, char **cmdArgv, const StageIo *io) {
+  int savedIn = -1, savedOut = -1;
+  fflush(stdout);
+  if (io->inFd != -1) {
+    savedIn = saveFd(0);
+    dup2(io->inFd, 0);
+  }
+  if (io->outFd != -1) {
+    savedOut = saveFd(1);
+    dup2(io->outFd, 1);
+  }
+  int status = builtin->func(cmdArgv);
+  fflush(stdout);
+  if (io->inFd != -1)
+    restoreFd(savedIn, 0);
+  if (io->outFd != -1)
+    restoreFd(savedOut, 1);
+  return status;
+}
@@ -0,0 +1,39 @@
+#ifndef BUILTIN_H
+#define BUILTIN_H
+
+#include <stddef.h>
+
+#include "launcher.h"
+
+// a builtin gets its own argv, NULL-terminated, and returns its exit status
+typedef int (*BuiltinFunc)(char **cmdArgv);
+
+typedef struct {
+  const char *name;
+  BuiltinFunc func;
+  int isPure; // only writes to stdout, so $(...) may run it in the shell
+} Builtin;
+
+// set up the lookup table and the state of cd
+void initBuiltins(void);
+
+// cd - goes back to the current directory, e.g. once a server helper has
+// moved to the one of its client
+void initCdDir(void);
+
+// constant time, NULL if name is not a builtin
+const Builtin *findBuiltin(const char *name);
+
+// name of builtin idx, NULL past the last one
+const char *builtinName(size_t idx);
+
+// run a builtin in the shell process itself, with fds 0 and 1 redirected as
+// in io for the duration of the call
+int runBuiltin(const Builtin *builtin, char **cmdArgv, const StageIo *io);
+
+// defined in myshell.c, needs the whole shell state
+int exitBuiltin(char **cmdArgv);
+int breakBuiltin(char **cmdArgv);
+int continueBuiltin(char **cmdArgv);
+
+#endif
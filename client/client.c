@@ -0,0 +1,45 @@
+// myshell_client: run a command line on a myshell --server, with the stdin,
+// stdout, stderr and working directory of this process, and exit with its
+// status, as myshell -c would
+//
+// myshell_client [-r] socket command
+//   -r  print the rusage of the command line to stderr
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "request.h"
+
+int main(int argc, char **argv) {
+  int isUsage = 0, opt;
+  while ((opt = getopt(argc, argv, "+r")) != -1) {
+    if (opt != 'r') {
+      optind = argc;
+      break;
+    }
+    isUsage = 1;
+  }
+  if (optind + 2 != argc) {
+    fprintf(stderr, "usage: %s [-r] socket command\n", argv[0]);
+    return 2;
+  }
+  const char *sockPath = argv[optind], *line = argv[optind + 1];
+  static const int stdFds[3] = {0, 1, 2};
+  ServerReply reply;
+  if (runOnServer(sockPath, line, stdFds, &reply) == -1) {
+    fprintf(stderr, "myshell_client: %s: %s\n", sockPath, strerror(errno));
+    return 127;
+  }
+  if (isUsage)
+    fprintf(stderr,
+            "status %d, user %ld.%06lds, sys %ld.%06lds, max rss %ldkB, "
+            "faults %ld, ctx switches %ld+%ld\n",
+            reply.status, (long)reply.usage.ru_utime.tv_sec,
+            (long)reply.usage.ru_utime.tv_usec,
+            (long)reply.usage.ru_stime.tv_sec,
+            (long)reply.usage.ru_stime.tv_usec, reply.usage.ru_maxrss,
+            reply.usage.ru_minflt + reply.usage.ru_majflt,
+            reply.usage.ru_nvcsw, reply.usage.ru_nivcsw);
+  return reply.status;
+}
@@ -0,0 +1,127 @@
+#define _GNU_SOURCE // O_PATH
+#include "request.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int connectTo(const char *sockPath) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(sockPath) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, sockPath);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd != -1 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+  return fd;
+}
+
+extern char **environ;
+
+static int sendAll(int sock, const char *data, size_t len) {
+  for (size_t done = 0; done < len;) {
+    ssize_t lenSent = send(sock, data + done, len - done, MSG_NOSIGNAL);
+    if (lenSent == -1 && errno == EINTR)
+      continue;
+    if (lenSent == -1)
+      return -1;
+    done += (size_t)lenSent;
+  }
+  return 0;
+}
+
+// environ as one block of "NAME=value\0" entries, NULL if out of memory
+static char *packEnviron(size_t *lenEnv) {
+  *lenEnv = 0;
+  for (char **env = environ; env && *env; ++env)
+    *lenEnv += strlen(*env) + 1;
+  char *data = malloc(*lenEnv ? *lenEnv : 1);
+  if (!data)
+    return NULL;
+  char *out = data;
+  for (char **env = environ; env && *env; ++env) {
+    size_t lenEntry = strlen(*env) + 1;
+    memcpy(out, *env, lenEntry);
+    out += lenEntry;
+  }
+  return data;
+}
+
+// the header, with the fds and the directory attached, then the line and
+// the environment
+static int sendRequest(int sock, const char *line, const int *stdFds) {
+  int fds[SERVER_NUM_FDS] = {stdFds[0], stdFds[1], stdFds[2],
+                             open(".", O_PATH | O_CLOEXEC)};
+  if (fds[3] == -1)
+    return -1;
+  union {
+    char buf[CMSG_SPACE(sizeof(fds))];
+    struct cmsghdr align;
+  } control;
+  size_t lenEnv;
+  char *envData = packEnviron(&lenEnv);
+  if (!envData) {
+    close(fds[3]);
+    return -1;
+  }
+  ServerRequest request = {(uint32_t)strlen(line), (uint32_t)lenEnv};
+  struct iovec iov = {&request, sizeof(request)};
+  struct msghdr msg = {0};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  ssize_t lenSent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+  close(fds[3]);
+  int ret = lenSent != (ssize_t)sizeof(request) ||
+                    sendAll(sock, line, request.lenLine) == -1 ||
+                    sendAll(sock, envData, lenEnv) == -1
+                ? -1
+                : 0;
+  free(envData);
+  return ret;
+}
+
+static int recvReply(int sock, ServerReply *reply) {
+  for (size_t done = 0; done < sizeof(*reply);) {
+    ssize_t lenRead = read(sock, (char *)reply + done, sizeof(*reply) - done);
+    if (lenRead == -1 && errno == EINTR)
+      continue;
+    if (lenRead == 0)
+      errno = ECONNRESET;
+    if (lenRead <= 0)
+      return -1;
+    done += (size_t)lenRead;
+  }
+  return 0;
+}
+
+int runOnServer(const char *sockPath, const char *line, const int *stdFds,
+                ServerReply *reply) {
+  int sock = connectTo(sockPath);
+  if (sock == -1)
+    return -1;
+  int ret = sendRequest(sock, line, stdFds) == -1 ||
+                    recvReply(sock, reply) == -1
+                ? -1
+                : 0;
+  int err = errno;
+  close(sock);
+  errno = err;
+  return ret;
+}
@@ -0,0 +1,15 @@
+#ifndef REQUEST_H
+#define REQUEST_H
+
+#include "../server.h"
+
+// the client side of myshell --server, see server.h
+
+// run line on the server listening on sockPath, with stdFds[0, 3) as its
+// stdin, stdout and stderr, in the current directory
+// returns 0 with the reply in *reply, or -1 with errno set, ECONNRESET if
+// the server closed the connection without a reply
+int runOnServer(const char *sockPath, const char *line, const int *stdFds,
+                ServerReply *reply);
+
+#endif
@@ -0,0 +1,183 @@
+#include "cmdindex.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vars.h"
+
+typedef struct {
+  char *dir;
+  int isRead;
+  // the directory the list was read from, an empty or relative PATH entry
+  // is another directory after cd
+  struct timespec mtime;
+  dev_t dev;
+  ino_t ino;
+  char *nameBuf; // all names, each '\0'-terminated
+  char **names;  // sorted, into nameBuf
+  size_t numNames;
+} CmdDir;
+
+static CmdDir *dirArr;
+static size_t numDirs;
+static char *indexPath; // PATH the directories come from
+static const char **matchArr;
+static size_t capMatch;
+
+static void *growArray(void *arr, size_t *cap, size_t need, size_t size) {
+  if (need <= *cap)
+    return arr;
+  size_t newCap = *cap ? *cap : 64;
+  while (newCap < need)
+    newCap *= 2;
+  if (!(arr = realloc(arr, newCap * size))) {
+    perror("");
+    exit(0);
+  }
+  *cap = newCap;
+  return arr;
+}
+
+static void forgetDir(CmdDir *dir) {
+  free(dir->nameBuf);
+  free(dir->names);
+  dir->nameBuf = NULL;
+  dir->names = NULL;
+  dir->numNames = 0;
+  dir->isRead = 0;
+}
+
+void clearCmdIndex(void) {
+  for (size_t i = 0; i < numDirs; ++i) {
+    forgetDir(&dirArr[i]);
+    free(dirArr[i].dir);
+  }
+  free(dirArr);
+  free(indexPath);
+  free(matchArr);
+  dirArr = NULL;
+  indexPath = NULL;
+  matchArr = NULL;
+  numDirs = 0;
+  capMatch = 0;
+}
+
+// start over if PATH has changed since the directories were read
+static void checkPathEnv(void) {
+  const char *env = getVar("PATH");
+  if (!env)
+    env = "";
+  if (indexPath && strcmp(indexPath, env) == 0)
+    return;
+  clearCmdIndex();
+  indexPath = strdup(env);
+  numDirs = 1;
+  for (const char *c = env; *c; ++c)
+    numDirs += *c == ':';
+  if (!indexPath || !(dirArr = calloc(numDirs, sizeof(CmdDir)))) {
+    perror("");
+    exit(0);
+  }
+  const char *dir = env;
+  for (size_t i = 0; i < numDirs; ++i) {
+    size_t lenDir = strcspn(dir, ":");
+    // empty entry means the current directory
+    dirArr[i].dir = lenDir ? strndup(dir, lenDir) : strdup(".");
+    dir += lenDir + 1;
+  }
+}
+
+static int compareNames(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void readDir(CmdDir *dir, const struct stat *dirSt) {
+  forgetDir(dir);
+  dir->isRead = 1;
+  dir->mtime = dirSt->st_mtim;
+  dir->dev = dirSt->st_dev;
+  dir->ino = dirSt->st_ino;
+  int dirFd = open(dir->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  DIR *stream = dirFd == -1 ? NULL : fdopendir(dirFd);
+  if (!stream) {
+    if (dirFd != -1)
+      close(dirFd);
+    return;
+  }
+  // offsets while nameBuf may still move
+  size_t *offsets = NULL, capOffsets = 0, lenBuf = 0, capBuf = 0;
+  struct dirent *entry;
+  while ((entry = readdir(stream))) {
+    if (entry->d_type != DT_REG && entry->d_type != DT_LNK &&
+        entry->d_type != DT_UNKNOWN)
+      continue;
+    struct stat st;
+    if (fstatat(dirFd, entry->d_name, &st, 0) == -1 || !S_ISREG(st.st_mode) ||
+        !(st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)))
+      continue;
+    size_t lenName = strlen(entry->d_name) + 1;
+    dir->nameBuf = growArray(dir->nameBuf, &capBuf, lenBuf + lenName, 1);
+    memcpy(dir->nameBuf + lenBuf, entry->d_name, lenName);
+    offsets = growArray(offsets, &capOffsets, dir->numNames + 1,
+                        sizeof(size_t));
+    offsets[dir->numNames++] = lenBuf;
+    lenBuf += lenName;
+  }
+  closedir(stream);
+  if (dir->numNames > 0 &&
+      !(dir->names = malloc(dir->numNames * sizeof(char *)))) {
+    perror("");
+    exit(0);
+  }
+  for (size_t i = 0; i < dir->numNames; ++i)
+    dir->names[i] = dir->nameBuf + offsets[i];
+  free(offsets);
+  if (dir->numNames > 0)
+    qsort(dir->names, dir->numNames, sizeof(char *), &compareNames);
+}
+
+const char **findCmds(const char *prefix, size_t lenPrefix, size_t *numCmds) {
+  checkPathEnv();
+  size_t numMatch = 0;
+  for (size_t i = 0; i < numDirs; ++i) {
+    CmdDir *dir = &dirArr[i];
+    struct stat st;
+    if (stat(dir->dir, &st) == -1) {
+      forgetDir(dir);
+      continue;
+    }
+    if (!dir->isRead || st.st_mtim.tv_sec != dir->mtime.tv_sec ||
+        st.st_mtim.tv_nsec != dir->mtime.tv_nsec || st.st_ino != dir->ino ||
+        st.st_dev != dir->dev)
+      readDir(dir, &st);
+    // first name not below prefix, then every name that starts with it
+    size_t low = 0, high = dir->numNames;
+    while (low < high) {
+      size_t mid = low + (high - low) / 2;
+      if (strncmp(dir->names[mid], prefix, lenPrefix) < 0)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+    for (; low < dir->numNames &&
+           strncmp(dir->names[low], prefix, lenPrefix) == 0;
+         ++low) {
+      matchArr = growArray(matchArr, &capMatch, numMatch + 1, sizeof(char *));
+      matchArr[numMatch++] = dir->names[low];
+    }
+  }
+  // a name in several directories is one command
+  if (numMatch > 0)
+    qsort(matchArr, numMatch, sizeof(char *), &compareNames);
+  size_t numUnique = 0;
+  for (size_t i = 0; i < numMatch; ++i)
+    if (numUnique == 0 || strcmp(matchArr[numUnique - 1], matchArr[i]) != 0)
+      matchArr[numUnique++] = matchArr[i];
+  *numCmds = numUnique;
+  return matchArr;
+}
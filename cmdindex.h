@@ -0,0 +1,17 @@
+#ifndef CMDINDEX_H
+#define CMDINDEX_H
+
+#include <stddef.h>
+
+// names of the executables in $PATH, for completion
+// each directory is read once into a sorted list and read again only when
+// its mtime has moved, so a completion costs one stat() per directory and
+// a binary search in each list instead of a readdir() of /usr/bin
+
+// commands that start with prefix, sorted and without duplicates
+// the result stays valid until the next call into the index
+const char **findCmds(const char *prefix, size_t lenPrefix, size_t *numCmds);
+
+void clearCmdIndex(void);
+
+#endif
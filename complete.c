@@ -0,0 +1,190 @@
+#include "complete.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "builtin.h"
+#include "cmdindex.h"
+#include "vars.h"
+
+static Arena compArena; // words and candidates of the last completion
+static char **matchArr;
+static size_t numMatch, capMatch;
+
+static void addMatch(char *match) {
+  if (numMatch == capMatch) {
+    capMatch = capMatch ? 2 * capMatch : 64;
+    if (!(matchArr = realloc(matchArr, capMatch * sizeof(char *)))) {
+      perror("");
+      exit(0);
+    }
+  }
+  matchArr[numMatch++] = match;
+}
+
+static int compareMatches(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// words after which the next word is a command again
+static int isCmdPrefix(const char *word) {
+  return strcmp(word, "do") == 0 || strcmp(word, "while") == 0 ||
+         strcmp(word, "time") == 0 || strcmp(word, "-j") == 0 ||
+         strcmp(word, "parallel") == 0;
+}
+
+// ==========
+// the word before the cursor, read the way the lexer reads it
+// returns the word without quotes and escapes
+// ==========
+static char *scanWord(const char *line, size_t cursor, size_t *wordStart,
+                      int *isCmdPos) {
+  char *word = arenaAlloc(&compArena, cursor + 1);
+  size_t lenWord = 0;
+  int inWord = 0;
+  char quote = 0;
+  *isCmdPos = 1;
+  *wordStart = 0;
+  for (size_t i = 0; i < cursor; ++i) {
+    char c = line[i];
+    if (quote == '\'') {
+      if (c == '\'')
+        quote = 0;
+      else
+        word[lenWord++] = c;
+      continue;
+    }
+    if (quote == '\"') {
+      if (c == '\"')
+        quote = 0;
+      else if (c == '\\' && i + 1 < cursor && strchr("\"\\$`", line[i + 1]))
+        word[lenWord++] = line[++i];
+      else
+        word[lenWord++] = c;
+      continue;
+    }
+    if (!inWord)
+      *wordStart = i;
+    if (c == '\\' || c == '\'' || c == '\"') {
+      if (c != '\\')
+        quote = c;
+      else if (i + 1 < cursor)
+        word[lenWord++] = line[++i];
+      inWord = 1;
+    } else if (strchr(" \t\n|&;<>", c)) {
+      if (inWord) {
+        word[lenWord] = '\0';
+        *isCmdPos = *isCmdPos && isCmdPrefix(word);
+      }
+      if (c == '|' || c == '&' || c == ';' || c == '\n')
+        *isCmdPos = 1;
+      else if (c == '<' || c == '>')
+        *isCmdPos = 0;
+      inWord = 0;
+      lenWord = 0;
+      *wordStart = i + 1;
+    } else {
+      word[lenWord++] = c;
+      inWord = 1;
+    }
+  }
+  word[lenWord] = '\0';
+  return word;
+}
+
+static void addCmds(const char *word) {
+  size_t lenWord = strlen(word), numCmds;
+  const char *name;
+  for (size_t i = 0; (name = builtinName(i)); ++i)
+    if (strncmp(name, word, lenWord) == 0)
+      addMatch((char *)name);
+  const char **cmds = findCmds(word, lenWord, &numCmds);
+  for (size_t i = 0; i < numCmds; ++i)
+    addMatch((char *)cmds[i]);
+}
+
+static void addPaths(const char *word, int isCmdPos) {
+  const char *slash = strrchr(word, '/');
+  size_t lenDir = slash ? (size_t)(slash + 1 - word) : 0;
+  const char *base = word + lenDir;
+  size_t lenBase = strlen(base);
+  // the directory to read, ~/ stands for $HOME
+  const char *home = getVar("HOME");
+  char *dirName;
+  if (lenDir == 0)
+    dirName = ".";
+  else if (word[0] == '~' && word[1] == '/' && home) {
+    size_t lenHome = strlen(home);
+    dirName = arenaAlloc(&compArena, lenHome + lenDir);
+    memcpy(dirName, home, lenHome);
+    memcpy(dirName + lenHome, word + 1, lenDir - 1);
+    dirName[lenHome + lenDir - 1] = '\0';
+  } else
+    dirName = arenaStrndup(&compArena, word, lenDir);
+  DIR *dir = opendir(dirName);
+  if (!dir)
+    return;
+  struct dirent *entry;
+  while ((entry = readdir(dir))) {
+    const char *name = entry->d_name;
+    if (strncmp(name, base, lenBase) != 0 || strcmp(name, ".") == 0 ||
+        strcmp(name, "..") == 0 || (name[0] == '.' && base[0] != '.'))
+      continue;
+    int isDir = entry->d_type == DT_DIR, isExec = 0;
+    if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN || isCmdPos) {
+      struct stat st;
+      int dirFd = dirfd(dir);
+      if (fstatat(dirFd, name, &st, 0) == 0) {
+        isDir = S_ISDIR(st.st_mode);
+        isExec = S_ISREG(st.st_mode) && (st.st_mode & S_IXUSR);
+      }
+    }
+    // a command can only be a program, or in a directory
+    if (isCmdPos && !isDir && !isExec)
+      continue;
+    size_t lenName = strlen(name);
+    char *match = arenaAlloc(&compArena, lenDir + lenName + 2);
+    memcpy(match, word, lenDir);
+    memcpy(match + lenDir, name, lenName);
+    match[lenDir + lenName] = isDir ? '/' : '\0';
+    match[lenDir + lenName + (isDir ? 1 : 0)] = '\0';
+    addMatch(match);
+  }
+  closedir(dir);
+}
+
+char **completeWord(const char *line, size_t cursor, size_t *wordStart,
+                    const char **word, size_t *numMatches) {
+  arenaReset(&compArena);
+  numMatch = 0;
+  int isCmdPos;
+  char *text = scanWord(line, cursor, wordStart, &isCmdPos);
+  if (isCmdPos && !strchr(text, '/') && text[0] != '~' && text[0] != '.')
+    addCmds(text);
+  else
+    addPaths(text, isCmdPos);
+  if (numMatch > 0)
+    qsort(matchArr, numMatch, sizeof(char *), &compareMatches);
+  // a builtin that is in PATH as well
+  size_t numUnique = 0;
+  for (size_t i = 0; i < numMatch; ++i)
+    if (numUnique == 0 || strcmp(matchArr[numUnique - 1], matchArr[i]) != 0)
+      matchArr[numUnique++] = matchArr[i];
+  *word = text;
+  *numMatches = numUnique;
+  return matchArr;
+}
+
+void freeCompletion(void) {
+  arenaDestroy(&compArena);
+  free(matchArr);
+  matchArr = NULL;
+  numMatch = 0;
+  capMatch = 0;
+  clearCmdIndex();
+}
@@ -0,0 +1,21 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+#include <stddef.h>
+
+// tab completion for the line editor
+// in command position a word completes to builtins and commands in $PATH,
+// anywhere else, or once it has a '/', to paths
+
+// candidates for the word that ends at cursor in line, sorted
+// the word and the candidates are as the word reads without quotes and
+// escapes, a directory ends in '/'
+// *wordStart: where the word begins in line, its opening quote included
+// *word: the word itself
+// the result stays valid until the next call
+char **completeWord(const char *line, size_t cursor, size_t *wordStart,
+                    const char **word, size_t *numMatches);
+
+void freeCompletion(void);
+
+#endif
@@ -0,0 +1,266 @@
+#include "expand.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pathglob.h"
+#include "vars.h"
+
+#define BYTEBUF_MIN 4096
+
+static pid_t shellPid;
+
+void expandInit(void) { shellPid = getpid(); }
+
+void byteBufReserve(ByteBuf *buf, size_t need) {
+  if (buf->len + need <= buf->cap)
+    return;
+  size_t cap = buf->cap ? buf->cap : BYTEBUF_MIN;
+  while (cap < buf->len + need)
+    cap *= 2;
+  if (!(buf->data = realloc(buf->data, cap))) {
+    perror("");
+    exit(0);
+  }
+  buf->cap = cap;
+}
+
+// fields of the words expanded so far, each an exact-length copy in arena
+typedef struct {
+  Arena *arena;
+  int isGlob;    // fields with unquoted '*', '?' or '[' become the paths
+                 // they match
+  ByteBuf field; // the one being built
+  int hasField;  // it counts even if it is empty, e.g. after ""
+  size_t *globs; // offsets of the unquoted '*', '?', '[' and ']' in field
+  size_t numGlobs, capGlobs;
+  char **fields;
+  size_t numFields, capFields;
+} Fields;
+
+static void *growArray(void *arr, size_t *cap, size_t need, size_t size) {
+  if (need <= *cap)
+    return arr;
+  size_t newCap = *cap ? *cap : 16;
+  while (newCap < need)
+    newCap *= 2;
+  if (!(arr = realloc(arr, newCap * size))) {
+    perror("");
+    exit(0);
+  }
+  *cap = newCap;
+  return arr;
+}
+
+static void pushField(Fields *fields, char *field) {
+  fields->fields = growArray(fields->fields, &fields->capFields,
+                             fields->numFields + 1, sizeof(char *));
+  fields->fields[fields->numFields++] = field;
+}
+
+static void pushGlob(Fields *fields, size_t offset) {
+  if (!fields->isGlob)
+    return;
+  fields->globs = growArray(fields->globs, &fields->capGlobs,
+                            fields->numGlobs + 1, sizeof(size_t));
+  fields->globs[fields->numGlobs++] = offset;
+}
+
+static int isGlobChar(char c) {
+  return c == '*' || c == '?' || c == '[' || c == ']';
+}
+
+// the field as a pattern for globPaths(), with what was quoted escaped
+static char *globPattern(Fields *fields) {
+  const char *data = fields->field.data;
+  char *pattern = arenaAlloc(fields->arena, 2 * fields->field.len + 1), *p;
+  p = pattern;
+  for (size_t i = 0, g = 0; i < fields->field.len; ++i) {
+    if (g < fields->numGlobs && fields->globs[g] == i)
+      ++g;
+    else if (isGlobChar(data[i]) || data[i] == '\\')
+      *p++ = '\\';
+    *p++ = data[i];
+  }
+  *p = '\0';
+  return pattern;
+}
+
+static void endField(Fields *fields) {
+  char *pattern = fields->numGlobs > 0 ? globPattern(fields) : NULL;
+  size_t numPaths = 0;
+  char **paths = pattern && isGlobPattern(pattern)
+                     ? globPaths(pattern, fields->arena, &numPaths)
+                     : NULL;
+  // a pattern that matches nothing stays as it is
+  for (size_t i = 0; i < numPaths; ++i)
+    pushField(fields, paths[i]);
+  if (numPaths == 0)
+    pushField(fields,
+              arenaStrndup(fields->arena,
+                           fields->field.data ? fields->field.data : "",
+                           fields->field.len));
+  fields->field.len = 0;
+  fields->hasField = 0;
+  fields->numGlobs = 0;
+}
+
+static void appendField(Fields *fields, const char *str, size_t len) {
+  if (len == 0)
+    return;
+  byteBufReserve(&fields->field, len);
+  memcpy(fields->field.data + fields->field.len, str, len);
+  fields->field.len += len;
+  fields->hasField = 1;
+}
+
+// word->text[from, to), with the glob characters in it, *iGlob is the
+// first of word->globs that is not behind from
+static void appendText(Fields *fields, const ExpWord *word, size_t from,
+                       size_t to, size_t *iGlob) {
+  for (; *iGlob < word->numGlobs && word->globs[*iGlob] < to; ++*iGlob)
+    pushGlob(fields, fields->field.len + word->globs[*iGlob] - from);
+  appendField(fields, word->text + from, to - from);
+}
+
+// split field.data[from, len) at spaces, tabs and newlines, in place, what
+// comes before from is part of the first field
+// glob characters in it are not quoted, so they match
+static void splitField(Fields *fields, size_t from) {
+  char *data = fields->field.data;
+  size_t end = fields->field.len, w = from;
+  for (size_t r = from; r < end; ++r) {
+    char c = data[r];
+    if (c == ' ' || c == '\t' || c == '\n') {
+      if (fields->hasField) {
+        fields->field.len = w;
+        endField(fields);
+        w = 0;
+      }
+    } else {
+      if (isGlobChar(c))
+        pushGlob(fields, w);
+      data[w++] = c;
+      fields->hasField = 1;
+    }
+  }
+  fields->field.len = w;
+}
+
+static void appendValue(Fields *fields, const char *value) {
+  size_t len = strlen(value);
+  byteBufReserve(&fields->field, len);
+  memcpy(fields->field.data + fields->field.len, value, len);
+  fields->field.len += len;
+}
+
+// value of $name, appended to the field, $@ and $* are the parameters
+// joined by spaces
+static void appendVar(Fields *fields, const char *name) {
+  char num[24];
+  const char *value = num;
+  if (strcmp(name, "?") == 0)
+    sprintf(num, "%d", lastStatus);
+  else if (strcmp(name, "$") == 0)
+    sprintf(num, "%d", (int)shellPid);
+  else if (strcmp(name, "#") == 0)
+    sprintf(num, "%zu", getNumParams());
+  else if (strcmp(name, "@") == 0 || strcmp(name, "*") == 0) {
+    for (size_t i = 1; i <= getNumParams(); ++i) {
+      if (i > 1)
+        appendValue(fields, " ");
+      appendValue(fields, getParam(i));
+    }
+    return;
+  } else if (isdigit((unsigned char)name[0])) {
+    if (!(value = getParam(strtoul(name, NULL, 10))))
+      return;
+  } else if (!(value = getVar(name)))
+    return;
+  appendValue(fields, value);
+}
+
+// "$@": each parameter is a field of its own, the first and the last joined
+// to the text around them, and with none, a word of "$@" alone is no field
+static void appendParamFields(Fields *fields, const ExpWord *word) {
+  size_t numParams = getNumParams();
+  for (size_t i = 1; i <= numParams; ++i) {
+    if (i > 1)
+      endField(fields);
+    appendValue(fields, getParam(i));
+    fields->hasField = 1;
+  }
+  if (numParams == 0 && word->numExps == 1 && !word->text[0])
+    fields->hasField = 0;
+}
+
+// the text of word with the output of its lists in place, as fields, or as
+// a single field if !isSplit
+// fields->isGlob: fields with glob characters become the paths they match
+static void expandInto(Fields *fields, const ExpWord *word, int isSplit) {
+  fields->field.len = 0;
+  fields->hasField = word->isQuoted || !isSplit;
+  fields->numGlobs = 0;
+  size_t pos = 0, iGlob = 0;
+  for (size_t i = 0; i < word->numExps; ++i) {
+    const Expansion *exp = &word->exps[i];
+    appendText(fields, word, pos, exp->offset, &iGlob);
+    pos = exp->offset;
+    size_t start = fields->field.len;
+    if (exp->varName && exp->isQuoted && isSplit &&
+        strcmp(exp->varName, "@") == 0) {
+      appendParamFields(fields, word);
+      continue;
+    }
+    if (exp->varName)
+      appendVar(fields, exp->varName);
+    else {
+      captureList(exp->list, &fields->field);
+      while (fields->field.len > start &&
+             fields->field.data[fields->field.len - 1] == '\n')
+        --fields->field.len;
+    }
+    if (isSplit && !exp->isQuoted)
+      splitField(fields, start);
+    else
+      fields->hasField = 1;
+  }
+  appendText(fields, word, pos, pos + strlen(word->text + pos), &iGlob);
+  if (fields->hasField)
+    endField(fields);
+}
+
+char **expandArgs(char *const *argv, size_t argc, const ExpWord *words,
+                  size_t numWords, Arena *arena, size_t *numArgs) {
+  Fields fields = {0};
+  fields.arena = arena;
+  fields.isGlob = 1;
+  for (size_t i = 0, w = 0; i < argc; ++i) {
+    if (w < numWords && words[w].argIdx == i)
+      expandInto(&fields, &words[w++], 1);
+    else
+      pushField(&fields, argv[i]);
+  }
+  char **args = arenaAlloc(arena, sizeof(char *) * (fields.numFields + 1));
+  if (fields.numFields > 0)
+    memcpy(args, fields.fields, sizeof(char *) * fields.numFields);
+  args[fields.numFields] = NULL;
+  *numArgs = fields.numFields;
+  free(fields.field.data);
+  free(fields.globs);
+  free(fields.fields);
+  return args;
+}
+
+char *expandWord(const ExpWord *word, Arena *arena) {
+  Fields fields = {0};
+  fields.arena = arena;
+  expandInto(&fields, word, 0);
+  char *field = fields.fields[0];
+  free(fields.field.data);
+  free(fields.fields);
+  return field;
+}
@@ -0,0 +1,41 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "parser.h"
+
+// words with $(...) or variables in them are expanded right before they are
+// used: the output of each list or the value of each variable goes in place
+// of it, and where it is unquoted it is split into fields at spaces, tabs
+// and newlines, so that one word can turn into no argument or many; fields
+// of arguments with unquoted '*', '?' or '[' then become the paths they
+// match, if there are any
+
+// remember the pid of the shell, $$ stays the same in subshells
+void expandInit(void);
+
+// growable bytes, e.g. a field with the output of $(...) in it
+typedef struct {
+  char *data;
+  size_t len, cap;
+} ByteBuf;
+
+// room for need more bytes after len
+void byteBufReserve(ByteBuf *buf, size_t need);
+
+// argv[0, argc) with the arguments in words expanded, NULL-terminated in
+// arena, the number of arguments goes to *numArgs
+char **expandArgs(char *const *argv, size_t argc, const ExpWord *words,
+                  size_t numWords, Arena *arena, size_t *numArgs);
+
+// one word that is not split, e.g. the target of a redirection
+char *expandWord(const ExpWord *word, Arena *arena);
+
+// defined in myshell.c, needs the whole shell state
+// run list as $(list) does and append its output to out
+void captureList(const Node *list, ByteBuf *out);
+extern int lastStatus; // exit status of the last command, for $?
+
+#endif
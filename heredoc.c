@@ -0,0 +1,55 @@
+#define _GNU_SOURCE // memfd_create, F_ADD_SEALS
+#include "heredoc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// PIPE_BUF: even a pipe cut down to one page by pipe-user-pages-soft takes
+// this much without a reader, so the write can never block
+#define HEREDOC_PIPE_MAX PIPE_BUF
+
+static int writeAll(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t lenWritten = write(fd, buf, len);
+    if (lenWritten == -1 && errno == EINTR)
+      continue;
+    if (lenWritten == -1)
+      return -1;
+    buf += lenWritten;
+    len -= (size_t)lenWritten;
+  }
+  return 0;
+}
+
+static int closeWithErrno(int fd) {
+  int err = errno;
+  close(fd);
+  errno = err;
+  return -1;
+}
+
+int openHereDoc(const char *body, size_t len) {
+  if (len <= HEREDOC_PIPE_MAX) {
+    int pipeFd[2];
+    if (pipe2(pipeFd, O_CLOEXEC) == -1)
+      return -1;
+    if (writeAll(pipeFd[1], body, len) == -1) {
+      closeWithErrno(pipeFd[1]);
+      return closeWithErrno(pipeFd[0]);
+    }
+    close(pipeFd[1]);
+    return pipeFd[0];
+  }
+  int fd = memfd_create("heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd == -1)
+    return -1;
+  if (writeAll(fd, body, len) == -1 ||
+      fcntl(fd, F_ADD_SEALS,
+            F_SEAL_WRITE | F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL) == -1 ||
+      lseek(fd, 0, SEEK_SET) == -1)
+    return closeWithErrno(fd);
+  return fd;
+}
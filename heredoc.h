@@ -0,0 +1,13 @@
+#ifndef HEREDOC_H
+#define HEREDOC_H
+
+#include <stddef.h>
+
+// stdin for a here-doc or here-string, nothing goes to disk:
+// a body that fits into any pipe is written into one, a larger one goes
+// into a memfd that is sealed against changes, so the command gets a
+// seekable fd, as it would for a file
+// returns an O_CLOEXEC fd positioned at the start, or -1 with errno set
+int openHereDoc(const char *body, size_t len);
+
+#endif
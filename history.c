@@ -0,0 +1,338 @@
+#define _GNU_SOURCE // mremap, memmem, memrchr
+#include "history.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HIST_MAP_MIN (1 << 20)
+#define HIST_BLOCK 2048 // records starting in 2KB of the file form a block
+#define BLOCK_BITS 4096 // trigram bitmap of one block
+#define MAX_QUERY_TRIGRAMS 64
+
+// ==========
+// search index
+// the records are grouped into blocks by where they start in the file, each
+// block with a bitmap of the hashed trigrams in its text
+// a query only scans the blocks that have all of its trigrams, which keeps
+// reverse search interactive on histories of millions of entries
+// a block is indexed when a search first reaches it and then kept up to date
+// as records come in, so the index costs nothing for a shell that never
+// searches, and a search that finds a recent entry never touches old blocks
+// ==========
+typedef struct {
+  size_t lenIndexed; // text of the block indexed so far, 0 before the first
+  uint64_t bits[BLOCK_BITS / 64];
+} HistBlock;
+
+static int histFd = -1;
+static char *histMap;  // the file, mapped ahead of its end for growth
+static size_t lenMap;
+static size_t lenSeen; // end of the last complete record
+static size_t posHidden; // entries before it are dropped by history -c
+static size_t numCounted, lenCounted; // records in [0, lenCounted)
+static HistBlock *blockArr;
+static size_t capBlocks;
+static char *lastLine; // last line recorded by this shell
+static char *recordBuf;
+static size_t capRecordBuf;
+
+static void *growArray(void *arr, size_t *cap, size_t need, size_t size) {
+  if (need <= *cap)
+    return arr;
+  size_t newCap = *cap ? *cap : 64;
+  while (newCap < need)
+    newCap *= 2;
+  if (!(arr = realloc(arr, newCap * size))) {
+    perror("");
+    exit(0);
+  }
+  *cap = newCap;
+  return arr;
+}
+
+// map at least [0, need) of the file
+// pages past the end of the file become readable as the file grows, so
+// appends only need a new mapping once the reserve is used up
+static int mapHistory(size_t need) {
+  if (need <= lenMap)
+    return 0;
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t len = 2 * need < HIST_MAP_MIN ? HIST_MAP_MIN : 2 * need;
+  len = (len + page - 1) / page * page;
+  void *map = histMap ? mremap(histMap, lenMap, len, MREMAP_MAYMOVE)
+                      : mmap(NULL, len, PROT_READ, MAP_SHARED, histFd, 0);
+  if (map == MAP_FAILED)
+    return -1;
+  histMap = map;
+  lenMap = len;
+  return 0;
+}
+
+void historyInit(void) {
+  const char *fileName = getenv("HISTFILE");
+  char pathBuf[PATH_MAX];
+  if (!fileName) {
+    const char *home = getenv("HOME");
+    if (!home ||
+        snprintf(pathBuf, PATH_MAX, "%s/.myshell_history", home) >= PATH_MAX)
+      return;
+    fileName = pathBuf;
+  }
+  if ((histFd = open(fileName, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+                     S_IRUSR | S_IWUSR)) == -1)
+    return;
+  struct stat st;
+  if (fstat(histFd, &st) == -1 || mapHistory((size_t)st.st_size) == -1) {
+    close(histFd);
+    histFd = -1;
+  }
+}
+
+// start of the first record at or after pos
+static size_t recordStart(size_t pos) {
+  if (pos == 0 || pos >= lenSeen)
+    return pos < lenSeen ? pos : lenSeen;
+  const char *newline = memchr(histMap + pos - 1, '\n', lenSeen - pos + 1);
+  return (size_t)(newline + 1 - histMap);
+}
+
+static unsigned hashTrigram(const char *str) {
+  uint32_t tri = (uint32_t)(unsigned char)str[0] << 16 |
+                 (uint32_t)(unsigned char)str[1] << 8 |
+                 (uint32_t)(unsigned char)str[2];
+  return (tri * 2654435761u) >> (32 - 12); // 12 bits for BLOCK_BITS
+}
+
+// bring the bitmap of block b up to the records that have come in
+static HistBlock *indexBlock(size_t b, size_t start, size_t end) {
+  if (b >= capBlocks) {
+    size_t newCap = capBlocks ? capBlocks : 64;
+    while (newCap <= b)
+      newCap *= 2;
+    if (!(blockArr = realloc(blockArr, newCap * sizeof(HistBlock)))) {
+      perror("");
+      exit(0);
+    }
+    memset(blockArr + capBlocks, 0, (newCap - capBlocks) * sizeof(HistBlock));
+    capBlocks = newCap;
+  }
+  HistBlock *block = &blockArr[b];
+  const unsigned char *text = (const unsigned char *)histMap + start;
+  // trigrams across the '\n' of a record only cost a false candidate
+  size_t len = end - start;
+  size_t i = block->lenIndexed >= 2 ? block->lenIndexed - 2 : 0;
+  uint32_t tri = 0;
+  for (size_t j = i; j < len && j < i + 2; ++j)
+    tri = tri << 8 | text[j];
+  for (i += 2; i < len; ++i) {
+    // the same hash as hashTrigram(), rolled along the text
+    tri = (tri << 8 | text[i]) & 0xffffff;
+    unsigned h = (tri * 2654435761u) >> (32 - 12);
+    block->bits[h / 64] |= 1ULL << (h % 64);
+  }
+  block->lenIndexed = len;
+  return block;
+}
+
+static void resetEntries(void) {
+  lenSeen = 0;
+  posHidden = 0;
+  numCounted = 0;
+  lenCounted = 0;
+  if (blockArr)
+    memset(blockArr, 0, capBlocks * sizeof(HistBlock));
+}
+
+// take in the records appended since the last call, by any shell
+static void syncHistory(void) {
+  struct stat st;
+  if (histFd == -1 || fstat(histFd, &st) == -1)
+    return;
+  size_t size = (size_t)st.st_size;
+  if (size < lenSeen) // truncated behind our back
+    resetEntries();
+  if (size == lenSeen || mapHistory(size) == -1)
+    return;
+  const char *newline = memrchr(histMap + lenSeen, '\n', size - lenSeen);
+  if (newline)
+    lenSeen = (size_t)(newline + 1 - histMap);
+}
+
+void addHistory(const char *line, size_t len) {
+  if (histFd == -1)
+    return;
+  if (len > 0 && line[len - 1] == '\n')
+    --len;
+  size_t i = 0;
+  while (i < len && (line[i] == ' ' || line[i] == '\t' || line[i] == '\n'))
+    ++i;
+  if (i == len)
+    return;
+  if (lastLine && strlen(lastLine) == len && memcmp(lastLine, line, len) == 0)
+    return;
+  free(lastLine);
+  if ((lastLine = malloc(len + 1))) {
+    memcpy(lastLine, line, len);
+    lastLine[len] = '\0';
+  }
+  recordBuf = growArray(recordBuf, &capRecordBuf, len + 1, 1);
+  for (i = 0; i < len; ++i)
+    recordBuf[i] = line[i] == '\n' ? '\0' : line[i];
+  recordBuf[len] = '\n';
+  // one write() per record, O_APPEND puts it whole at the end of the file
+  if (write(histFd, recordBuf, len + 1) == -1)
+    perror("history");
+}
+
+size_t historyEnd(void) {
+  syncHistory();
+  return lenSeen;
+}
+
+const char *historyEntry(size_t pos, size_t *len) {
+  const char *text = histMap + pos;
+  *len = (size_t)((char *)memchr(text, '\n', lenSeen - pos) - text);
+  return text;
+}
+
+// last occurrence of query in [start, end), found backwards from the end
+static const char *lastMatch(const char *start, const char *end,
+                             const char *query, size_t lenQuery) {
+  if (lenQuery == 0)
+    return end > start ? end - 1 : NULL;
+  char lastChar = query[lenQuery - 1];
+  while (end - start >= (ptrdiff_t)lenQuery) {
+    const char *last = memrchr(start + lenQuery - 1, lastChar,
+                               (size_t)(end - start) - (lenQuery - 1));
+    if (!last)
+      return NULL;
+    if (memcmp(last + 1 - lenQuery, query, lenQuery) == 0)
+      return last + 1 - lenQuery;
+    end = last;
+  }
+  return NULL;
+}
+
+long searchHistory(const char *query, size_t lenQuery, size_t before) {
+  syncHistory();
+  if (lenSeen == 0 || before <= posHidden)
+    return -1;
+  before = recordStart(before); // the entry at before - 1 is included
+  unsigned hashArr[MAX_QUERY_TRIGRAMS];
+  size_t numHash = 0;
+  for (size_t i = 0; i + 3 <= lenQuery && numHash < MAX_QUERY_TRIGRAMS; ++i)
+    hashArr[numHash++] = hashTrigram(query + i);
+  size_t firstBlock = posHidden / HIST_BLOCK;
+  for (size_t b = (before - 1) / HIST_BLOCK + 1; b-- > firstBlock;) {
+    size_t start = recordStart(b * HIST_BLOCK);
+    size_t end = recordStart((b + 1) * HIST_BLOCK);
+    if (start >= end) // inside a record that started in an earlier block
+      continue;
+    // a query shorter than a trigram has to scan every block anyway
+    if (numHash > 0) {
+      const HistBlock *block = indexBlock(b, start, end);
+      int isCandidate = 1;
+      for (size_t i = 0; isCandidate && i < numHash; ++i)
+        isCandidate = (block->bits[hashArr[i] / 64] >> (hashArr[i] % 64)) & 1;
+      if (!isCandidate)
+        continue;
+    }
+    // the newest match first, a match never spans records as the query has
+    // no '\n'
+    if (start < posHidden)
+      start = posHidden;
+    if (end > before)
+      end = before;
+    const char *found = lastMatch(histMap + start, histMap + end, query,
+                                  lenQuery);
+    if (found) {
+      const char *newline = memrchr(histMap, '\n', (size_t)(found - histMap));
+      return newline ? newline + 1 - histMap : 0;
+    }
+  }
+  return -1;
+}
+
+static size_t countRecords(size_t start, size_t end) {
+  size_t num = 0;
+  const char *pos = histMap + start, *newline;
+  while ((newline = memchr(pos, '\n', (size_t)(histMap + end - pos)))) {
+    ++num;
+    pos = newline + 1;
+  }
+  return num;
+}
+
+// history      all entries, numbered
+// history n    the last n entries
+// history -c   clear the history of this shell, the file is kept for the
+//              other shells that append to it
+int historyBuiltin(char **cmdArgv) {
+  syncHistory();
+  size_t start = posHidden;
+  if (cmdArgv[1] && strcmp(cmdArgv[1], "-c") == 0) {
+    posHidden = lenSeen;
+    return 0;
+  }
+  if (cmdArgv[1]) {
+    char *end;
+    long n = strtol(cmdArgv[1], &end, 10);
+    if (*end || n < 0) {
+      printf("history: %s: numeric argument required\n", cmdArgv[1]);
+      return 1;
+    }
+    // walk back n records from the end
+    size_t pos = lenSeen;
+    for (; n > 0 && pos > start; --n) {
+      const char *newline = memrchr(histMap + start, '\n', pos - 1 - start);
+      pos = newline ? (size_t)(newline + 1 - histMap) : start;
+    }
+    start = pos;
+  }
+  // entries are numbered from the start of the file
+  numCounted += countRecords(lenCounted, lenSeen);
+  lenCounted = lenSeen;
+  size_t num = numCounted - countRecords(start, lenSeen);
+  for (size_t pos = start; pos < lenSeen;) {
+    size_t len;
+    const char *text = historyEntry(pos, &len);
+    pos += len + 1;
+    printf("%5zu  ", ++num);
+    // inner newlines come back from their '\0'
+    for (const char *nul; (nul = memchr(text, '\0', len));) {
+      fwrite(text, 1, (size_t)(nul - text), stdout);
+      putchar('\n');
+      len -= (size_t)(nul + 1 - text);
+      text = nul + 1;
+    }
+    fwrite(text, 1, len, stdout);
+    putchar('\n');
+  }
+  return 0;
+}
+
+void freeHistory(void) {
+  if (histMap)
+    munmap(histMap, lenMap);
+  if (histFd != -1)
+    close(histFd);
+  free(blockArr);
+  free(lastLine);
+  free(recordBuf);
+  histMap = NULL;
+  histFd = -1;
+  blockArr = NULL;
+  lastLine = NULL;
+  recordBuf = NULL;
+  lenMap = 0;
+  capBlocks = 0;
+  capRecordBuf = 0;
+  resetEntries();
+}
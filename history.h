@@ -0,0 +1,39 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+
+// command history in $HISTFILE, ~/.myshell_history by default
+// the file is an append-only log: one record per command line, written with
+// a single write() to an O_APPEND fd, so that shells running at the same
+// time never interleave inside a record
+// a record ends with '\n', newlines inside the command are stored as '\0'
+// the file is mapped rather than read, nothing of it is looked at until the
+// history is first used, so startup does not grow with the history
+
+// open and map the history file, without it history is off
+void historyInit(void);
+
+// record a command line, a trailing '\n' is dropped
+// empty lines and repeats of the previous line are not recorded
+void addHistory(const char *line, size_t len);
+
+// entries are addressed by the offset of their record in the file
+// end of the last record, records appended by other shells included
+size_t historyEnd(void);
+
+// entry at pos, as stored: no '\n' at the end and '\0' for inner newlines
+// stays valid until the next call into the history
+const char *historyEntry(size_t pos, size_t *len);
+
+// newest entry that starts before pos `before` and contains query
+// historyEnd() as before starts at the newest entry
+// returns its pos, or -1 if there is none
+long searchHistory(const char *query, size_t lenQuery, size_t before);
+
+// history [-c] [n]
+int historyBuiltin(char **cmdArgv);
+
+void freeHistory(void);
+
+#endif
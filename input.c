@@ -0,0 +1,97 @@
+#include "input.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define INPUT_BLOCK 65536
+
+void inputOpenFd(InputReader *input, int fd) {
+  input->fd = fd;
+  input->cap = INPUT_BLOCK;
+  if (!(input->buf = malloc(input->cap))) {
+    perror("");
+    exit(1);
+  }
+  input->start = 0;
+  input->end = 0;
+  input->isEof = 0;
+  input->waitReadable = NULL;
+}
+
+void inputOpenString(InputReader *input, const char *str) {
+  input->fd = -1;
+  input->buf = (char *)str; // never written to, nor freed
+  input->cap = strlen(str);
+  input->start = 0;
+  input->end = input->cap;
+  input->isEof = 1;
+  input->waitReadable = NULL;
+}
+
+ssize_t inputReadLine(InputReader *input, const char **line) {
+  size_t searched = input->start;
+  while (1) {
+    char *newline =
+        memchr(input->buf + searched, '\n', input->end - searched);
+    if (newline || (input->isEof && input->start < input->end)) {
+      size_t lenLine = newline
+                           ? (size_t)(newline - input->buf) + 1 - input->start
+                           : input->end - input->start;
+      *line = input->buf + input->start;
+      input->start += lenLine;
+      return (ssize_t)lenLine;
+    }
+    if (input->isEof)
+      return INPUT_EOF;
+    // no complete line buffered, move the partial one to the front and
+    // make room for one more block
+    searched = input->end - input->start;
+    memmove(input->buf, input->buf + input->start, searched);
+    input->end = searched;
+    input->start = 0;
+    if (input->cap - input->end < INPUT_BLOCK / 2) {
+      input->cap *= 2;
+      if (!(input->buf = realloc(input->buf, input->cap))) {
+        perror("");
+        exit(1);
+      }
+    }
+    if (input->waitReadable && input->waitReadable(input->fd) == -1)
+      return INPUT_INTR;
+    uint64_t traceAt = TRACE_NOW();
+    ssize_t lenRead =
+        read(input->fd, input->buf + input->end, input->cap - input->end);
+    TRACE("read", traceAt, "bytes", (long)lenRead, NULL);
+    if (lenRead == -1 && errno == EINTR)
+      return INPUT_INTR;
+    if (lenRead <= 0)
+      input->isEof = 1;
+    else
+      input->end += (size_t)lenRead;
+  }
+}
+
+int inputAtEnd(const InputReader *input) {
+  return input->isEof && input->start == input->end;
+}
+
+void inputSync(InputReader *input) {
+  if (input->fd == -1 || input->start == input->end)
+    return;
+  if (lseek(input->fd, -(off_t)(input->end - input->start), SEEK_CUR) != -1) {
+    input->start = 0;
+    input->end = 0;
+    input->isEof = 0;
+  }
+}
+
+void inputClose(InputReader *input) {
+  if (input->fd != -1)
+    free(input->buf);
+  input->buf = NULL;
+}
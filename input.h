@@ -0,0 +1,37 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define INPUT_EOF -1
+#define INPUT_INTR -2 // read() interrupted by a signal, e.g. ctrl+c
+
+// line reader over large read() blocks, or over an in-memory string for -c
+typedef struct {
+  int fd; // -1 for a string
+  char *buf;
+  size_t start, end, cap; // unread input is buf[start, end)
+  int isEof;
+  // called before each read(), returns -1 if interrupted, may be NULL
+  int (*waitReadable)(int fd);
+} InputReader;
+
+void inputOpenFd(InputReader *input, int fd);
+void inputOpenString(InputReader *input, const char *str);
+
+// next line including its '\n' (the last one may lack it)
+// *line points into the reader and stays valid until the next call
+// returns the length, INPUT_EOF or INPUT_INTR
+ssize_t inputReadLine(InputReader *input, const char **line);
+
+// no input is left, only meaningful for strings
+int inputAtEnd(const InputReader *input);
+
+// give read-ahead back to a seekable fd, so that a child reading the same
+// fd starts right after the current command line
+void inputSync(InputReader *input);
+
+void inputClose(InputReader *input);
+
+#endif
@@ -0,0 +1,862 @@
+#define _GNU_SOURCE // sigabbrev_np
+#include "jobs.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define INPUT_TAG UINT64_MAX
+#define JOBS_TAG (UINT64_MAX - 1)
+#define SIGNAL_TAG (UINT64_MAX - 2) // the SIGCHLD signalfd, in jobEpollFd
+#define HIDDEN_BIT (1ULL << 63) // in the tag of a hidden child
+#define MAX_EVENTS 32
+#define MAX_DONE_JOBS 1024 // finished jobs whose status wait can still get
+
+typedef struct {
+  char *line;   // NULL for a free slot
+  pid_t *pids;  // 0 once reaped
+  pid_t *startPids; // as started, for the status kept once it finishes
+  int *pidFds;  // -1 once reaped, or if pidfd_open() is not available
+  char **limitDescs; // of each stage, NULL for none
+  size_t numPids, numLive;
+  int status;   // of the last stage
+  unsigned seq; // tells a reused slot from the job that was there before
+  pid_t pgid;   // 0 without job control
+  char *isStopped; // of each stage
+  size_t numStopped;
+  struct termios termios; // modes the job stopped with, for fg
+  int hasTermios;
+} Job;
+
+// a job that finished before anybody waited for it
+typedef struct {
+  size_t num; // the job number it had
+  pid_t *pids;
+  size_t numPids;
+  int status;
+} DoneJob;
+
+// job n lives in jobArr[n - 1], freed slots are reused lowest first
+static Job *jobArr;
+static size_t numJobSlots, capJobSlots, numLiveJobs;
+static unsigned jobSeq;
+static int jobEpollFd = -1;   // pidfds of all live children
+static int inputEpollFd = -1; // jobEpollFd and the shell's input
+static int isInputPolled, isJobNotify;
+static const char *jobPrompt;
+static int isAtPrompt, numNotices;
+static unsigned long noticeCount; // notices printed since the start
+// last finished job and the job a wait is for
+static unsigned doneSeq, waitSeq;
+static int doneStatus, waitStatus;
+// job control: the terminal, the group of the shell and the group that
+// had the terminal before it, the current job of %% and fg, and the job fg
+// runs, which finishes without a notice
+static int isJobCtl, termFd = -1, signalFd = -1;
+static pid_t shellPgid, origPgid;
+static struct termios shellTermios;
+static unsigned curSeq, fgSeq;
+// hidden children, slot i is free if hiddenPids[i] is 0
+static pid_t *hiddenPids;
+static int *hiddenPidFds;
+static size_t numHiddenSlots, numHidden;
+// oldest first, the oldest are dropped beyond MAX_DONE_JOBS
+static DoneJob *doneJobs;
+static size_t numDoneJobs, capDoneJobs;
+
+void jobsInit(int isNotify, int inputFd) {
+  isJobNotify = isNotify;
+  if ((jobEpollFd = epoll_create1(EPOLL_CLOEXEC)) == -1 ||
+      (inputEpollFd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+    perror("");
+    exit(1);
+  }
+  struct epoll_event event = {.events = EPOLLIN, .data.u64 = JOBS_TAG};
+  epoll_ctl(inputEpollFd, EPOLL_CTL_ADD, jobEpollFd, &event);
+  // fails with EPERM for regular files, which are always readable anyway
+  event.data.u64 = INPUT_TAG;
+  isInputPolled = inputFd != -1 &&
+                  epoll_ctl(inputEpollFd, EPOLL_CTL_ADD, inputFd, &event) == 0;
+}
+
+int jobControlInit(int fd) {
+  // started in the background of another shell, wait to be brought to the
+  // foreground
+  pid_t pgid;
+  while ((pgid = getpgrp()) != tcgetpgrp(fd)) {
+    if (tcgetpgrp(fd) == -1)
+      return -1;
+    kill(-pgid, SIGTTIN);
+  }
+  origPgid = pgid;
+  signal(SIGTSTP, SIG_IGN);
+  signal(SIGTTIN, SIG_IGN);
+  signal(SIGTTOU, SIG_IGN);
+  // a session leader is in its own group already and gets EPERM
+  setpgid(0, 0);
+  shellPgid = getpgrp();
+  if (tcsetpgrp(fd, shellPgid) == -1 || tcgetattr(fd, &shellTermios) == -1)
+    return -1;
+  // pidfds only tell of exits, stops and continues come as SIGCHLD, read
+  // from a signalfd, so that no handler runs in the middle of the shell
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &mask, NULL);
+  if ((signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) {
+    perror("");
+    exit(1);
+  }
+  struct epoll_event event = {.events = EPOLLIN, .data.u64 = SIGNAL_TAG};
+  epoll_ctl(jobEpollFd, EPOLL_CTL_ADD, signalFd, &event);
+  termFd = fd;
+  isJobCtl = 1;
+  return 0;
+}
+
+int jobTerminal(void) { return isJobCtl ? termFd : -1; }
+
+void leaveJobControl(void) {
+  if (!isJobCtl)
+    return;
+  isJobCtl = 0;
+  // only closed, the epoll set is the parent's too
+  close(signalFd);
+  signalFd = -1;
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigprocmask(SIG_UNBLOCK, &mask, NULL);
+}
+
+void takeTerminal(int isRestoreModes) {
+  if (!isJobCtl)
+    return;
+  tcsetpgrp(termFd, shellPgid);
+  // modes a job leaves behind when it exits, e.g. from stty, are kept
+  if (isRestoreModes)
+    tcsetattr(termFd, TCSADRAIN, &shellTermios);
+  else
+    tcgetattr(termFd, &shellTermios);
+}
+
+void setJobPrompt(const char *prompt) { jobPrompt = prompt; }
+
+unsigned long jobNoticeCount(void) { return noticeCount; }
+
+static int statusOf(int status) {
+  if (WIFEXITED(status))
+    return WEXITSTATUS(status);
+  if (WIFSIGNALED(status))
+    return 128 + WTERMSIG(status);
+  return 128 + WSTOPSIG(status);
+}
+
+static void freeJob(Job *job) {
+  for (size_t stage = 0; job->limitDescs && stage < job->numPids; ++stage)
+    free(job->limitDescs[stage]);
+  free(job->line);
+  free(job->pids);
+  free(job->startPids);
+  free(job->pidFds);
+  free(job->limitDescs);
+  free(job->isStopped);
+  memset(job, 0, sizeof(Job));
+}
+
+static void jobNotice(size_t idx, const char *state) {
+  if (!isJobNotify)
+    return;
+  // the cursor is behind the prompt, start on a new line
+  if (isAtPrompt && numNotices == 0)
+    printf("\n");
+  printf("[%zu] %s %s\n", idx + 1, state, jobArr[idx].line);
+  ++numNotices;
+  ++noticeCount;
+}
+
+// keep the status of a finished job for a later wait %n or wait pid
+static void keepDoneJob(size_t idx) {
+  Job *job = &jobArr[idx];
+  if (numDoneJobs == MAX_DONE_JOBS) {
+    free(doneJobs[0].pids);
+    memmove(doneJobs, doneJobs + 1, sizeof(DoneJob) * --numDoneJobs);
+  }
+  if (numDoneJobs == capDoneJobs) {
+    capDoneJobs = capDoneJobs ? 2 * capDoneJobs : 16;
+    if (!(doneJobs = realloc(doneJobs, sizeof(DoneJob) * capDoneJobs))) {
+      perror("");
+      exit(1);
+    }
+  }
+  doneJobs[numDoneJobs++] =
+      (DoneJob){idx + 1, job->startPids, job->numPids, job->status};
+  job->startPids = NULL;
+}
+
+// the status kept for "%n" or a pid, which wait takes only once
+// returns -1 if there is none
+static int takeDoneJob(const char *spec) {
+  char *end;
+  long n = strtol(spec + (spec[0] == '%'), &end, 10);
+  if (*end || n <= 0)
+    return -1;
+  // the newest first, a job number may have been used again since
+  for (size_t i = numDoneJobs; i-- > 0;) {
+    DoneJob *done = &doneJobs[i];
+    int isFound = spec[0] == '%' && done->num == (size_t)n;
+    for (size_t stage = 0; spec[0] != '%' && stage < done->numPids; ++stage)
+      isFound |= done->pids[stage] == n;
+    if (!isFound)
+      continue;
+    int status = done->status;
+    free(done->pids);
+    memmove(done, done + 1, sizeof(DoneJob) * (--numDoneJobs - i));
+    return status;
+  }
+  return -1;
+}
+
+static void clearDoneJobs(void) {
+  for (size_t i = 0; i < numDoneJobs; ++i)
+    free(doneJobs[i].pids);
+  numDoneJobs = 0;
+}
+
+static void finishJob(size_t idx) {
+  Job *job = &jobArr[idx];
+  if (job->seq != fgSeq)
+    jobNotice(idx, "done");
+  doneSeq = job->seq;
+  doneStatus = job->status;
+  if (job->seq == waitSeq)
+    waitStatus = job->status;
+  else if (job->seq != fgSeq)
+    keepDoneJob(idx);
+  freeJob(job);
+  --numLiveJobs;
+}
+
+// the stage has been reaped with status, as $? shows it
+static void endStage(size_t idx, size_t stage, int status) {
+  Job *job = &jobArr[idx];
+  TRACE("reap", TRACE_NOW(), "status", status, NULL);
+  if (stage == job->numPids - 1)
+    job->status = status;
+  if (job->isStopped[stage]) {
+    job->isStopped[stage] = 0;
+    --job->numStopped;
+  }
+  // a child spawned meanwhile may still hold a copy of the pidfd until its
+  // exec is done, so closing alone would not take it out of the epoll set
+  if (job->pidFds[stage] != -1) {
+    epoll_ctl(jobEpollFd, EPOLL_CTL_DEL, job->pidFds[stage], NULL);
+    close(job->pidFds[stage]);
+  }
+  job->pidFds[stage] = -1;
+  job->pids[stage] = 0;
+  if (--job->numLive == 0)
+    finishJob(idx);
+}
+
+// returns 1 if the stage has been reaped
+static int reapStage(size_t idx, size_t stage, int options) {
+  Job *job = &jobArr[idx];
+  // a scan for stops may have reaped it already
+  if (!job->line || job->pids[stage] <= 0)
+    return 0;
+  int status = 0;
+  pid_t ret = waitpid(job->pids[stage], &status, options);
+  if (ret == 0 || (ret == -1 && errno == EINTR))
+    return 0;
+  endStage(idx, stage, ret == -1 ? 127 : statusOf(status));
+  return 1;
+}
+
+static void markStage(size_t idx, size_t stage, int isStop) {
+  Job *job = &jobArr[idx];
+  if (job->isStopped[stage] == isStop)
+    return;
+  job->isStopped[stage] = (char)isStop;
+  if (!isStop) {
+    --job->numStopped;
+    return;
+  }
+  if (job->numStopped++ == 0) {
+    curSeq = job->seq;
+    jobNotice(idx, "stopped");
+  }
+}
+
+// stages that stopped or went on, e.g. from a signal sent elsewhere
+static void scanStages(void) {
+  for (size_t idx = 0; idx < numJobSlots; ++idx) {
+    for (size_t stage = 0; jobArr[idx].line && stage < jobArr[idx].numPids;
+         ++stage) {
+      int status;
+      if (jobArr[idx].pids[stage] <= 0 ||
+          waitpid(jobArr[idx].pids[stage], &status,
+                  WNOHANG | WUNTRACED | WCONTINUED) <= 0)
+        continue;
+      if (WIFSTOPPED(status))
+        markStage(idx, stage, 1);
+      else if (WIFCONTINUED(status))
+        markStage(idx, stage, 0);
+      else
+        endStage(idx, stage, statusOf(status));
+    }
+  }
+}
+
+static void reapHidden(size_t slot) {
+  if (waitpid(hiddenPids[slot], NULL, WNOHANG) != hiddenPids[slot])
+    return;
+  if (hiddenPidFds[slot] != -1) {
+    epoll_ctl(jobEpollFd, EPOLL_CTL_DEL, hiddenPidFds[slot], NULL);
+    close(hiddenPidFds[slot]);
+  }
+  hiddenPids[slot] = 0;
+  --numHidden;
+}
+
+void addHiddenChild(pid_t pid) {
+  size_t slot = 0;
+  while (slot < numHiddenSlots && hiddenPids[slot])
+    ++slot;
+  if (slot == numHiddenSlots) {
+    numHiddenSlots = numHiddenSlots ? 2 * numHiddenSlots : 8;
+    if (!(hiddenPids = realloc(hiddenPids, sizeof(pid_t) * numHiddenSlots)) ||
+        !(hiddenPidFds = realloc(hiddenPidFds, sizeof(int) * numHiddenSlots))) {
+      perror("");
+      exit(1);
+    }
+    for (size_t i = slot; i < numHiddenSlots; ++i)
+      hiddenPids[i] = 0;
+  }
+  hiddenPids[slot] = pid;
+  hiddenPidFds[slot] = (int)syscall(SYS_pidfd_open, pid, 0);
+  if (hiddenPidFds[slot] != -1) {
+    struct epoll_event event = {.events = EPOLLIN,
+                                .data.u64 = HIDDEN_BIT | slot};
+    epoll_ctl(jobEpollFd, EPOLL_CTL_ADD, hiddenPidFds[slot], &event);
+  }
+  ++numHidden;
+}
+
+// handle exited children, timeout as for epoll_wait()
+// returns -1 when interrupted by a signal
+static int processJobEvents(int timeout) {
+  struct epoll_event events[MAX_EVENTS];
+  int numEvents = epoll_wait(jobEpollFd, events, MAX_EVENTS, timeout);
+  if (numEvents == -1)
+    return errno == EINTR ? -1 : 0;
+  numNotices = 0;
+  for (int i = 0; i < numEvents; ++i) {
+    uint64_t tag = events[i].data.u64;
+    if (tag == SIGNAL_TAG) {
+      struct signalfd_siginfo info;
+      if (signalFd == -1) // a forked child, see leaveJobControl()
+        continue;
+      while (read(signalFd, &info, sizeof(info)) == sizeof(info))
+        ;
+      scanStages();
+    } else if (tag & HIDDEN_BIT)
+      reapHidden((size_t)(tag & ~HIDDEN_BIT));
+    else
+      reapStage((size_t)(tag >> 32), (size_t)(tag & UINT32_MAX), WNOHANG);
+  }
+  // children without a pidfd can only be polled
+  for (size_t idx = 0; idx < numJobSlots; ++idx) {
+    for (size_t stage = 0; jobArr[idx].line && stage < jobArr[idx].numPids;
+         ++stage) {
+      if (jobArr[idx].pids[stage] > 0 && jobArr[idx].pidFds[stage] == -1)
+        reapStage(idx, stage, WNOHANG);
+    }
+  }
+  for (size_t slot = 0; slot < numHiddenSlots; ++slot)
+    if (hiddenPids[slot] && hiddenPidFds[slot] == -1)
+      reapHidden(slot);
+  if (numNotices > 0) {
+    if (isAtPrompt && jobPrompt)
+      printf("%s", jobPrompt);
+    fflush(stdout);
+  }
+  return 0;
+}
+
+int addJob(const pid_t *pids, size_t numPids, const char *line,
+           const char *const *limitDescs, pid_t pgid, int isStopped) {
+  size_t idx = 0;
+  while (idx < numJobSlots && jobArr[idx].line)
+    ++idx;
+  if (idx == capJobSlots) {
+    capJobSlots = capJobSlots ? 2 * capJobSlots : 16;
+    if (!(jobArr = realloc(jobArr, sizeof(Job) * capJobSlots))) {
+      perror("");
+      exit(1);
+    }
+  }
+  if (idx == numJobSlots)
+    ++numJobSlots;
+  Job *job = &jobArr[idx];
+  job->pids = malloc(sizeof(pid_t) * numPids);
+  job->startPids = malloc(sizeof(pid_t) * numPids);
+  job->pidFds = malloc(sizeof(int) * numPids);
+  job->limitDescs = limitDescs ? malloc(sizeof(char *) * numPids) : NULL;
+  job->isStopped = malloc(numPids);
+  job->numPids = 0;
+  job->numLive = 0;
+  job->numStopped = 0;
+  job->status = 0;
+  job->seq = ++jobSeq;
+  job->pgid = pgid;
+  job->hasTermios = 0;
+  for (size_t i = 0; i < numPids; ++i) {
+    if (pids[i] <= 0)
+      continue;
+    size_t stage = job->numPids++;
+    job->pids[stage] = job->startPids[stage] = pids[i];
+    job->isStopped[stage] = (char)isStopped;
+    if (job->limitDescs)
+      job->limitDescs[stage] = limitDescs[i] ? strdup(limitDescs[i]) : NULL;
+    job->pidFds[stage] = (int)syscall(SYS_pidfd_open, pids[i], 0);
+    if (job->pidFds[stage] != -1) {
+      struct epoll_event event = {.events = EPOLLIN,
+                                  .data.u64 = (uint64_t)idx << 32 | stage};
+      epoll_ctl(jobEpollFd, EPOLL_CTL_ADD, job->pidFds[stage], &event);
+    }
+    ++job->numLive;
+  }
+  if (job->numLive == 0) {
+    freeJob(job);
+    return 0;
+  }
+  job->line = strdup(line);
+  ++numLiveJobs;
+  curSeq = job->seq;
+  if (isStopped) {
+    // the stages that had not been waited for, all stopped by the same key
+    job->numStopped = job->numLive;
+    job->hasTermios = isJobCtl && tcgetattr(termFd, &job->termios) == 0;
+    // the cursor is behind the ^Z the terminal echoed
+    if (isJobNotify)
+      printf("\n");
+    jobNotice(idx, "stopped");
+  } else if (isJobNotify)
+    printf("[%zu] %s\n", idx + 1, line);
+  return (int)idx + 1;
+}
+
+void reapJobs(void) {
+  if (numLiveJobs > 0 || numHidden > 0)
+    processJobEvents(0);
+}
+
+int waitForInput(int fd) {
+  (void)fd; // registered in jobsInit()
+  if (!isInputPolled) {
+    reapJobs();
+    return 0;
+  }
+  isAtPrompt = 1;
+  while (1) {
+    struct epoll_event events[2];
+    int numEvents = epoll_wait(inputEpollFd, events, 2, -1);
+    if (numEvents == -1 && errno == EINTR) {
+      isAtPrompt = 0;
+      return -1;
+    }
+    int isReadable = numEvents == -1; // epoll broken, let read() block
+    for (int i = 0; i < numEvents; ++i) {
+      if (events[i].data.u64 == JOBS_TAG)
+        processJobEvents(0);
+      else
+        isReadable = 1;
+    }
+    if (isReadable) {
+      isAtPrompt = 0;
+      return 0;
+    }
+  }
+}
+
+int jobsBuiltin(char **cmdArgv) {
+  int isLong = cmdArgv[1] && strcmp(cmdArgv[1], "-l") == 0;
+  reapJobs();
+  for (size_t idx = 0; idx < numJobSlots; ++idx) {
+    Job *job = &jobArr[idx];
+    if (!job->line)
+      continue;
+    printf("[%zu] %s %s\n", idx + 1,
+           job->numStopped > 0 ? "stopped" : "running", job->line);
+    for (size_t stage = 0; isLong && stage < job->numPids; ++stage) {
+      if (job->pids[stage] <= 0)
+        continue;
+      const char *desc = job->limitDescs ? job->limitDescs[stage] : NULL;
+      printf("    %d%s%s\n", (int)job->pids[stage], desc ? " " : "",
+             desc ? desc : "");
+    }
+  }
+  return 0;
+}
+
+// the job last started or stopped, or else the newest one, -1 if none
+static long currentJob(void) {
+  long found = -1;
+  for (size_t idx = 0; idx < numJobSlots; ++idx) {
+    if (!jobArr[idx].line)
+      continue;
+    if (jobArr[idx].seq == curSeq)
+      return (long)idx;
+    if (found == -1 || jobArr[idx].seq > jobArr[found].seq)
+      found = (long)idx;
+  }
+  return found;
+}
+
+// job of "%n", "%%", "%+" or of a pid, -1 if there is none
+static long findJob(const char *spec) {
+  char *end;
+  if (strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0 ||
+      strcmp(spec, "%") == 0)
+    return currentJob();
+  if (spec[0] == '%') {
+    long n = strtol(spec + 1, &end, 10);
+    if (*end || n < 1 || (size_t)n > numJobSlots || !jobArr[n - 1].line)
+      return -1;
+    return n - 1;
+  }
+  long pid = strtol(spec, &end, 10);
+  if (*end || pid <= 0)
+    return -1;
+  for (size_t idx = 0; idx < numJobSlots; ++idx) {
+    for (size_t stage = 0; jobArr[idx].line && stage < jobArr[idx].numPids;
+         ++stage) {
+      if (jobArr[idx].pids[stage] == pid)
+        return (long)idx;
+    }
+  }
+  return -1;
+}
+
+int waitBuiltin(char **cmdArgv) {
+  // wait: all jobs, the statuses kept so far are dropped as in bash
+  if (!cmdArgv[1]) {
+    while (numLiveJobs > 0) {
+      if (processJobEvents(-1) == -1)
+        return 130;
+    }
+    clearDoneJobs();
+    return 0;
+  }
+  // wait -n: the next job to finish
+  if (strcmp(cmdArgv[1], "-n") == 0) {
+    if (numLiveJobs == 0)
+      return 127;
+    unsigned seqBefore = doneSeq;
+    while (doneSeq == seqBefore) {
+      if (processJobEvents(-1) == -1)
+        return 130;
+    }
+    return doneStatus;
+  }
+  // wait %n|pid...: those jobs, status of the last one
+  // a job that has finished already gives the status it was kept with
+  int status = 0;
+  for (size_t i = 1; cmdArgv[i]; ++i) {
+    long idx = findJob(cmdArgv[i]);
+    if (idx == -1 && (status = takeDoneJob(cmdArgv[i])) != -1)
+      continue;
+    if (idx == -1) {
+      printf("wait: %s: no such job\n", cmdArgv[i]);
+      status = 127;
+      continue;
+    }
+    waitSeq = jobArr[idx].seq;
+    while (jobArr[idx].seq == waitSeq) {
+      if (processJobEvents(-1) == -1)
+        return 130;
+    }
+    status = waitStatus;
+  }
+  return status;
+}
+
+// ==========
+// job control
+// ==========
+
+// the job of spec, the current one if spec is NULL, -1 after telling why
+// there is none
+static long jobOperand(const char *name, const char *spec) {
+  long idx = findJob(spec ? spec : "%%");
+  if (idx == -1 && spec)
+    printf("%s: %s: no such job\n", name, spec);
+  else if (idx == -1)
+    printf("%s: no current job\n", name);
+  return idx;
+}
+
+// all stages, through the group if the job has one
+static int signalJob(const Job *job, int sig) {
+  if (job->pgid > 0)
+    return kill(-job->pgid, sig);
+  int ret = 0;
+  for (size_t stage = 0; stage < job->numPids; ++stage)
+    if (job->pids[stage] > 0 && kill(job->pids[stage], sig) == -1)
+      ret = -1;
+  return ret;
+}
+
+static void continueJob(size_t idx) {
+  Job *job = &jobArr[idx];
+  memset(job->isStopped, 0, job->numPids);
+  job->numStopped = 0;
+  signalJob(job, SIGCONT);
+}
+
+int fgBuiltin(char **cmdArgv) {
+  if (!isJobCtl) {
+    printf("fg: no job control\n");
+    return 1;
+  }
+  long idx = jobOperand("fg", cmdArgv[1]);
+  if (idx == -1)
+    return 1;
+  Job *job = &jobArr[idx];
+  printf("%s\n", job->line);
+  fflush(stdout);
+  tcsetattr(termFd, TCSADRAIN,
+            job->hasTermios ? &job->termios : &shellTermios);
+  if (job->pgid > 0)
+    tcsetpgrp(termFd, job->pgid);
+  continueJob((size_t)idx);
+  // waited for here as a pipeline in the foreground, the slot is freed
+  // once the last stage is reaped
+  unsigned seq = fgSeq = job->seq;
+  int status = 0, isStop = 0, isSignaled = 0;
+  for (size_t stage = 0; job->seq == seq && stage < job->numPids; ++stage) {
+    int wstatus;
+    pid_t ret;
+    if (job->pids[stage] <= 0)
+      continue;
+    while ((ret = waitpid(job->pids[stage], &wstatus, WUNTRACED)) == -1 &&
+           errno == EINTR)
+      ;
+    if (ret == -1) {
+      endStage((size_t)idx, stage, 127);
+      continue;
+    }
+    if (WIFSTOPPED(wstatus)) {
+      job->hasTermios = tcgetattr(termFd, &job->termios) == 0;
+      printf("\n");
+      markStage((size_t)idx, stage, 1);
+      isStop = 1;
+      status = statusOf(wstatus);
+      break;
+    }
+    if (WIFSIGNALED(wstatus)) {
+      if (WTERMSIG(wstatus) == SIGINT && !isSignaled)
+        printf("\n");
+      isSignaled = 1;
+    }
+    endStage((size_t)idx, stage, statusOf(wstatus));
+  }
+  fgSeq = 0;
+  takeTerminal(isStop || isSignaled);
+  return isStop || doneSeq != seq ? status : doneStatus;
+}
+
+int bgBuiltin(char **cmdArgv) {
+  if (!isJobCtl) {
+    printf("bg: no job control\n");
+    return 1;
+  }
+  long idx = jobOperand("bg", cmdArgv[1]);
+  if (idx == -1)
+    return 1;
+  printf("[%ld] %s &\n", idx + 1, jobArr[idx].line);
+  continueJob((size_t)idx);
+  return 0;
+}
+
+// signal of "HUP", "SIGHUP" or "1", -1 if there is none
+static int signalNumber(const char *name) {
+  char *end;
+  long num = strtol(name, &end, 10);
+  if (*name && !*end)
+    return num >= 0 && num < NSIG ? (int)num : -1;
+  if (strncasecmp(name, "SIG", 3) == 0)
+    name += 3;
+  for (int sig = 1; sig < NSIG; ++sig) {
+    const char *abbrev = sigabbrev_np(sig);
+    if (abbrev && strcasecmp(name, abbrev) == 0)
+      return sig;
+  }
+  return -1;
+}
+
+// send sig to the job of "%n" or to a pid, which need not be a job
+// returns the exit status of the builtin
+static int signalOperand(const char *name, const char *spec, int sig) {
+  if (spec[0] != '%') {
+    char *end;
+    long pid = strtol(spec, &end, 10);
+    if (!*spec || *end) {
+      printf("%s: %s: arguments must be process or job IDs\n", name, spec);
+      return 1;
+    }
+    if (kill((pid_t)pid, sig) == -1) {
+      printf("%s: (%ld) - %s\n", name, pid, strerror(errno));
+      return 1;
+    }
+    return 0;
+  }
+  long idx = findJob(spec);
+  if (idx == -1) {
+    printf("%s: %s: no such job\n", name, spec);
+    return 1;
+  }
+  if (signalJob(&jobArr[idx], sig) == -1) {
+    printf("%s: %s: %s\n", name, spec, strerror(errno));
+    return 1;
+  }
+  // a stopped job would only see these once it runs again
+  if (jobArr[idx].numStopped > 0 && (sig == SIGTERM || sig == SIGHUP))
+    continueJob((size_t)idx);
+  return 0;
+}
+
+// the operands of a builtin, or the current job if there are none
+static char **jobSpecs(char **cmdArgv) {
+  static char *current[] = {"%%", NULL};
+  return cmdArgv[1] ? cmdArgv + 1 : current;
+}
+
+int killBuiltin(char **cmdArgv) {
+  if (cmdArgv[1] && strcmp(cmdArgv[1], "-l") == 0) {
+    for (int sig = 1; sig < NSIG; ++sig)
+      if (sigabbrev_np(sig))
+        printf("%2d %s\n", sig, sigabbrev_np(sig));
+    return 0;
+  }
+  size_t i = 1;
+  const char *sigName = "TERM";
+  if (cmdArgv[i] && strcmp(cmdArgv[i], "-s") == 0 && cmdArgv[i + 1]) {
+    sigName = cmdArgv[i + 1];
+    i += 2;
+  } else if (cmdArgv[i] && cmdArgv[i][0] == '-' && cmdArgv[i][1] &&
+             strcmp(cmdArgv[i], "--") != 0)
+    sigName = cmdArgv[i++] + 1;
+  if (cmdArgv[i] && strcmp(cmdArgv[i], "--") == 0)
+    ++i;
+  int sig = signalNumber(sigName);
+  if (sig == -1) {
+    printf("kill: %s: invalid signal specification\n", sigName);
+    return 1;
+  }
+  if (!cmdArgv[i]) {
+    printf("kill: usage: kill [-s sig | -sig] %%n|pid... or kill -l\n");
+    return 2;
+  }
+  int status = 0;
+  for (; cmdArgv[i]; ++i)
+    if (signalOperand("kill", cmdArgv[i], sig) != 0)
+      status = 1;
+  return status;
+}
+
+int stopBuiltin(char **cmdArgv) {
+  int status = 0;
+  for (char **spec = jobSpecs(cmdArgv); *spec; ++spec)
+    if (signalOperand("stop", *spec, SIGSTOP) != 0)
+      status = 1;
+  return status;
+}
+
+int disownBuiltin(char **cmdArgv) {
+  int status = 0;
+  for (char **spec = jobSpecs(cmdArgv); *spec; ++spec) {
+    long idx = jobOperand("disown", *spec);
+    if (idx == -1) {
+      status = 1;
+      continue;
+    }
+    // still reaped, but no longer listed, waited for or told of
+    Job *job = &jobArr[idx];
+    for (size_t stage = 0; stage < job->numPids; ++stage) {
+      if (job->pids[stage] <= 0)
+        continue;
+      if (job->pidFds[stage] != -1) {
+        epoll_ctl(jobEpollFd, EPOLL_CTL_DEL, job->pidFds[stage], NULL);
+        close(job->pidFds[stage]);
+      }
+      addHiddenChild(job->pids[stage]);
+    }
+    freeJob(job);
+    --numLiveJobs;
+  }
+  return status;
+}
+
+void freeJobs(void) {
+  for (size_t idx = 0; idx < numJobSlots; ++idx) {
+    for (size_t stage = 0; jobArr[idx].line && stage < jobArr[idx].numPids;
+         ++stage) {
+      if (jobArr[idx].pidFds[stage] != -1)
+        close(jobArr[idx].pidFds[stage]);
+    }
+    if (jobArr[idx].line)
+      freeJob(&jobArr[idx]);
+  }
+  free(jobArr);
+  jobArr = NULL;
+  clearDoneJobs();
+  free(doneJobs);
+  doneJobs = NULL;
+  capDoneJobs = 0;
+  for (size_t slot = 0; slot < numHiddenSlots; ++slot)
+    if (hiddenPids[slot] && hiddenPidFds[slot] != -1)
+      close(hiddenPidFds[slot]);
+  free(hiddenPids);
+  free(hiddenPidFds);
+  hiddenPids = NULL;
+  hiddenPidFds = NULL;
+  numHiddenSlots = 0;
+  numHidden = 0;
+  numJobSlots = 0;
+  capJobSlots = 0;
+  numLiveJobs = 0;
+  if (jobEpollFd != -1)
+    close(jobEpollFd);
+  if (inputEpollFd != -1)
+    close(inputEpollFd);
+  // the terminal goes back to whoever started the shell
+  if (isJobCtl) {
+    tcsetpgrp(termFd, origPgid);
+    close(signalFd);
+    isJobCtl = 0;
+    signalFd = -1;
+  }
+  jobEpollFd = -1;
+  inputEpollFd = -1;
+}
+
+void forgetJobs(void) {
+  // freeJobs() only closes the pidfds and epoll fds, which leaves the sets
+  // of the parent as they are
+  freeJobs();
+  jobsInit(0, -1);
+}
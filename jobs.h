@@ -0,0 +1,90 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// background jobs, each child is watched through a pidfd in an epoll set so
+// that it is reaped as soon as it exits
+
+// isNotify: print "[n] done" notices, only for interactive shells
+// inputFd: the shell's input, waited on next to the jobs when it is not a
+// regular file
+void jobsInit(int isNotify, int inputFd);
+
+// job control on terminal fd, for interactive shells: every pipeline is a
+// process group of its own that gets the terminal while it runs in the
+// foreground, ctrl+z stops it and leaves it in the table as a stopped job
+// the shell ignores the stop signals and reads SIGCHLD from a signalfd
+// returns -1 if fd is no controlling terminal
+int jobControlInit(int fd);
+
+// the terminal of job control, -1 if it is off
+int jobTerminal(void);
+
+// in a forked child of the shell, which leaves the groups to its parent
+void leaveJobControl(void);
+
+// after a job in the foreground, make the shell's group the foreground one
+// isRestoreModes: put back the terminal modes of the shell, for a job that
+// stopped or was killed, otherwise they are kept as the job left them
+void takeTerminal(int isRestoreModes);
+
+// prompt to print again after a notice interrupted it, NULL for none
+void setJobPrompt(const char *prompt);
+
+// notices printed so far, tells a caller that draws its own prompt whether
+// a notice came in between
+unsigned long jobNoticeCount(void);
+
+// record the started stages of a background pipeline, pids <= 0 are skipped
+// limitDescs: limits of each stage as jobs -l shows them, NULL for none,
+// the array itself may be NULL too
+// pgid: process group of the stages, 0 if they are in the shell's
+// isStopped: a foreground pipeline that ctrl+z stopped
+// returns the job number, or 0 if nothing was started
+int addJob(const pid_t *pids, size_t numPids, const char *line,
+           const char *const *limitDescs, pid_t pgid, int isStopped);
+
+// a child that is no job of its own and nobody waits for, e.g. the list of
+// a process substitution, it is reaped through the same pidfds as jobs
+void addHiddenChild(pid_t pid);
+
+// reap jobs that have exited, without blocking
+void reapJobs(void);
+
+// block until fd is readable, reaping jobs meanwhile
+// returns -1 when interrupted by a signal
+int waitForInput(int fd);
+
+// jobs, jobs -l with the pid and limits of each stage that still runs
+int jobsBuiltin(char **cmdArgv);
+
+// fg [%n], bg [%n]: continue a job in the foreground or the background,
+// the current one by default, the job last started or stopped
+int fgBuiltin(char **cmdArgv);
+int bgBuiltin(char **cmdArgv);
+
+// kill [-s sig | -sig] %n|pid..., kill -l
+int killBuiltin(char **cmdArgv);
+
+// stop [%n|pid...]: SIGSTOP
+int stopBuiltin(char **cmdArgv);
+
+// disown [%n...]: drop jobs from the table, they are still reaped
+int disownBuiltin(char **cmdArgv);
+
+// wait, wait -n, wait %n|pid...
+// a job that finished before it was waited for still gives its status to
+// wait %n or wait pid, once, until a plain wait drops them all
+// returns the exit status of the builtin
+int waitBuiltin(char **cmdArgv);
+
+void freeJobs(void);
+
+// in a forked child of the shell: the jobs are its parent's, which alone
+// waits for them, so they are dropped, and so is the epoll set the child
+// shares with the parent for one of its own, e.g. for the jobs of $(...)
+void forgetJobs(void);
+
+#endif
@@ -0,0 +1,194 @@
+#define _GNU_SOURCE
+#include "launcher.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static size_t pipeSize; // 0 for the kernel default
+
+// stop signals, ignored by a shell with job control, the default again for
+// the stages of its jobs
+static void jobSignals(sigset_t *set) {
+  sigemptyset(set);
+  sigaddset(set, SIGTSTP);
+  sigaddset(set, SIGTTIN);
+  sigaddset(set, SIGTTOU);
+}
+
+// the mask of the shell without SIGCHLD, which it keeps blocked for a
+// signalfd under job control
+static void childSigMask(sigset_t *mask) {
+  sigprocmask(SIG_SETMASK, NULL, mask);
+  sigdelset(mask, SIGCHLD);
+}
+
+int launchCmd(const char *cmdPath, char **cmdArgv, const StageIo *io,
+              pid_t *pid) {
+  posix_spawn_file_actions_t fileActions;
+  posix_spawnattr_t attr;
+  int err;
+  if ((err = posix_spawn_file_actions_init(&fileActions)) != 0)
+    return err;
+  if ((err = posix_spawnattr_init(&attr)) != 0) {
+    posix_spawn_file_actions_destroy(&fileActions);
+    return err;
+  }
+  // only matters for old glibc, newer ones always use CLONE_VFORK
+  short flags = POSIX_SPAWN_USEVFORK | POSIX_SPAWN_SETSIGMASK;
+  sigset_t sigSet;
+  childSigMask(&sigSet);
+  err = posix_spawnattr_setsigmask(&attr, &sigSet);
+  // the child joins the group and takes the terminal before its exec, so
+  // that it can never read the terminal from the background
+  // the terminal goes first, it may be the fd that stdin replaces
+  if (!err && io->pgid != 0) {
+    flags |= POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF;
+    jobSignals(&sigSet);
+    err = posix_spawnattr_setpgroup(&attr, io->pgid == -1 ? 0 : io->pgid);
+    if (!err)
+      err = posix_spawnattr_setsigdefault(&attr, &sigSet);
+    if (!err && io->ttyFd != -1)
+      err = posix_spawn_file_actions_addtcsetpgrp_np(&fileActions, io->ttyFd);
+  }
+  // dup2 clears O_CLOEXEC on 0/1 only, the originals and io->closeFd are
+  // closed by exec itself
+  if (!err && io->inFd != -1)
+    err = posix_spawn_file_actions_adddup2(&fileActions, io->inFd, 0);
+  if (!err && io->outFd != -1)
+    err = posix_spawn_file_actions_adddup2(&fileActions, io->outFd, 1);
+  if (!err)
+    err = posix_spawnattr_setflags(&attr, flags);
+  if (!err)
+    err = posix_spawn(pid, cmdPath, &fileActions, &attr, cmdArgv, environ);
+  if (err == ENOEXEC) {
+    char **shArgv = scriptArgv(cmdPath, cmdArgv);
+    err = posix_spawn(pid, SCRIPT_SHELL, &fileActions, &attr, shArgv, environ);
+    free(shArgv);
+  }
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&fileActions);
+  return err;
+}
+
+int launchCmdLimited(const char *cmdPath, char **cmdArgv, const StageIo *io,
+                     const StageLimits *limits, pid_t *pid,
+                     const char **failed) {
+  // the child runs in our memory until its exec, so it reports back through
+  // these, and only makes system calls
+  volatile int err = 0;
+  const char *volatile failedPrefix = NULL;
+  pid_t child = vfork();
+  if (child == -1)
+    return errno;
+  if (child == 0) {
+    if (applyStageIo(io) == -1)
+      err = errno;
+    else if ((failedPrefix = applyLimits(limits)))
+      err = errno;
+    else {
+      execv(cmdPath, cmdArgv);
+      err = errno;
+    }
+    _exit(127);
+  }
+  *failed = failedPrefix;
+  if (err)
+    waitpid(child, NULL, 0);
+  // the argv is built here, the child must not call malloc()
+  if (err == ENOEXEC && !failedPrefix) {
+    char **shArgv = scriptArgv(cmdPath, cmdArgv);
+    err = launchCmdLimited(SCRIPT_SHELL, shArgv, io, limits, pid, failed);
+    free(shArgv);
+    return err;
+  }
+  if (err)
+    return err;
+  *pid = child;
+  return 0;
+}
+
+char **scriptArgv(const char *cmdPath, char **cmdArgv) {
+  size_t argc = 1;
+  while (cmdArgv[argc])
+    ++argc;
+  // SCRIPT_SHELL cmdPath args..., the NULL included
+  char **shArgv = malloc(sizeof(char *) * (argc + 2));
+  if (!shArgv) {
+    perror("");
+    exit(0);
+  }
+  shArgv[0] = SCRIPT_SHELL;
+  shArgv[1] = (char *)cmdPath;
+  memcpy(shArgv + 2, cmdArgv + 1, sizeof(char *) * argc);
+  return shArgv;
+}
+
+int applyStageIo(const StageIo *io) {
+  sigset_t sigSet;
+  if (io->pgid != 0) {
+    // SIGTTOU is still ignored, so the group can take the terminal
+    setpgid(0, io->pgid == -1 ? 0 : io->pgid);
+    if (io->ttyFd != -1)
+      tcsetpgrp(io->ttyFd, getpgrp());
+    jobSignals(&sigSet);
+    for (int sig = 1; sig < NSIG; ++sig)
+      if (sigismember(&sigSet, sig) == 1)
+        signal(sig, SIG_DFL);
+  }
+  childSigMask(&sigSet);
+  sigprocmask(SIG_SETMASK, &sigSet, NULL);
+  if (io->inFd != -1 && dup2(io->inFd, 0) == -1)
+    return -1;
+  if (io->outFd != -1 && dup2(io->outFd, 1) == -1)
+    return -1;
+  for (size_t i = 0; i < io->numCloseFd; ++i)
+    close(io->closeFd[i]);
+  return 0;
+}
+
+int makeStagePipe(int pipeFd[2]) {
+  if (pipe2(pipeFd, O_CLOEXEC) == -1)
+    return -1;
+  // only a hint, the pipe still works with the default size
+  if (pipeSize)
+    fcntl(pipeFd[1], F_SETPIPE_SZ, (int)pipeSize);
+  return 0;
+}
+
+long setPipeSize(size_t size) {
+  if (size == 0) {
+    pipeSize = 0;
+    return 0;
+  }
+  if (size > INT_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+  // try it on a scratch pipe, so that a bad size is reported now and not
+  // at every command line
+  int pipeFd[2];
+  if (pipe2(pipeFd, O_CLOEXEC) == -1)
+    return -1;
+  int rounded = fcntl(pipeFd[1], F_SETPIPE_SZ, (int)size);
+  int err = errno;
+  close(pipeFd[0]);
+  close(pipeFd[1]);
+  if (rounded == -1) {
+    errno = err;
+    return -1;
+  }
+  pipeSize = (size_t)rounded;
+  return rounded;
+}
+
+size_t getPipeSize(void) { return pipeSize; }
@@ -0,0 +1,63 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "stagelimit.h"
+
+// fds a pipeline stage starts with, -1 keeps the shell's own fd
+typedef struct {
+  int inFd;
+  int outFd;
+  // fds the stage must not inherit, e.g. the read end of its own output
+  // pipe, only the fork() path needs them since every fd the shell opens
+  // for a command line is O_CLOEXEC
+  const int *closeFd;
+  size_t numCloseFd;
+  // job control, none if pgid is 0: the process group the stage joins, -1
+  // for a new one that it leads, and the terminal it takes over for that
+  // group, -1 for none, e.g. in the background
+  pid_t pgid;
+  int ttyFd;
+} StageIo;
+
+// launch the program at cmdPath with its stdin/stdout set up as in io
+// posix_spawn is implemented with clone(CLONE_VM | CLONE_VFORK) by glibc,
+// so no page tables are copied as with fork()
+// returns 0 and stores the child pid, or an errno value on failure
+// a file that exec refuses with ENOEXEC, a script without a #! line, is run
+// by SCRIPT_SHELL instead, as execvp() does
+int launchCmd(const char *cmdPath, char **cmdArgv, const StageIo *io,
+              pid_t *pid);
+
+#define SCRIPT_SHELL "/bin/sh"
+
+// argv to run cmdPath as a script with SCRIPT_SHELL, malloc()ed
+char **scriptArgv(const char *cmdPath, char **cmdArgv);
+
+// launchCmd for a stage with limits, which posix_spawn has no attributes
+// for, so the child is started with vfork() and applies them before exec
+// returns 0, or an errno value with *failed naming the prefix that could not
+// be applied, NULL if exec itself failed
+int launchCmdLimited(const char *cmdPath, char **cmdArgv, const StageIo *io,
+                     const StageLimits *limits, pid_t *pid,
+                     const char **failed);
+
+// dup2 the stage fds onto 0/1 and close the rest, for the fork() path,
+// after joining the process group of the stage and taking the terminal
+// returns -1 on failure
+int applyStageIo(const StageIo *io);
+
+// pipe between two stages, both ends O_CLOEXEC, with the buffer size set by
+// setPipeSize()
+// returns -1 on failure
+int makeStagePipe(int pipeFd[2]);
+
+// buffer size of the pipes from makeStagePipe(), 0 for the kernel default
+// the kernel rounds it up to a power of 2 pages, the rounded size is returned,
+// or -1 with errno set if the size is not allowed
+long setPipeSize(size_t size);
+size_t getPipeSize(void);
+
+#endif
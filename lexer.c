@@ -0,0 +1,580 @@
+#include "lexer.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { LC_WORD = 0, LC_SPACE, LC_SQ, LC_DQ, LC_ESC, LC_OP, LC_DOLLAR, LC_BQ };
+
+// class of each unquoted character, everything else belongs to a word
+static const unsigned char lexClass[256] = {
+    [' '] = LC_SPACE, ['\t'] = LC_SPACE, ['\n'] = LC_SPACE,
+    ['\''] = LC_SQ,   ['\"'] = LC_DQ,    ['\\'] = LC_ESC,
+    ['|'] = LC_OP,    ['<'] = LC_OP,     ['>'] = LC_OP,
+    ['&'] = LC_OP,    [';'] = LC_OP,     ['$'] = LC_DOLLAR,
+    ['`'] = LC_BQ,
+};
+
+static void *growArray(void *arr, size_t *cap, size_t need, size_t size) {
+  if (need <= *cap)
+    return arr;
+  size_t newCap = *cap ? *cap : 64;
+  while (newCap < need)
+    newCap *= 2;
+  if (!(arr = realloc(arr, newCap * size))) {
+    perror("");
+    exit(0);
+  }
+  *cap = newCap;
+  return arr;
+}
+
+// pos: offset of str in the chunk, where the word begins if it is new
+static void startWord(Lexer *lexer, size_t pos) {
+  if (lexer->inWord)
+    return;
+  lexer->inWord = 1;
+  lexer->isWordQuoted = 0;
+  lexer->wordStart = lexer->pos + pos;
+}
+
+static void appendWord(Lexer *lexer, const char *str, size_t len) {
+  lexer->word =
+      growArray(lexer->word, &lexer->capWord, lexer->lenWord + len, 1);
+  memcpy(lexer->word + lexer->lenWord, str, len);
+  lexer->lenWord += len;
+  lexer->inWord = 1;
+}
+
+static Token *pushToken(Lexer *lexer, TokenType type) {
+  lexer->tokens = growArray(lexer->tokens, &lexer->capTokens,
+                            lexer->numTokens + 1, sizeof(Token));
+  Token *token = &lexer->tokens[lexer->numTokens++];
+  token->type = type;
+  token->word = NULL;
+  token->len = 0;
+  token->isQuoted = 0;
+  token->subs = NULL;
+  token->numSubs = 0;
+  token->globs = NULL;
+  token->numGlobs = 0;
+  return token;
+}
+
+// pos: offset in the chunk right after the word
+static void endWord(Lexer *lexer, size_t pos) {
+  if (!lexer->inWord)
+    return;
+  Token *token = pushToken(lexer, TOK_WORD);
+  token->word = arenaStrndup(lexer->arena, lexer->word, lexer->lenWord);
+  token->len = lexer->lenWord;
+  token->isQuoted = lexer->isWordQuoted;
+  token->start = lexer->wordStart;
+  token->end = lexer->pos + pos;
+  if (lexer->numWordSubs > 0) {
+    token->numSubs = lexer->numWordSubs;
+    token->subs = arenaAlloc(lexer->arena, sizeof(WordSub) * token->numSubs);
+    memcpy(token->subs, lexer->wordSubs, sizeof(WordSub) * token->numSubs);
+  }
+  if (lexer->numWordGlobs > 0) {
+    token->numGlobs = lexer->numWordGlobs;
+    token->globs = arenaAlloc(lexer->arena, sizeof(size_t) * token->numGlobs);
+    memcpy(token->globs, lexer->wordGlobs, sizeof(size_t) * token->numGlobs);
+  }
+  lexer->lenWord = 0;
+  lexer->inWord = 0;
+  lexer->numWordSubs = 0;
+  lexer->numWordGlobs = 0;
+  // the delimiter of a here-doc, its body comes after the line
+  if (lexer->numTokens > 1 && token[-1].type == TOK_HEREDOC) {
+    lexer->hereDocs = growArray(lexer->hereDocs, &lexer->capHereDocs,
+                                lexer->numHereDocs + 1, sizeof(HereDoc));
+    HereDoc *hereDoc = &lexer->hereDocs[lexer->numHereDocs++];
+    hereDoc->tokenIdx = lexer->numTokens - 2;
+    hereDoc->isStripTabs = token[-1].len == 1;
+  }
+}
+
+static int isRedirection(TokenType type) {
+  return type == TOK_IN || type == TOK_OUT || type == TOK_APPEND ||
+         type == TOK_HEREDOC || type == TOK_HERESTRING;
+}
+
+// returns -1 if the operator cannot follow the previous token
+static int pushOperator(Lexer *lexer, TokenType type, size_t start,
+                        size_t end) {
+  if (lexer->numTokens > 0 &&
+      isRedirection(lexer->tokens[lexer->numTokens - 1].type)) {
+    lexer->errToken = type;
+    return -1;
+  }
+  Token *token = pushToken(lexer, type);
+  token->start = lexer->pos + start;
+  token->end = lexer->pos + end;
+  return 0;
+}
+
+void lexerReset(Lexer *lexer, Arena *arena) {
+  lexer->arena = arena;
+  lexer->numTokens = 0;
+  lexer->lenWord = 0;
+  lexer->inWord = 0;
+  lexer->quote = 0;
+  lexer->isLineJoined = 0;
+  lexer->pos = 0;
+  lexer->subDepth = 0;
+  lexer->lenSub = 0;
+  lexer->numWordSubs = 0;
+  lexer->numWordGlobs = 0;
+  lexer->numHereDocs = 0;
+  lexer->nextHereDoc = 0;
+  lexer->lenBody = 0;
+}
+
+static void appendSub(Lexer *lexer, const char *str, size_t len) {
+  lexer->sub = growArray(lexer->sub, &lexer->capSub, lexer->lenSub + len, 1);
+  memcpy(lexer->sub + lexer->lenSub, str, len);
+  lexer->lenSub += len;
+}
+
+// chunk[i] opens <(, >(, $( or `
+static void startSub(Lexer *lexer, const char *chunk, size_t i) {
+  lexer->subOpen = chunk[i];
+  lexer->subDepth = 1;
+  lexer->subQuote = 0;
+  lexer->isSubEscape = 0;
+  lexer->subStart = lexer->pos + i;
+  lexer->lenSub = 0;
+}
+
+static void pushWordSub(Lexer *lexer, int isVar, char *text, size_t len) {
+  lexer->wordSubs = growArray(lexer->wordSubs, &lexer->capWordSubs,
+                              lexer->numWordSubs + 1, sizeof(WordSub));
+  lexer->wordSubs[lexer->numWordSubs++] =
+      (WordSub){lexer->lenWord, lexer->quote == '\"', isVar, text, len};
+}
+
+// the substitution is complete, end: offset in the chunk after it
+static void endSub(Lexer *lexer, size_t end) {
+  char *text =
+      arenaStrndup(lexer->arena, lexer->sub ? lexer->sub : "", lexer->lenSub);
+  if (lexer->subOpen == '<' || lexer->subOpen == '>') {
+    Token *token = pushToken(lexer, lexer->subOpen == '<' ? TOK_PROCSUB_IN
+                                                          : TOK_PROCSUB_OUT);
+    token->word = text;
+    token->len = lexer->lenSub;
+    token->start = lexer->subStart;
+    token->end = lexer->pos + end;
+    return;
+  }
+  pushWordSub(lexer, 0, text, lexer->lenSub);
+}
+
+// the unquoted '*', '?', '[' or ']' that is about to go at offset in the
+// word
+static void pushWordGlob(Lexer *lexer, size_t offset) {
+  lexer->wordGlobs = growArray(lexer->wordGlobs, &lexer->capWordGlobs,
+                               lexer->numWordGlobs + 1, sizeof(size_t));
+  lexer->wordGlobs[lexer->numWordGlobs++] = offset;
+}
+
+static int isNameChar(char c) { return isalnum((unsigned char)c) || c == '_'; }
+
+// chunk[i] is a '$': $(...) starts a substitution, $NAME, ${NAME}, $?, $$,
+// $#, $@, $*, $0 to $9 and ${10} on become a variable of the word, any other
+// '$' is taken as it is
+// returns the offset after what it took
+static size_t lexDollar(Lexer *lexer, const char *chunk, size_t i,
+                        size_t len) {
+  if (i + 1 < len && chunk[i + 1] == '(') {
+    startSub(lexer, chunk, i);
+    return i + 2;
+  }
+  size_t lenBrace = i + 1 < len && chunk[i + 1] == '{' ? 1 : 0;
+  size_t start = i + 1 + lenBrace, end = start;
+  if (end < len && chunk[end] && strchr("?$#@*", chunk[end]))
+    ++end;
+  else if (end < len && isdigit((unsigned char)chunk[end])) {
+    ++end;
+    while (lenBrace && end < len && isdigit((unsigned char)chunk[end]))
+      ++end;
+  }
+  else if (end < len &&
+           (isalpha((unsigned char)chunk[end]) || chunk[end] == '_'))
+    while (end < len && isNameChar(chunk[end]))
+      ++end;
+  if (end == start || (lenBrace && (end == len || chunk[end] != '}'))) {
+    appendWord(lexer, chunk + i, 1);
+    return i + 1;
+  }
+  pushWordSub(lexer, 1, arenaStrndup(lexer->arena, chunk + start, end - start),
+              end - start);
+  return end + lenBrace;
+}
+
+// text of `...` from chunk[i], until its '`' or the end of chunk, where
+// '\' only escapes '$', '`', '\' and in "" also '"'
+static size_t lexBackquote(Lexer *lexer, const char *chunk, size_t i,
+                           size_t len) {
+  size_t j = i;
+  for (; j < len; ++j) {
+    char c = chunk[j];
+    if (lexer->isSubEscape) {
+      lexer->isSubEscape = 0;
+      if (!strchr("$`\\", c) && (c != '\"' || lexer->quote != '\"'))
+        appendSub(lexer, "\\", 1);
+      appendSub(lexer, &c, 1);
+    } else if (c == '\\')
+      lexer->isSubEscape = 1;
+    else if (c == '`') {
+      lexer->subDepth = 0;
+      endSub(lexer, ++j);
+      break;
+    } else
+      appendSub(lexer, &c, 1);
+  }
+  return j;
+}
+
+// text of <(...), >(...) or $(...) from chunk[i], until its ')' or the end
+// of chunk
+// returns the offset after what it took
+static size_t lexSub(Lexer *lexer, const char *chunk, size_t i, size_t len) {
+  if (lexer->subOpen == '`')
+    return lexBackquote(lexer, chunk, i, len);
+  size_t j = i;
+  for (; j < len && lexer->subDepth > 0; ++j) {
+    char c = chunk[j];
+    if (lexer->subQuote == '\'') {
+      if (c == '\'')
+        lexer->subQuote = 0;
+    } else if (lexer->isSubEscape)
+      lexer->isSubEscape = 0;
+    else if (c == '\\')
+      lexer->isSubEscape = 1;
+    else if (lexer->subQuote == '\"') {
+      if (c == '\"')
+        lexer->subQuote = 0;
+    } else if (c == '\'' || c == '\"')
+      lexer->subQuote = c;
+    else if (c == '(')
+      ++lexer->subDepth;
+    else if (c == ')')
+      --lexer->subDepth;
+  }
+  size_t end = lexer->subDepth == 0 ? j - 1 : j; // without the ')'
+  if (end > i)
+    appendSub(lexer, chunk + i, end - i);
+  if (lexer->subDepth == 0)
+    endSub(lexer, j);
+  return j;
+}
+
+static LexStatus lexChunk(Lexer *lexer, const char *chunk, size_t len) {
+  lexer->isLineJoined = 0;
+  size_t i = 0;
+  while (i < len) {
+    if (lexer->subDepth > 0) {
+      i = lexSub(lexer, chunk, i, len);
+      continue;
+    }
+    // ==========
+    // inside single quotes, everything is literal
+    // ==========
+    if (lexer->quote == '\'') {
+      const char *end = memchr(chunk + i, '\'', len - i);
+      size_t lenRun = end ? (size_t)(end - chunk) - i : len - i;
+      appendWord(lexer, chunk + i, lenRun);
+      i += lenRun;
+      if (end) {
+        lexer->quote = 0;
+        ++i;
+      }
+      continue;
+    }
+    // ==========
+    // inside double quotes, only '\', '"', '$' and '`' are special
+    // ==========
+    if (lexer->quote == '\"') {
+      size_t j = i;
+      while (j < len && chunk[j] != '\"' && chunk[j] != '\\' &&
+             chunk[j] != '$' && chunk[j] != '`')
+        ++j;
+      appendWord(lexer, chunk + i, j - i);
+      i = j;
+      if (i == len)
+        break;
+      if (chunk[i] == '`') {
+        startSub(lexer, chunk, i);
+        ++i;
+      } else if (chunk[i] == '$')
+        i = lexDollar(lexer, chunk, i, len);
+      else if (chunk[i] == '\"') {
+        lexer->quote = 0;
+        ++i;
+      } else if (i + 1 < len && chunk[i + 1] == '\n') {
+        i += 2; // line continuation
+      } else if (i + 1 < len && strchr("\"\\$`", chunk[i + 1])) {
+        appendWord(lexer, chunk + i + 1, 1);
+        i += 2;
+      } else {
+        appendWord(lexer, chunk + i, 1);
+        ++i;
+      }
+      continue;
+    }
+    // ==========
+    // unquoted
+    // ==========
+    switch (lexClass[(unsigned char)chunk[i]]) {
+    case LC_WORD: {
+      // a '#' that starts a word comments out the rest of the line
+      if (chunk[i] == '#' && !lexer->inWord) {
+        const char *end = memchr(chunk + i, '\n', len - i);
+        i = end ? (size_t)(end - chunk) : len;
+        break;
+      }
+      startWord(lexer, i);
+      size_t j = i;
+      for (; j < len && lexClass[(unsigned char)chunk[j]] == LC_WORD; ++j)
+        if (chunk[j] == '*' || chunk[j] == '?' || chunk[j] == '[' ||
+            chunk[j] == ']')
+          pushWordGlob(lexer, lexer->lenWord + j - i);
+      appendWord(lexer, chunk + i, j - i);
+      i = j;
+      break;
+    }
+    case LC_SPACE:
+      endWord(lexer, i);
+      ++i;
+      break;
+    case LC_SQ:
+    case LC_DQ:
+      startWord(lexer, i); // "" is an empty word, not nothing
+      lexer->isWordQuoted = 1;
+      lexer->quote = chunk[i];
+      ++i;
+      break;
+    case LC_ESC:
+      if (i + 1 == len) { // nothing to escape, keep it
+        startWord(lexer, i);
+        appendWord(lexer, chunk + i, 1);
+      } else if (chunk[i + 1] == '\n') // line continuation
+        lexer->isLineJoined = i + 2 == len;
+      else {
+        startWord(lexer, i);
+        lexer->isWordQuoted = 1;
+        appendWord(lexer, chunk + i + 1, 1);
+      }
+      i += 2;
+      break;
+    case LC_DOLLAR:
+      startWord(lexer, i);
+      i = lexDollar(lexer, chunk, i, len);
+      break;
+    case LC_BQ:
+      startWord(lexer, i);
+      startSub(lexer, chunk, i);
+      ++i;
+      break;
+    case LC_OP: {
+      endWord(lexer, i);
+      size_t start = i;
+      if ((chunk[i] == '<' || chunk[i] == '>') && i + 1 < len &&
+          chunk[i + 1] == '(') {
+        startSub(lexer, chunk, i);
+        i += 2;
+        break;
+      }
+      TokenType type = TOK_BG;
+      if (chunk[i] == ';')
+        type = TOK_SEMI;
+      else if (chunk[i] == '|')
+        type = TOK_PIPE;
+      else if (chunk[i] == '<' && i + 2 < len && chunk[i + 1] == '<' &&
+               chunk[i + 2] == '<') {
+        type = TOK_HERESTRING;
+        i += 2;
+      } else if (chunk[i] == '<' && i + 1 < len && chunk[i + 1] == '<') {
+        type = TOK_HEREDOC;
+        ++i;
+        if (i + 1 < len && chunk[i + 1] == '-')
+          ++i;
+      } else if (chunk[i] == '<')
+        type = TOK_IN;
+      else if (chunk[i] == '>' && i + 1 < len && chunk[i + 1] == '>') {
+        type = TOK_APPEND;
+        ++i;
+      } else if (chunk[i] == '>')
+        type = TOK_OUT;
+      if (pushOperator(lexer, type, start, i + 1) == -1)
+        return LEX_ERROR;
+      // until the body is in, len tells <<- (1) from << (0)
+      if (type == TOK_HEREDOC)
+        lexer->tokens[lexer->numTokens - 1].len = i - start - 1;
+      ++i;
+      break;
+    }
+    }
+  }
+  // ==========
+  // end of chunk, decide whether the command line goes on
+  // ==========
+  if (lexer->quote || lexer->isLineJoined || lexer->subDepth > 0)
+    return LEX_INCOMPLETE;
+  endWord(lexer, len);
+  if (lexer->numTokens > 0) {
+    TokenType lastType = lexer->tokens[lexer->numTokens - 1].type;
+    if (lastType == TOK_PIPE || isRedirection(lastType))
+      return LEX_INCOMPLETE;
+  }
+  // the line is done, but the here-doc bodies after it are not
+  if (lexer->nextHereDoc < lexer->numHereDocs)
+    return LEX_INCOMPLETE;
+  Token *token = pushToken(lexer, TOK_NEWLINE);
+  token->start = token->end = lexer->pos + len;
+  return LEX_OK;
+}
+
+// ==========
+// here-doc bodies
+// ==========
+
+// the body of a here-doc whose delimiter is not quoted, into the word of
+// token: as inside "", $ and ` are expanded, but without splitting, and '\'
+// only escapes '$', '`', '\' and the newline, '"' is just a character
+static void lexHereDocBody(Lexer *lexer, Token *token) {
+  const char *body = lexer->body ? lexer->body : "";
+  size_t len = lexer->lenBody, i = 0;
+  lexer->quote = '\"';
+  while (i < len) {
+    if (lexer->subDepth > 0) {
+      i = lexSub(lexer, body, i, len);
+      continue;
+    }
+    size_t j = i;
+    while (j < len && body[j] != '\\' && body[j] != '$' && body[j] != '`')
+      ++j;
+    appendWord(lexer, body + i, j - i);
+    i = j;
+    if (i == len)
+      break;
+    if (body[i] == '`') {
+      startSub(lexer, body, i);
+      ++i;
+    } else if (body[i] == '$')
+      i = lexDollar(lexer, body, i, len);
+    else if (i + 1 < len && body[i + 1] == '\n')
+      i += 2; // line continuation
+    else if (i + 1 < len && strchr("\\$`", body[i + 1])) {
+      appendWord(lexer, body + i + 1, 1);
+      i += 2;
+    } else {
+      appendWord(lexer, body + i, 1);
+      ++i;
+    }
+  }
+  // a $( or ` left open at the end of the body is dropped
+  lexer->subDepth = 0;
+  lexer->quote = 0;
+  token->word = arenaStrndup(lexer->arena, lexer->word ? lexer->word : "",
+                             lexer->lenWord);
+  token->len = lexer->lenWord;
+  if (lexer->numWordSubs > 0) {
+    token->numSubs = lexer->numWordSubs;
+    token->subs = arenaAlloc(lexer->arena, sizeof(WordSub) * token->numSubs);
+    memcpy(token->subs, lexer->wordSubs, sizeof(WordSub) * token->numSubs);
+  }
+  lexer->lenWord = 0;
+  lexer->inWord = 0;
+  lexer->numWordSubs = 0;
+}
+
+// one line of a here-doc body up to the delimiter line, the body is taken
+// as it is if the delimiter was quoted
+static LexStatus lexHereDocLine(Lexer *lexer, const char *chunk, size_t len) {
+  const HereDoc *hereDoc = &lexer->hereDocs[lexer->nextHereDoc];
+  Token *token = &lexer->tokens[hereDoc->tokenIdx];
+  const Token *delim = token + 1;
+  if (hereDoc->isStripTabs)
+    while (len > 0 && *chunk == '\t') {
+      ++chunk;
+      --len;
+    }
+  size_t lenText = len > 0 && chunk[len - 1] == '\n' ? len - 1 : len;
+  if (lenText != delim->len || memcmp(chunk, delim->word, lenText) != 0) {
+    lexer->body =
+        growArray(lexer->body, &lexer->capBody, lexer->lenBody + len, 1);
+    memcpy(lexer->body + lexer->lenBody, chunk, len);
+    lexer->lenBody += len;
+    return LEX_INCOMPLETE;
+  }
+  if (delim->isQuoted) {
+    token->word = arenaStrndup(lexer->arena, lexer->body ? lexer->body : "",
+                               lexer->lenBody);
+    token->len = lexer->lenBody;
+  } else
+    lexHereDocBody(lexer, token);
+  lexer->lenBody = 0;
+  if (++lexer->nextHereDoc < lexer->numHereDocs)
+    return LEX_INCOMPLETE;
+  Token *newline = pushToken(lexer, TOK_NEWLINE);
+  newline->start = newline->end = lexer->pos + len;
+  return LEX_OK;
+}
+
+LexStatus lexFeed(Lexer *lexer, const char *chunk, size_t len) {
+  LexStatus status = lexer->nextHereDoc < lexer->numHereDocs
+                         ? lexHereDocLine(lexer, chunk, len)
+                         : lexChunk(lexer, chunk, len);
+  lexer->pos += len;
+  return status;
+}
+
+const char *tokenText(TokenType type) {
+  switch (type) {
+  case TOK_PIPE:
+    return "|";
+  case TOK_IN:
+    return "<";
+  case TOK_OUT:
+    return ">";
+  case TOK_APPEND:
+    return ">>";
+  case TOK_HEREDOC:
+    return "<<";
+  case TOK_HERESTRING:
+    return "<<<";
+  case TOK_BG:
+    return "&";
+  case TOK_SEMI:
+    return ";";
+  default:
+    return "newline";
+  }
+}
+
+void lexerFree(Lexer *lexer) {
+  free(lexer->tokens);
+  free(lexer->word);
+  free(lexer->hereDocs);
+  free(lexer->body);
+  free(lexer->sub);
+  free(lexer->wordSubs);
+  free(lexer->wordGlobs);
+  lexer->tokens = NULL;
+  lexer->word = NULL;
+  lexer->hereDocs = NULL;
+  lexer->body = NULL;
+  lexer->sub = NULL;
+  lexer->wordSubs = NULL;
+  lexer->wordGlobs = NULL;
+  lexer->capTokens = 0;
+  lexer->capWord = 0;
+  lexer->capHereDocs = 0;
+  lexer->capBody = 0;
+  lexer->capSub = 0;
+  lexer->capWordSubs = 0;
+  lexer->capWordGlobs = 0;
+}
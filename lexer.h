@@ -0,0 +1,108 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stddef.h>
+
+#include "arena.h"
+
+typedef enum {
+  TOK_WORD,   // quotes already removed
+  TOK_PIPE,   // |
+  TOK_IN,     // <
+  TOK_OUT,    // >
+  TOK_APPEND, // >>
+  TOK_HEREDOC,    // << or <<-, the body is in word once it is complete, with
+                  // subs unless the delimiter was quoted
+  TOK_HERESTRING, // <<<
+  TOK_PROCSUB_IN,  // <(list), word is the list as written
+  TOK_PROCSUB_OUT, // >(list)
+  TOK_BG,     // &
+  TOK_SEMI,   // ;
+  TOK_NEWLINE // end of a complete line
+} TokenType;
+
+// $(list), `list`, $NAME, ${NAME}, $? or $$ in a word, it is not part of
+// the word text, which only holds what is around it
+typedef struct {
+  size_t offset; // in the word text, where the value goes
+  int isQuoted;  // inside "", the value is not split into fields
+  int isVar;     // text is the name of a variable, not a list
+  char *text;    // the list as written
+  size_t len;
+} WordSub;
+
+typedef struct {
+  TokenType type;
+  char *word; // TOK_WORD, TOK_HEREDOC and TOK_PROCSUB_*, exact-length copy
+              // in the arena
+  size_t len;
+  int isQuoted;      // the word had quotes or escapes, so it is no keyword
+  WordSub *subs;     // TOK_WORD, in the order they appear
+  size_t numSubs;
+  size_t *globs; // TOK_WORD, offsets of the unquoted '*', '?', '[' and ']'
+  size_t numGlobs;
+  size_t start, end; // source text, as offsets into all input fed so far
+} Token;
+
+typedef enum {
+  LEX_OK,         // a complete line, loops may still need more lines
+  LEX_INCOMPLETE, // open quote, trailing '\' or operator, or here-doc body
+                  // still to come, feed the next line
+  LEX_ERROR       // operator right after a redirection, see errToken
+} LexStatus;
+
+// a << whose body follows the line it is on
+typedef struct {
+  size_t tokenIdx;
+  int isStripTabs; // <<-, leading tabs of the body lines go
+} HereDoc;
+
+// single pass state machine over the input, resumable between lines so that
+// continuation lines do not rescan what has already been read
+typedef struct {
+  Arena *arena;
+  Token *tokens; // kept across command lines, only grows
+  size_t numTokens, capTokens;
+  char *word; // word being built, kept across command lines
+  size_t lenWord, capWord;
+  int inWord;       // a word has started, even an empty one like ""
+  char quote;       // '\'', '"' or 0 outside quotes
+  int isLineJoined; // the last chunk ended with '\' + '\n'
+  int isWordQuoted;
+  size_t pos;       // offset of the current chunk in the input fed so far
+  size_t wordStart; // offset where the current word began
+  TokenType errToken;
+  // inside <(, >(, $( or `, the text is taken as it is up to the matching
+  // ')' or '`', into sub
+  int subDepth;         // open parentheses, 0 outside
+  char subOpen;         // '<', '>', '$' or '`'
+  char subQuote;        // quote inside the text, to skip parentheses in it
+  int isSubEscape;      // the last character was '\'
+  size_t subStart;
+  char *sub;
+  size_t lenSub, capSub;
+  WordSub *wordSubs; // of the word being built, kept across command lines
+  size_t numWordSubs, capWordSubs;
+  size_t *wordGlobs; // the same for its glob characters
+  size_t numWordGlobs, capWordGlobs;
+  // here-docs of the line, their bodies are read in order after it, into
+  // body, which has no limit on its size
+  HereDoc *hereDocs;
+  size_t numHereDocs, capHereDocs, nextHereDoc;
+  char *body;
+  size_t lenBody, capBody;
+} Lexer;
+
+// start a new command line, tokens and words are allocated from arena
+void lexerReset(Lexer *lexer, Arena *arena);
+
+// feed the next line, including its '\n'
+// a complete line ends with a TOK_NEWLINE token
+LexStatus lexFeed(Lexer *lexer, const char *chunk, size_t len);
+
+// text of an operator token, for error messages
+const char *tokenText(TokenType type);
+
+void lexerFree(Lexer *lexer);
+
+#endif
@@ -0,0 +1,615 @@
+#include "lineedit.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "complete.h"
+#include "history.h"
+#include "input.h"
+#include "jobs.h"
+
+#define EDIT_READ 4096
+#define MAX_ESC 16
+#define KEY_MORE 0
+#define KEY_DONE 1
+#define KEY_EOF 2
+#define CTRL_KEY(c) ((c) & 0x1f)
+
+static int editFd = -1;
+static struct termios origTermios, rawTermios;
+static int width; // of the terminal, in columns
+// keys read but not handled yet, a paste may hold several lines
+static char readBuf[EDIT_READ];
+static size_t readStart, readEnd;
+static const char *prompt;
+static char *lineBuf;
+static size_t lenLine, capLine, cursor;
+// a line with newlines, e.g. a loop from the history, goes out line by line
+static size_t nextLine;
+static char *shownBuf; // what the terminal shows, prompt included
+static size_t lenShown, capShown, lenShownHead; // head: prompt or search
+static int cursorRow; // row of the cursor, counted from the first shown row
+static int escState;  // 1 after ESC, 2 inside an escape sequence
+static char escBuf[MAX_ESC];
+static size_t lenEsc;
+static int isLastTab; // the previous key was a tab as well
+static long browsePos; // entry shown by up and down, -1 for the typed line
+// reverse search
+static int isSearching, isSearchFailed;
+static char *queryBuf, *savedBuf; // savedBuf: the line before search/browse
+static size_t lenQuery, capQuery, lenSaved, capSaved;
+static long matchPos; // entry shown, -1 before the first match
+
+static void appendBuf(char **buf, size_t *len, size_t *cap, const char *str,
+                      size_t n) {
+  if (*len + n + 1 > *cap) {
+    size_t newCap = *cap ? *cap : 256;
+    while (*len + n + 1 > newCap)
+      newCap *= 2;
+    if (!(*buf = realloc(*buf, newCap))) {
+      perror("");
+      exit(0);
+    }
+    *cap = newCap;
+  }
+  if (n > 0) // str may be a buffer that was never allocated
+    memcpy(*buf + *len, str, n);
+  *len += n;
+  (*buf)[*len] = '\0';
+}
+
+int editorInit(int fd) {
+  const char *term = getenv("TERM");
+  if (!isatty(fd) || (term && strcmp(term, "dumb") == 0) ||
+      tcgetattr(fd, &origTermios) == -1)
+    return -1;
+  // no line discipline, but ctrl+c still raises SIGINT and output still
+  // turns '\n' into "\r\n"
+  rawTermios = origTermios;
+  rawTermios.c_lflag &= ~(tcflag_t)(ICANON | ECHO | IEXTEN);
+  rawTermios.c_iflag &= ~(tcflag_t)(ICRNL | IXON);
+  rawTermios.c_cc[VMIN] = 1;
+  rawTermios.c_cc[VTIME] = 0;
+  editFd = fd;
+  return 0;
+}
+
+// ==========
+// drawing
+// ==========
+static void composeShown(void) {
+  lenShown = 0;
+  if (isSearching) {
+    const char *head =
+        isSearchFailed ? "(failed reverse-i-search)`" : "(reverse-i-search)`";
+    appendBuf(&shownBuf, &lenShown, &capShown, head, strlen(head));
+    appendBuf(&shownBuf, &lenShown, &capShown, queryBuf, lenQuery);
+    appendBuf(&shownBuf, &lenShown, &capShown, "': ", 3);
+  } else
+    appendBuf(&shownBuf, &lenShown, &capShown, prompt, strlen(prompt));
+  lenShownHead = lenShown;
+  appendBuf(&shownBuf, &lenShown, &capShown, lineBuf, lenLine);
+}
+
+// where the terminal puts the character after shownBuf[0, len)
+// a full row wraps, a UTF-8 character takes one column
+static void layoutAt(size_t len, int *row, int *col) {
+  int r = 0, c = 0;
+  for (size_t i = 0; i < len; ++i) {
+    if (shownBuf[i] == '\n') {
+      ++r;
+      c = 0;
+    } else if (((unsigned char)shownBuf[i] & 0xc0) != 0x80) {
+      if (c == width) {
+        ++r;
+        c = 0;
+      }
+      ++c;
+    }
+  }
+  if (c == width) {
+    ++r;
+    c = 0;
+  }
+  *row = r;
+  *col = c;
+}
+
+// the terminal leaves the cursor on a full row until the next character,
+// take it to the next row so that rows can be counted
+static void settleEnd(int endCol) {
+  if (endCol == 0 && lenShown > 0 && shownBuf[lenShown - 1] != '\n')
+    putchar('\n');
+}
+
+// draw the whole line again and put the cursor in place
+static void refreshLine(void) {
+  composeShown();
+  if (cursorRow > 0)
+    printf("\x1b[%dA", cursorRow);
+  fputs("\r\x1b[J", stdout);
+  fwrite(shownBuf, 1, lenShown, stdout);
+  int endRow, endCol, row, col;
+  layoutAt(lenShown, &endRow, &endCol);
+  settleEnd(endCol);
+  layoutAt(isSearching ? lenShown : lenShownHead + cursor, &row, &col);
+  if (endRow > row)
+    printf("\x1b[%dA", endRow - row);
+  putchar('\r');
+  if (col > 0)
+    printf("\x1b[%dC", col);
+  cursorRow = row;
+}
+
+// ==========
+// editing
+// ==========
+static void setLine(const char *text, size_t len) {
+  lenLine = 0;
+  appendBuf(&lineBuf, &lenLine, &capLine, text, len);
+  for (size_t i = 0; i < len; ++i) // stored newlines
+    if (lineBuf[i] == '\0')
+      lineBuf[i] = '\n';
+  cursor = lenLine;
+}
+
+static void saveLine(void) {
+  lenSaved = 0;
+  appendBuf(&savedBuf, &lenSaved, &capSaved, lineBuf, lenLine);
+}
+
+static void insertText(const char *text, size_t len) {
+  appendBuf(&lineBuf, &lenLine, &capLine, text, len); // room for it
+  memmove(lineBuf + cursor + len, lineBuf + cursor, lenLine - len - cursor);
+  memcpy(lineBuf + cursor, text, len);
+  cursor += len;
+}
+
+static void deleteText(size_t start, size_t end) {
+  memmove(lineBuf + start, lineBuf + end, lenLine - end + 1);
+  lenLine -= end - start;
+  cursor = start;
+}
+
+static int isUtf8Cont(size_t pos) {
+  return ((unsigned char)lineBuf[pos] & 0xc0) == 0x80;
+}
+
+// one character left or right of pos
+static size_t charLeft(size_t pos) {
+  while (pos > 0 && isUtf8Cont(--pos))
+    ;
+  return pos;
+}
+
+static size_t charRight(size_t pos) {
+  while (pos < lenLine && isUtf8Cont(++pos))
+    ;
+  return pos;
+}
+
+static int isWordChar(size_t pos) {
+  return !strchr(" \t\n|&;<>/", lineBuf[pos]);
+}
+
+static size_t wordLeft(size_t pos) {
+  while (pos > 0 && !isWordChar(pos - 1))
+    --pos;
+  while (pos > 0 && isWordChar(pos - 1))
+    --pos;
+  return pos;
+}
+
+static size_t wordRight(size_t pos) {
+  while (pos < lenLine && !isWordChar(pos))
+    ++pos;
+  while (pos < lenLine && isWordChar(pos))
+    ++pos;
+  return pos;
+}
+
+// ==========
+// history, browsed with up and down or searched with ctrl+r
+// ==========
+static void browseHistory(int isUp) {
+  long pos = -1;
+  size_t len;
+  if (isUp) {
+    if (browsePos == -1)
+      saveLine();
+    // the empty query matches the entry right before
+    pos = searchHistory("", 0,
+                        browsePos == -1 ? historyEnd() : (size_t)browsePos);
+    if (pos == -1) {
+      putchar('\a');
+      return;
+    }
+  } else {
+    if (browsePos == -1) {
+      putchar('\a');
+      return;
+    }
+    historyEntry((size_t)browsePos, &len);
+    size_t next = (size_t)browsePos + len + 1;
+    if (next < historyEnd())
+      pos = (long)next;
+  }
+  browsePos = pos;
+  if (pos == -1)
+    setLine(savedBuf, lenSaved);
+  else {
+    const char *text = historyEntry((size_t)pos, &len);
+    setLine(text, len);
+  }
+  refreshLine();
+}
+
+static int isLineEntry(const char *text, size_t len) {
+  if (len != lenLine)
+    return 0;
+  for (size_t i = 0; i < len; ++i)
+    if (text[i] != (lineBuf[i] == '\n' ? '\0' : lineBuf[i]))
+      return 0;
+  return 1;
+}
+
+// newest match in the entries that start before pos `before`
+// isNext: ctrl+r, a repeat of the line shown is no new match
+static void searchFrom(size_t before, int isNext) {
+  long pos;
+  while ((pos = searchHistory(queryBuf, lenQuery, before)) != -1) {
+    size_t len;
+    const char *text = historyEntry((size_t)pos, &len);
+    if (!isNext || !isLineEntry(text, len)) {
+      matchPos = pos;
+      isSearchFailed = 0;
+      setLine(text, len);
+      return;
+    }
+    before = (size_t)pos;
+  }
+  isSearchFailed = 1;
+}
+
+static void endSearch(void) {
+  isSearching = 0;
+  refreshLine();
+}
+
+// returns 1 if the key is left for the editor itself
+static int handleSearchKey(unsigned char c) {
+  if (c == CTRL_KEY('r')) {
+    searchFrom(matchPos == -1 ? historyEnd() : (size_t)matchPos, 1);
+  } else if (c == 0x7f || c == CTRL_KEY('h')) {
+    // start over with the shorter query
+    if (lenQuery > 0)
+      --lenQuery;
+    setLine(savedBuf, lenSaved);
+    matchPos = -1;
+    isSearchFailed = 0;
+    if (lenQuery > 0)
+      searchFrom(historyEnd(), 0);
+  } else if (c == CTRL_KEY('g')) {
+    setLine(savedBuf, lenSaved);
+    endSearch();
+    return 0;
+  } else if (c >= 0x20 && c != 0x7f) {
+    appendBuf(&queryBuf, &lenQuery, &capQuery, (const char *)&c, 1);
+    // the match shown stays if it still matches
+    searchFrom(matchPos == -1 ? historyEnd() : (size_t)matchPos + 1, 0);
+  } else {
+    endSearch();
+    return 1;
+  }
+  refreshLine();
+  return 0;
+}
+
+// ==========
+// tab completion
+// ==========
+// text quoted the way the word began: in quotes or with backslashes
+static void insertQuoted(const char *text, size_t len, char quote) {
+  for (size_t i = 0; i < len; ++i) {
+    char c = text[i];
+    if (quote == '\"' && strchr("\"\\$`", c))
+      insertText("\\", 1);
+    else if (quote == '\'' && c == '\'') {
+      insertText("'\\''", 4);
+      continue;
+    } else if (!quote && strchr(" \t\n\\\'\"|&;<>()$`*?[]#{}!", c))
+      insertText("\\", 1);
+    insertText(&c, 1);
+  }
+}
+
+// below the line, in columns, without the directory part of the word
+static void listMatches(char **matches, size_t numMatches, const char *word) {
+  const char *slash = strrchr(word, '/');
+  size_t skip = slash ? (size_t)(slash + 1 - word) : 0, lenMax = 0;
+  for (size_t i = 0; i < numMatches; ++i)
+    if (strlen(matches[i]) - skip > lenMax)
+      lenMax = strlen(matches[i]) - skip;
+  size_t numCols = (size_t)width / (lenMax + 2);
+  numCols = numCols ? numCols : 1;
+  size_t numRows = (numMatches + numCols - 1) / numCols;
+  int endRow, endCol;
+  layoutAt(lenShown, &endRow, &endCol);
+  if (endRow > cursorRow)
+    printf("\x1b[%dB", endRow - cursorRow);
+  putchar('\n');
+  for (size_t row = 0; row < numRows; ++row) {
+    for (size_t col = 0; col < numCols; ++col) {
+      size_t i = col * numRows + row;
+      if (i >= numMatches)
+        break;
+      int isLast = col + 1 == numCols || i + numRows >= numMatches;
+      printf("%-*s", isLast ? 0 : (int)(lenMax + 2), matches[i] + skip);
+    }
+    putchar('\n');
+  }
+  cursorRow = 0;
+  refreshLine();
+}
+
+static void completeLine(void) {
+  size_t wordStart, numMatches;
+  const char *word;
+  char **matches =
+      completeWord(lineBuf, cursor, &wordStart, &word, &numMatches);
+  if (numMatches == 0) {
+    putchar('\a');
+    return;
+  }
+  // as far as all candidates agree
+  size_t lenWord = strlen(word), lenCommon = strlen(matches[0]);
+  for (size_t i = 1; i < numMatches; ++i) {
+    size_t j = 0;
+    while (j < lenCommon && matches[i][j] == matches[0][j])
+      ++j;
+    lenCommon = j;
+  }
+  if (numMatches > 1 && lenCommon <= lenWord) {
+    // nothing to add, a second tab shows the candidates
+    if (isLastTab)
+      listMatches(matches, numMatches, word);
+    else
+      putchar('\a');
+    return;
+  }
+  char quote = lineBuf[wordStart] == '\'' || lineBuf[wordStart] == '\"'
+                   ? lineBuf[wordStart]
+                   : 0;
+  deleteText(wordStart, cursor);
+  if (quote)
+    insertText(&quote, 1);
+  insertQuoted(matches[0], lenCommon, quote);
+  // a complete word is followed by the next one, a directory by its entries
+  if (numMatches == 1 && matches[0][lenCommon - 1] != '/') {
+    if (quote)
+      insertText(&quote, 1);
+    insertText(" ", 1);
+  }
+  refreshLine();
+}
+
+// ==========
+// keys
+// ==========
+static void handleEscape(char final) {
+  escBuf[lenEsc] = '\0';
+  int isCtrl = strcmp(escBuf, "1;5") == 0; // ctrl+left, ctrl+right
+  if (final == 'A')
+    browseHistory(1);
+  else if (final == 'B')
+    browseHistory(0);
+  else if (final == 'C')
+    cursor = isCtrl ? wordRight(cursor) : charRight(cursor);
+  else if (final == 'D')
+    cursor = isCtrl ? wordLeft(cursor) : charLeft(cursor);
+  else if (final == 'H' || (final == '~' && strchr("17", escBuf[0])))
+    cursor = 0;
+  else if (final == 'F' || (final == '~' && strchr("48", escBuf[0])))
+    cursor = lenLine;
+  else if (final == '~' && escBuf[0] == '3' && cursor < lenLine)
+    deleteText(cursor, charRight(cursor));
+  else
+    return;
+  refreshLine();
+}
+
+static int handleKey(unsigned char c) {
+  // ==========
+  // escape sequences, ESC [ or ESC O, and alt+b, alt+f
+  // ==========
+  if (escState == 1) {
+    escState = 0;
+    lenEsc = 0;
+    if (c == '[' || c == 'O')
+      escState = 2;
+    else if (c == 'b' || c == 'f') {
+      cursor = c == 'b' ? wordLeft(cursor) : wordRight(cursor);
+      refreshLine();
+    }
+    return KEY_MORE;
+  }
+  if (escState == 2) {
+    if (c >= 0x40 && c <= 0x7e) { // final byte
+      escState = 0;
+      handleEscape((char)c);
+    } else if (lenEsc + 1 < MAX_ESC)
+      escBuf[lenEsc++] = (char)c;
+    return KEY_MORE;
+  }
+  if (isSearching && !handleSearchKey(c))
+    return KEY_MORE;
+  int isTab = c == '\t';
+  if (!isTab && c != 0x1b)
+    isLastTab = 0;
+  // ==========
+  // editing
+  // ==========
+  if (c == '\r' || c == '\n') {
+    if (cursor != lenLine) { // output goes below the whole line
+      cursor = lenLine;
+      refreshLine();
+    }
+    return KEY_DONE;
+  }
+  if (c == CTRL_KEY('d') && lenLine == 0)
+    return KEY_EOF;
+  if (c == 0x7f || c == CTRL_KEY('h')) {
+    if (cursor == 0)
+      return KEY_MORE;
+    deleteText(charLeft(cursor), cursor);
+  } else if (c == CTRL_KEY('d')) {
+    if (cursor == lenLine)
+      return KEY_MORE;
+    deleteText(cursor, charRight(cursor));
+  } else if (c == CTRL_KEY('a'))
+    cursor = 0;
+  else if (c == CTRL_KEY('e'))
+    cursor = lenLine;
+  else if (c == CTRL_KEY('b'))
+    cursor = charLeft(cursor);
+  else if (c == CTRL_KEY('f'))
+    cursor = charRight(cursor);
+  else if (c == CTRL_KEY('u'))
+    deleteText(0, cursor);
+  else if (c == CTRL_KEY('k'))
+    deleteText(cursor, lenLine);
+  else if (c == CTRL_KEY('w')) {
+    size_t start = cursor;
+    while (start > 0 && strchr(" \t", lineBuf[start - 1]))
+      --start;
+    while (start > 0 && !strchr(" \t", lineBuf[start - 1]))
+      --start;
+    deleteText(start, cursor);
+  } else if (c == CTRL_KEY('l')) {
+    fputs("\x1b[H\x1b[2J", stdout);
+    cursorRow = 0;
+  } else if (c == CTRL_KEY('p') || c == CTRL_KEY('n')) {
+    browseHistory(c == CTRL_KEY('p'));
+    return KEY_MORE;
+  } else if (c == CTRL_KEY('r')) {
+    isSearching = 1;
+    isSearchFailed = 0;
+    matchPos = -1;
+    lenQuery = 0;
+    saveLine();
+  } else if (isTab) {
+    completeLine();
+    isLastTab = 1;
+    return KEY_MORE;
+  } else if (c == 0x1b) {
+    escState = 1;
+    return KEY_MORE;
+  } else if (c >= 0x20 && c != 0x7f) {
+    int isAtEnd = cursor == lenLine;
+    insertText((const char *)&c, 1);
+    if (isAtEnd) {
+      // typing at the end only needs the character itself
+      putchar(c);
+      composeShown();
+      int endCol;
+      layoutAt(lenShown, &cursorRow, &endCol);
+      settleEnd(endCol);
+      return KEY_MORE;
+    }
+  } else
+    return KEY_MORE;
+  refreshLine();
+  return KEY_MORE;
+}
+
+// next line of what was accepted, with its '\n'
+static ssize_t takeLine(const char **line) {
+  const char *start = lineBuf + nextLine;
+  size_t len = (size_t)((char *)memchr(start, '\n', lenLine - nextLine) + 1 -
+                        start);
+  nextLine += len;
+  *line = start;
+  return (ssize_t)len;
+}
+
+ssize_t editLine(const char *linePrompt, const char **line) {
+  if (nextLine < lenLine) // shown already, with the first line
+    return takeLine(line);
+  prompt = linePrompt;
+  lenLine = 0;
+  appendBuf(&lineBuf, &lenLine, &capLine, "", 0);
+  nextLine = 0;
+  cursor = 0;
+  cursorRow = 0;
+  isSearching = 0;
+  isLastTab = 0;
+  escState = 0;
+  browsePos = -1;
+  struct winsize winSize;
+  width = ioctl(editFd, TIOCGWINSZ, &winSize) == 0 && winSize.ws_col > 0
+              ? winSize.ws_col
+              : 80;
+  tcsetattr(editFd, TCSANOW, &rawTermios);
+  fputs(prompt, stdout);
+  ssize_t ret;
+  while (1) {
+    if (readStart == readEnd) {
+      // output goes out once per read, not once per key of a paste
+      fflush(stdout);
+      // a job notice leaves the cursor on a new row, under the line
+      unsigned long noticeCount = jobNoticeCount();
+      if (waitForInput(editFd) == -1) {
+        ret = INPUT_INTR;
+        break;
+      }
+      if (jobNoticeCount() != noticeCount) {
+        cursorRow = 0;
+        refreshLine();
+      }
+      ssize_t lenRead = read(editFd, readBuf, EDIT_READ);
+      if (lenRead == -1 && errno == EINTR) {
+        ret = INPUT_INTR;
+        break;
+      }
+      if (lenRead <= 0) {
+        ret = INPUT_EOF;
+        break;
+      }
+      readStart = 0;
+      readEnd = (size_t)lenRead;
+    }
+    int key = handleKey((unsigned char)readBuf[readStart++]);
+    if (key == KEY_DONE) {
+      putchar('\n');
+      appendBuf(&lineBuf, &lenLine, &capLine, "\n", 1);
+      ret = takeLine(line);
+      break;
+    }
+    if (key == KEY_EOF) {
+      ret = INPUT_EOF;
+      break;
+    }
+  }
+  if (ret < 0) // nothing is queued after ctrl+c or EOF
+    lenLine = nextLine = 0;
+  if (ret == INPUT_INTR) // ctrl+c drops what was typed ahead
+    readStart = readEnd;
+  fflush(stdout);
+  tcsetattr(editFd, TCSANOW, &origTermios);
+  return ret;
+}
+
+void editorFree(void) {
+  free(lineBuf);
+  free(shownBuf);
+  free(queryBuf);
+  free(savedBuf);
+  lineBuf = shownBuf = queryBuf = savedBuf = NULL;
+  capLine = capShown = capQuery = capSaved = 0;
+  freeCompletion();
+}
@@ -0,0 +1,26 @@
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+
+#include <sys/types.h>
+
+// line editor for an interactive shell, the terminal is in raw mode only
+// while a line is being edited and back in its own mode for the commands
+//
+// keys: left, right, home, end, ctrl/alt + left/right by words, backspace,
+// delete, ctrl+a/e/b/f/d/k/u/w/l as in bash, up and down go through the
+// history, tab completes commands and paths, a second tab lists them
+// ctrl+d on an empty line is EOF, ctrl+r searches the history backwards,
+// the match is taken with enter or any other key, ctrl+g leaves the search
+// with the line as it was
+
+// returns 0 if fd is a terminal the editor can drive
+int editorInit(int fd);
+
+// show prompt and read one line, with a '\n' at the end
+// *line stays valid until the next call
+// returns the length, INPUT_EOF or INPUT_INTR as inputReadLine() does
+ssize_t editLine(const char *prompt, const char **line);
+
+void editorFree(void);
+
+#endif
@@ -1,708 +1,946 @@
+#define _GNU_SOURCE // fopencookie
 #include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "arena.h"
+#include "builtin.h"
+#include "expand.h"
+#include "heredoc.h"
+#include "history.h"
+#include "input.h"
+#include "jobs.h"
+#include "launcher.h"
+#include "lexer.h"
+#include "lineedit.h"
+#include "parsecache.h"
+#include "parser.h"
+#include "pathcache.h"
+#include "pathglob.h"
+#include "server.h"
+#include "stagelimit.h"
+#include "timing.h"
+#include "trace.h"
+#include "vars.h"
+
 #define MAXCHAR 1035
 #define CTRLC_EXIT 0
 #define CTRLC_PARENT 1
-#define CTRLC_CHILD 2
 
-char **argv, **linesBg;
-char *iFileName, *oFileName; // redirection destination file
-char *homeDir, *lastDir, *lastDirTmp;
-size_t numCmd, numPipe, numBg = 0, argc; // argc inlcudes '|'
-int isSQClosed, isDQClosed, isRPEnd, isFirstFgets, hasIOError, hasBg;
-int hasIRdrct, hasORdrct; // hasORdrct: 1 for '>', 2 for '>>'
-int iFd, oFd;
-pid_t *pidBgArr;
+extern char **environ;
 
-void inputParamInitialize() {
-  isSQClosed = 1;
-  isDQClosed = 1;
-  isRPEnd = 1;
-  isFirstFgets = 1;
-  hasIOError = 0;
-  hasBg = 0;
-}
+int isInteractive, isCmdString; // isCmdString: run by -c
+int isSubshell; // a forked child that exits after its list, e.g. of <(...)
+int isEditing;                  // lines come from the line editor
+int lastStatus;                 // exit status of the last command
+size_t numCaptures;             // $(...) run so far, to tell whether a
+                                // command had one
+const char *serverPath;         // socket of --server
+size_t numServerHelpers;
+Arena cmdArena; // everything that lives for one command line
+Lexer lexer;
+Parser parser;
+InputReader input;
+char *lineWhole; // the whole command line, with continuation lines
+size_t lenLineWhole, capLineWhole;
+size_t loopDepth;       // loops being run
+size_t numLoopExit;     // loops that break leaves
+int isLoopContinue;     // continue the loop left after numLoopExit
 
-void execParamInitialize() {
-  numCmd = 0;
-  numPipe = 0;
-  argc = 0;
-  hasIRdrct = 0;
-  hasORdrct = 0;
-  iFd = 0;
-  oFd = 1;
+void inputParamInitialize() { lenLineWhole = 0; }
+
+void freeOuter() {
+  arenaDestroy(&cmdArena);
+  lexerFree(&lexer);
+  inputClose(&input);
+  free(lineWhole);
+  freeJobs();
+  clearPathCache();
+  clearGlobCache();
+  clearParseCache();
+  freeHistory();
+  editorFree();
+  freeVars();
+  traceStop();
 }
 
-void freeArgv() {
-  for (size_t i = 0; i < MAXCHAR; ++i)
-    free(argv[i]);
-  free(argv);
+int exitBuiltin(char **cmdArgv) {
+  if (isInteractive)
+    printf("exit\n");
+  int exitStatus = cmdArgv[1] ? atoi(cmdArgv[1]) : lastStatus;
+  fflush(stdout);
+  freeOuter();
+  exit(exitStatus);
 }
 
-void freeOuter() {
-  free(iFileName);
-  free(oFileName);
-  free(lastDir);
-  free(lastDirTmp);
-  for (size_t i = 0; i < numBg; ++i)
-    free(linesBg[i]);
-  free(linesBg);
-  free(pidBgArr);
+// keep the raw input, for the parser and to show background jobs
+void appendLineWhole(const char *line, size_t lenLine) {
+  if (lenLineWhole + lenLine + 1 > capLineWhole) {
+    capLineWhole = capLineWhole ? capLineWhole : MAXCHAR;
+    while (lenLineWhole + lenLine + 1 > capLineWhole)
+      capLineWhole *= 2;
+    if (!(lineWhole = realloc(lineWhole, capLineWhole))) {
+      perror("");
+      exit(0);
+    }
+  }
+  memcpy(lineWhole + lenLineWhole, line, lenLine);
+  lenLineWhole += lenLine;
+  lineWhole[lenLineWhole] = '\0';
 }
 
 struct sigaction mySigAction;
-int ctrlCStatus;
+volatile sig_atomic_t ctrlCStatus = CTRLC_PARENT;
 void sigHandler() {
-  // parent and child receive ctrl+c at the same time
-  // only parent is responsible for printing '\n'
-  // child exits immediately
-  if (ctrlCStatus == CTRLC_PARENT) {
-    printf("\n");
-    ctrlCStatus = CTRLC_EXIT;
-  } else if (ctrlCStatus == CTRLC_CHILD)
-    exit(0);
+  // only a flag, the '\n' is printed by the main loop, forked children
+  // take the default action and die
+  // with job control ctrl+c goes to the foreground job and not the shell,
+  // which sees the stage killed by SIGINT instead
+  ctrlCStatus = CTRLC_EXIT;
+}
+
+// myshell                 interactive, or batch if stdin is not a terminal
+// myshell -c command [name [args]]
+//                         run command, the last one replaces the shell,
+//                         with $0 = name and $1... = args
+// myshell script [args]   run script, with $0 = script and $1... = args
+// myshell --server sock [helpers]
+//                         run the command lines of myshell_client, each in
+//                         a helper forked ahead of time
+void parseMainArgs(int argcMain, char **argvMain) {
+  if (argcMain > 2 && strcmp(argvMain[1], "--server") == 0) {
+    serverPath = argvMain[2];
+    numServerHelpers =
+        argcMain > 3 ? strtoul(argvMain[3], NULL, 10) : SERVER_HELPERS;
+    if (numServerHelpers == 0)
+      numServerHelpers = 1;
+    // each request is run as -c runs its command
+    isCmdString = 1;
+    inputOpenString(&input, "");
+  } else if (argcMain > 2 && strcmp(argvMain[1], "-c") == 0) {
+    isCmdString = 1;
+    inputOpenString(&input, argvMain[2]);
+    if (argcMain > 3)
+      setParams(argvMain + 3, (size_t)argcMain - 3);
+  } else if (argcMain > 1 && (strcmp(argvMain[1], "-c") == 0 ||
+                               strcmp(argvMain[1], "--server") == 0)) {
+    printf("myshell: %s: option requires an argument\n", argvMain[1]);
+    exit(2);
+  } else if (argcMain > 1) {
+    int fd = open(argvMain[1], O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+      printf("myshell: %s: %s\n", argvMain[1], strerror(errno));
+      exit(127);
+    }
+    inputOpenFd(&input, fd);
+    setParams(argvMain + 1, (size_t)argcMain - 1);
+  } else {
+    isInteractive = isatty(0);
+    inputOpenFd(&input, 0);
+  }
+}
+
+// break [n], continue [n]
+// outside loops they do nothing, as in bash
+static int loopCtlBuiltin(char **cmdArgv, int isContinue) {
+  long n = cmdArgv[1] ? strtol(cmdArgv[1], NULL, 10) : 1;
+  if (n < 1) {
+    printf("%s: %s: loop count out of range\n", cmdArgv[0], cmdArgv[1]);
+    return 1;
+  }
+  if (loopDepth == 0)
+    return 0;
+  numLoopExit = (size_t)n < loopDepth ? (size_t)n : loopDepth;
+  isLoopContinue = isContinue;
+  if (isLoopContinue)
+    --numLoopExit; // the n-th loop goes on
+  return 0;
 }
 
+int breakBuiltin(char **cmdArgv) { return loopCtlBuiltin(cmdArgv, 0); }
+
+int continueBuiltin(char **cmdArgv) { return loopCtlBuiltin(cmdArgv, 1); }
+
 void actionBeforeMainLoop() {
+  traceInit();
+  varsInit();
+  expandInit();
   mySigAction.sa_handler = &sigHandler;
   sigaction(SIGINT, &mySigAction, NULL);
-  if (!(homeDir = getenv("HOME"))) {
+  initBuiltins();
+  jobsInit(isInteractive, input.fd);
+  if (isInteractive)
+    jobControlInit(input.fd);
+  // wait for input and exited background jobs together
+  input.waitReadable = &waitForInput;
+  if (isInteractive) {
+    historyInit();
+    isEditing = editorInit(input.fd) == 0;
+  }
+}
+
+// next line of input, after prompt if the shell is interactive
+ssize_t readLine(const char *prompt, const char **line) {
+  if (isEditing)
+    return editLine(prompt, line);
+  if (isInteractive) {
+    printf("%s", prompt);
+    fflush(stdout); // use fflush() right after stdout that has no '\n'
+    setJobPrompt(prompt);
+  }
+  return inputReadLine(&input, line);
+}
+
+// stages with limits need a child that applies them before its exec
+int launchStage(const char *cmdPath, char **cmdArgv, const StageLimits *limits,
+                const StageIo *io, pid_t *pid, const char **failed) {
+  if (limits)
+    return launchCmdLimited(cmdPath, cmdArgv, io, limits, pid, failed);
+  return launchCmd(cmdPath, cmdArgv, io, pid);
+}
+
+// ==========
+// forked children that run a list of the command line, such as <(list)
+// ==========
+int runList(const Node *list);
+
+void enterSubshell() {
+  signal(SIGINT, SIG_DFL);
+  leaveJobControl();
+  forgetJobs();
+  traceChild();
+  isInteractive = 0;
+  isSubshell = 1;
+  loopDepth = 0; // break and continue only affect the subshell
+}
+
+void exitSubshell(int status) {
+  fflush(stdout);
+  freeOuter();
+  exit(status);
+}
+
+// ==========
+// process substitution
+// each <(list) and >(list) runs in a forked child next to the stage, which
+// gets /dev/fd/N for the end of the pipe it reads or writes, the job table
+// reaps the child whenever it exits
+// returns the argv of the stage, with the /dev/fd paths in it
+// subFds: the pipe ends of the stage, inherited by it, for the caller to
+// close once it has started
+// stageFds: the fds of the pipeline, which the children must not hold
+// ==========
+
+char **startProcSubs(const SimpleCmd *cmd, const char **iFileName,
+                     const char **oFileName, int *subFds, const int *stageFds,
+                     size_t numStageFds) {
+  char **cmdArgv = arenaAlloc(&cmdArena, sizeof(char *) * (cmd->argc + 1));
+  memcpy(cmdArgv, cmd->argv, sizeof(char *) * (cmd->argc + 1));
+  for (size_t i = 0; i < cmd->numProcSubs; ++i) {
+    const ProcSub *procSub = &cmd->procSubs[i];
+    int pipeFd[2];
+    if (makeStagePipe(pipeFd) == -1) {
+      perror("");
+      freeOuter();
+      exit(0);
+    }
+    fflush(stdout);
+    uint64_t traceAt = TRACE_NOW();
+    pid_t pid = fork();
+    if (pid == 0) {
+      enterSubshell();
+      dup2(pipeFd[procSub->isOut ? 0 : 1], procSub->isOut ? 0 : 1);
+      close(pipeFd[0]);
+      close(pipeFd[1]);
+      for (size_t j = 0; j < numStageFds; ++j)
+        if (stageFds[j] != -1)
+          close(stageFds[j]);
+      for (size_t j = 0; j < i; ++j)
+        close(subFds[j]);
+      exitSubshell(runList(procSub->list));
+    }
+    TRACE("fork", traceAt, "pid", (long)pid,
+          procSub->isOut ? ">(...)" : "<(...)");
+    if (pid == -1) {
+      perror("");
+      freeOuter();
+      exit(0);
+    }
+    addHiddenChild(pid);
+    subFds[i] = pipeFd[procSub->isOut ? 1 : 0];
+    close(pipeFd[procSub->isOut ? 0 : 1]);
+    char *path = arenaAlloc(&cmdArena, 32);
+    sprintf(path, "/dev/fd/%d", subFds[i]);
+    if (procSub->argIdx == PROCSUB_IN_FILE)
+      *iFileName = path;
+    else if (procSub->argIdx == PROCSUB_OUT_FILE)
+      *oFileName = path;
+    else
+      cmdArgv[procSub->argIdx] = path;
+  }
+  return cmdArgv;
+}
+
+// ==========
+// command substitution
+// a lone builtin that only writes to stdout, such as $(pwd), runs in the
+// shell itself with its stdout going straight into out, without a fork or
+// a pipe, anything else runs in a forked child and its output is read from
+// a pipe into the free space of out, which doubles as it fills up
+// ==========
+#define CAPTURE_READ_MIN 4096
+
+static ssize_t captureWrite(void *cookie, const char *data, size_t len) {
+  ByteBuf *out = cookie;
+  byteBufReserve(out, len);
+  memcpy(out->data + out->len, data, len);
+  out->len += len;
+  return (ssize_t)len;
+}
+
+// the builtin that list is, if it can run in the shell
+const Builtin *findPureBuiltin(const Node *list) {
+  if (!list || list->next || list->type != NODE_PIPELINE)
+    return NULL;
+  const Pipeline *pipeline = &list->pipeline;
+  if (pipeline->numCmd != 1 || pipeline->isBg || pipeline->isTimed)
+    return NULL;
+  const SimpleCmd *cmd = pipeline->cmds;
+  if (cmd->argc == 0 || cmd->numAssigns > 0 || cmd->iFileName ||
+      cmd->hereDoc || cmd->oFileName || cmd->limits || cmd->isLimitsAtRun ||
+      cmd->numProcSubs > 0 ||
+      (cmd->numArgWords > 0 && cmd->argWords[0].argIdx == 0))
+    return NULL;
+  const Builtin *builtin = findBuiltin(cmd->argv[0]);
+  return builtin && builtin->isPure ? builtin : NULL;
+}
+
+void captureList(const Node *list, ByteBuf *out) {
+  ++numCaptures;
+  const Builtin *builtin = findPureBuiltin(list);
+  if (builtin) {
+    const SimpleCmd *cmd = list->pipeline.cmds;
+    ArenaMark mark = arenaMark(&cmdArena);
+    char **cmdArgv = cmd->argv;
+    size_t argc;
+    if (cmd->numArgWords > 0)
+      cmdArgv = expandArgs(cmd->argv, cmd->argc, cmd->argWords,
+                           cmd->numArgWords, &cmdArena, &argc);
+    fflush(stdout);
+    FILE *shellStdout = stdout;
+    stdout = fopencookie(out, "w", (cookie_io_functions_t){NULL, captureWrite,
+                                                            NULL, NULL});
+    if (!stdout) {
+      stdout = shellStdout;
+      perror("");
+      freeOuter();
+      exit(0);
+    }
+    setvbuf(stdout, NULL, _IONBF, 0); // straight into out
+    lastStatus = builtin->func(cmdArgv);
+    fclose(stdout);
+    stdout = shellStdout;
+    arenaRelease(&cmdArena, mark);
+    return;
+  }
+  int pipeFd[2];
+  if (makeStagePipe(pipeFd) == -1) {
     perror("");
+    freeOuter();
     exit(0);
   }
-  lastDir = malloc(MAXCHAR);
-  memset(lastDir, 0, MAXCHAR);
-  if (!getcwd(lastDir, MAXCHAR)) {
+  fflush(stdout);
+  uint64_t traceAt = TRACE_NOW();
+  pid_t pid = fork();
+  if (pid == 0) {
+    enterSubshell();
+    dup2(pipeFd[1], 1);
+    close(pipeFd[0]);
+    close(pipeFd[1]);
+    exitSubshell(runList(list));
+  }
+  TRACE("fork", traceAt, "pid", (long)pid, "$(...)");
+  if (pid == -1) {
     perror("");
-    free(lastDir);
+    freeOuter();
     exit(0);
   }
-  lastDirTmp = malloc(MAXCHAR);
-  memset(lastDirTmp, 0, MAXCHAR);
-  strcpy(lastDirTmp, lastDir);
-  iFileName = malloc(MAXCHAR);
-  memset(iFileName, 0, MAXCHAR);
-  oFileName = malloc(MAXCHAR);
-  memset(oFileName, 0, MAXCHAR);
-  linesBg = malloc(sizeof(char *) * MAXCHAR);
-  for (size_t i = 0; i < MAXCHAR; ++i)
-    linesBg[i] = NULL;
-  pidBgArr = malloc(sizeof(pid_t) * MAXCHAR);
+  close(pipeFd[1]);
+  while (1) {
+    if (out->cap - out->len < CAPTURE_READ_MIN)
+      byteBufReserve(out, out->cap > CAPTURE_READ_MIN ? out->cap
+                                                      : CAPTURE_READ_MIN);
+    ssize_t lenRead =
+        read(pipeFd[0], out->data + out->len, out->cap - out->len);
+    if (lenRead > 0)
+      out->len += (size_t)lenRead;
+    else if (lenRead == 0 || errno != EINTR)
+      break;
+  }
+  close(pipeFd[0]);
+  int status = 0;
+  while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+    ;
+  lastStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
 }
 
-int main() {
-  actionBeforeMainLoop();
+// ==========
+// run one pipeline
+// isTail: last command of -c, may replace the shell
+// returns the status of its last stage
+// ==========
+int runPipeline(const Pipeline *pipeline, int isTail) {
+  size_t numCmd = pipeline->numCmd;
+  int isTimed = pipeline->isTimed && !pipeline->isBg; // nobody waits for bg
+  if (numCmd == 0) { // time alone
+    reportTime(NULL, 0, 0, pipeline->isTimeJson);
+    return 0;
+  }
+  // per-pipeline memory goes back as soon as it is done, so that a loop
+  // runs in constant memory
+  ArenaMark mark = arenaMark(&cmdArena);
+  const SimpleCmd *cmds = pipeline->cmds;
+  pid_t *pidArr = arenaAlloc(&cmdArena, sizeof(pid_t) * numCmd);
+  int *statusArr = arenaAlloc(&cmdArena, sizeof(int) * numCmd);
+  const char **limitDescs = arenaAlloc(&cmdArena, sizeof(char *) * numCmd);
+  for (size_t i = 0; i < numCmd; ++i) {
+    pidArr[i] = 0; // 0 for stages that did not start a process
+    statusArr[i] = 0;
+  }
+  StageTime *stageTimeArr = NULL;
+  double timeStart = 0;
+  if (isTimed) {
+    stageTimeArr = arenaAlloc(&cmdArena, sizeof(StageTime) * numCmd);
+    memset(stageTimeArr, 0, sizeof(StageTime) * numCmd);
+    timeStart = wallClock();
+  }
   // ==========
-  // main loop
+  // each pipe is created right before its writer and closed in the parent
+  // as soon as both ends are handed off, so the parent holds at most three
+  // pipe fds and every stage costs a constant number of syscalls
+  // pipeFd[0]: read end, pipeFd[1]: write end
   // ==========
-  while (1) {
-    printf("myshell $ ");
-    fflush(stdout); // use fflush() right after stdout that has no '\n'
-    ctrlCStatus = CTRLC_PARENT;
+  int prevReadFd = -1; // read end of the pipe feeding this stage
+  int pipeFd[2] = {-1, -1};
+  // with job control the stages share a process group led by the first one
+  // started, which takes the terminal if the pipeline is in the foreground
+  int ttyFd = jobTerminal();
+  pid_t jobPgid = -1;
+  for (size_t iCmd = 0; iCmd < numCmd; ++iCmd) {
+    char **cmdArgv = cmds[iCmd].argv;
+    pipeFd[0] = pipeFd[1] = -1;
+    uint64_t traceAt = TRACE_NOW();
+    if (iCmd != numCmd - 1 && makeStagePipe(pipeFd) == -1) {
+      perror("");
+      freeOuter();
+      exit(0);
+    }
+    if (pipeFd[0] != -1)
+      TRACE("pipe", traceAt, NULL, 0, NULL);
     // ==========
-    // receive complete input
+    // stage stdin/stdout
+    // redirection files are opened here in the parent, so that the spawned
+    // child only needs dup2 and no error reporting of its own
     // ==========
-    inputParamInitialize();
-    char *lineWhole = malloc(MAXCHAR);
-    memset(lineWhole, 0, MAXCHAR);
-    while (1) {
-      char lineInit[MAXCHAR];
-      memset(lineInit, 0, MAXCHAR);
-      // fgets() includes '\n', size ensures the ending '\0', here stdin ensures
-      // a final '\n'
-      if (!fgets(lineInit, MAXCHAR, stdin)) // gets EOF from ctrl+c or ctrl+d
-      {
-        // EOF from ctrl+c
-        if (ctrlCStatus == CTRLC_EXIT)
-          break;
-        // EOF from ctrl+d
-        printf("exit\n");
-        freeOuter();
-        free(lineWhole);
-        exit(0);
-      }
-      // ==========
-      // check incomplete quotes and syntax error
-      // ==========
-      size_t lenLineInit = strlen(lineInit); // strlen() excludes the endng '\0'
-      --lenLineInit;                         // excludes the final '\n'
-      for (size_t i = 0; i < lenLineInit; ++i) {
-        if (lineInit[i] == '\'') {
-          if (isSQClosed && isDQClosed &&
-              (i == 0 || (i > 0 && lineInit[i - 1] != '\\')))
-            isSQClosed = 0;
-          else if (!isSQClosed)
-            isSQClosed = 1;
-        } else if (lineInit[i] == '\"') {
-          if (isDQClosed && isSQClosed &&
-              (i == 0 || (i > 0 && lineInit[i - 1] != '\\')))
-            isDQClosed = 0;
-          else if (!isDQClosed &&
-                   (i == 0 || (i > 0 && lineInit[i - 1] != '\\')))
-            isDQClosed = 1;
-        } else if (isFirstFgets) // check syntax error, here ensures only
-                                 // occurring in the first fgets
-        {
-          if ((lineInit[i] == '<' || lineInit[i] == '>') && isSQClosed &&
-              isDQClosed) {
-            if (lineInit[i] == '>' && lineInit[i + 1] == '>')
-              ++i;
-            for (++i; i < lenLineInit; ++i) {
-              if (lineInit[i] == ' ')
-                continue;
-              else if (lineInit[i] == '<' || lineInit[i] == '>' ||
-                       lineInit[i] == '|') {
-                hasIOError = 1;
-                printf("syntax error near unexpected token `%c\'\n",
-                       lineInit[i]);
-                break;
-              } else {
-                --i;
-                break;
-              }
-            }
-          }
-          if (hasIOError)
-            break;
-        }
+    fflush(stdout); // children share stdout, keep our output before theirs
+    // a forked stage must not keep the read end of its own output pipe,
+    // or it would never see EPIPE
+    StageIo io = {prevReadFd, pipeFd[1], pipeFd, pipeFd[0] != -1,
+                  ttyFd != -1 ? jobPgid : 0, pipeline->isBg ? -1 : ttyFd};
+    int hasStageError = 0;
+    int iFd = -1, oFd = -1;
+    const char *iFileName = cmds[iCmd].iFileName;
+    const char *oFileName = cmds[iCmd].oFileName;
+    size_t numSubFds = cmds[iCmd].numProcSubs;
+    int *subFds = arenaAlloc(&cmdArena, sizeof(int) * numSubFds);
+    if (numSubFds > 0) {
+      int stageFds[] = {prevReadFd, pipeFd[0], pipeFd[1]};
+      cmdArgv = startProcSubs(&cmds[iCmd], &iFileName, &oFileName, subFds,
+                              stageFds, 3);
+    }
+    // ==========
+    // expansions, each $(...) runs to its end before the stage starts
+    // ==========
+    size_t numCapturesBefore = numCaptures;
+    size_t argc = cmds[iCmd].argc;
+    const char *hereDoc = cmds[iCmd].hereDoc;
+    size_t lenHereDoc = cmds[iCmd].lenHereDoc;
+    if (cmds[iCmd].numArgWords > 0)
+      cmdArgv = expandArgs(cmdArgv, argc, cmds[iCmd].argWords,
+                           cmds[iCmd].numArgWords, &cmdArena, &argc);
+    if (cmds[iCmd].iFileWord)
+      iFileName = expandWord(cmds[iCmd].iFileWord, &cmdArena);
+    if (cmds[iCmd].oFileWord)
+      oFileName = expandWord(cmds[iCmd].oFileWord, &cmdArena);
+    if (cmds[iCmd].hereDocWord) {
+      hereDoc = expandWord(cmds[iCmd].hereDocWord, &cmdArena);
+      lenHereDoc = strlen(hereDoc);
+    }
+    if (cmds[iCmd].hereStringWord) {
+      const char *word = expandWord(cmds[iCmd].hereStringWord, &cmdArena);
+      lenHereDoc = strlen(word) + 1;
+      char *hereString = arenaAlloc(&cmdArena, lenHereDoc + 1);
+      sprintf(hereString, "%s\n", word);
+      hereDoc = hereString;
+    }
+    char **assigns = cmds[iCmd].assigns;
+    size_t numAssigns = cmds[iCmd].numAssigns;
+    if (cmds[iCmd].numAssignWords > 0) {
+      assigns = arenaAlloc(&cmdArena, sizeof(char *) * numAssigns);
+      memcpy(assigns, cmds[iCmd].assigns, sizeof(char *) * numAssigns);
+      for (size_t i = 0; i < cmds[iCmd].numAssignWords; ++i) {
+        const ExpWord *word = &cmds[iCmd].assignWords[i];
+        assigns[word->argIdx] = expandWord(word, &cmdArena);
       }
-      // has syntax error
-      if (isFirstFgets && hasIOError)
-        break;
-      isFirstFgets = 0;
-      // incomplete quotes
-      if (!isDQClosed || !isSQClosed) {
-        printf("> ");
-        fflush(stdout);
-        strcat(lineWhole, lineInit);
-        continue;
+    }
+    if (ctrlCStatus == CTRLC_EXIT) // while a $(...) ran
+      hasStageError = 1;
+    const StageLimits *limits = cmds[iCmd].limits;
+    if (cmds[iCmd].isLimitsAtRun) {
+      StageLimits *runLimits = arenaAlloc(&cmdArena, sizeof(StageLimits));
+      memset(runLimits, 0, sizeof(StageLimits));
+      runLimits->ioPrio = -1;
+      const char *errMsg;
+      long numTaken = parseLimitPrefixes(cmdArgv, argc, runLimits, &cmdArena,
+                                         &errMsg);
+      if (numTaken == -1) {
+        printf("%s\n", errMsg);
+        hasStageError = 1;
+      } else if (numTaken > 0) {
+        cmdArgv += numTaken;
+        argc -= (size_t)numTaken;
+        limits = runLimits;
       }
-      // check incomplete redirection or pipe, here >> is not considered
-      for (int i = (int)lenLineInit - 1; i >= 0; --i) {
-        if (lineInit[i] == ' ')
-          continue;
-        else if (lineInit[i] == '<' || lineInit[i] == '>' ||
-                 lineInit[i] == '|') {
-          isRPEnd = 0;
-          break;
-        } else {
-          isRPEnd = 1;
-          break;
-        }
+    }
+    limitDescs[iCmd] = limits ? limits->desc : NULL;
+    if (isTimed)
+      stageTimeArr[iCmd].cmdName = argc > 0 ? cmdArgv[0] : "";
+    // the stage has to inherit them, and nothing else starts before it
+    for (size_t i = 0; i < numSubFds; ++i)
+      fcntl(subFds[i], F_SETFD, 0);
+    if (!hasStageError && iFileName) {
+      if ((iFd = open(iFileName, O_RDONLY | O_CLOEXEC)) == -1) {
+        if (errno == ENOENT)
+          printf("%s: No such file or directory\n", iFileName);
+        hasStageError = 1;
       }
-      // incomplete redirecton or pipe
-      if (!isRPEnd) {
-        printf("> ");
-        fflush(stdout);
-        lineInit[lenLineInit] =
-            ' '; // if incomplete rp, we don't need the final '\n'
-        strcat(lineWhole, lineInit);
-        continue;
+      io.inFd = iFd;
+    }
+    if (!hasStageError && !iFileName && hereDoc) {
+      if ((iFd = openHereDoc(hereDoc, lenHereDoc)) == -1) {
+        perror("");
+        hasStageError = 1;
       }
-      // complete input
-      strcat(lineWhole, lineInit);
-      break;
+      io.inFd = iFd;
     }
-    // ==========
-    // original complete input received
-    // meet ctrl+c || syntax error || real empty input
-    // ==========
-    if (ctrlCStatus == CTRLC_EXIT || (isFirstFgets && hasIOError) ||
-        lineWhole[0] == '\n') {
-      free(lineWhole);
-      continue;
+    if (!hasStageError && oFileName) {
+      int oFlag = cmds[iCmd].oMode == 1 ? O_TRUNC : O_APPEND;
+      if ((oFd = open(oFileName, O_CREAT | oFlag | O_WRONLY | O_CLOEXEC,
+                      S_IRWXU)) == -1) {
+        if (errno == EPERM || errno == EROFS)
+          printf("%s: Permission denied\n", oFileName);
+        if (cmds[iCmd].oMode == 2)
+          perror("");
+        hasStageError = 1;
+      }
+      io.outFd = oFd;
     }
     // ==========
-    // check background
+    // built-in commands
+    // alone in the foreground they run in the shell itself, so that cd
+    // and friends take effect and no fork is needed, otherwise they run
+    // in a forked child like any other stage, so do builtins with limits,
+    // which must not stay on the shell
     // ==========
-    size_t lenLineWhole = strlen(lineWhole);
-    lineWhole[--lenLineWhole] = '\0'; // discard final '\n'
-    for (int i = (int)lenLineWhole - 1; i >= 0; --i) {
-      if (lineWhole[i] == '&') {
-        hasBg = 1;
-        linesBg[numBg] = malloc(MAXCHAR);
-        memset(linesBg[numBg], 0, MAXCHAR);
-        strcpy(linesBg[numBg], lineWhole);
-        // delete '&' and make sure end with "\n\0"
-        lineWhole[i] = '\0';
-        lenLineWhole = strlen(lineWhole);
-        break;
-      } else if (lineWhole[lenLineWhole - 1] == ' ')
-        continue;
-      else
-        break;
-    }
+    const char *failed = NULL; // prefix that could not be applied
+    const Builtin *builtin = argc > 0 ? findBuiltin(cmdArgv[0]) : NULL;
+    // assignments in front of a command are only in its environment
+    if (argc > 0 && numAssigns > 0)
+      environ = stageEnviron(assigns, numAssigns, &cmdArena);
+    // a child or builtin reading our stdin has to start after this command
+    // line
+    if (!hasStageError && io.inFd == -1 && input.fd == 0)
+      inputSync(&input);
+    if (hasStageError)
+      statusArr[iCmd] = 1;
     // ==========
-    // deal quotes,
-    // decide special chars in quotes and quotation marks to be ignored,
-    // do not modify lineWhole, only store ignored chars and special chars
+    // assignments alone, or all of it expanded to nothing, only the shell
+    // itself keeps the variables, a pipeline or background drops them as
+    // the subshell would
+    // the status is the one of the last $(...), if there was one
     // ==========
-    isSQClosed = 1;
-    isDQClosed = 1;
-    // index array of quotation marks to be ignored
-    size_t *ignoredCharIdx = malloc(sizeof(size_t) * MAXCHAR);
-    memset(ignoredCharIdx, 0, MAXCHAR);
-    // special characters in quotes
-    char *specialCharInQ = malloc(MAXCHAR);
-    memset(specialCharInQ, 0, MAXCHAR);
-    size_t numIgnoredChar = 0, numSpecialCharInQ = 0;
-    for (size_t i = 0; i < lenLineWhole; ++i) {
-      if (!isSQClosed || !isDQClosed) {
-        if (lineWhole[i] == ' ') {
-          lineWhole[i] = 13;
-          specialCharInQ[numSpecialCharInQ++] = ' ';
-        }
-        if (lineWhole[i] == '\n') {
-          lineWhole[i] = 13;
-          specialCharInQ[numSpecialCharInQ++] = '\n';
-        } else if (lineWhole[i] == '<') {
-          lineWhole[i] = 13;
-          specialCharInQ[numSpecialCharInQ++] = '<';
-        } else if (lineWhole[i] == '>') {
-          lineWhole[i] = 13;
-          specialCharInQ[numSpecialCharInQ++] = '>';
-        } else if (lineWhole[i] == '|') {
-          lineWhole[i] = 13;
-          specialCharInQ[numSpecialCharInQ++] = '|';
-        }
+    else if (argc == 0) {
+      for (size_t i = 0; i < numAssigns && numCmd == 1 && !pipeline->isBg;
+           ++i) {
+        const char *eq = strchr(assigns[i], '=');
+        setVar(assigns[i], (size_t)(eq - assigns[i]), eq + 1, 0);
       }
-      if (lineWhole[i] == '\'') {
-        if (isSQClosed && isDQClosed) {
-          if (i > 0 && lineWhole[i - 1] == '\\')
-            ignoredCharIdx[numIgnoredChar++] = i - 1;
-          else {
-            isSQClosed = 0;
-            ignoredCharIdx[numIgnoredChar++] = i;
-          }
-        } else if (!isSQClosed) {
-          isSQClosed = 1;
-          ignoredCharIdx[numIgnoredChar++] = i;
-        }
-      } else if (lineWhole[i] == '\"') {
-        if (i > 0 && lineWhole[i - 1] == '\\')
-          ignoredCharIdx[numIgnoredChar++] = i - 1;
-        else {
-          if (isDQClosed && isSQClosed) {
-            isDQClosed = 0;
-            ignoredCharIdx[numIgnoredChar++] = i;
-          } else if (!isDQClosed) {
-            isDQClosed = 1;
-            ignoredCharIdx[numIgnoredChar++] = i;
-          }
-        }
+      statusArr[iCmd] = numCaptures != numCapturesBefore ? lastStatus : 0;
+    } else if (builtin && numCmd == 1 && !pipeline->isBg && !limits) {
+      struct rusage usageBefore, usageAfter;
+      if (isTimed)
+        getrusage(RUSAGE_SELF, &usageBefore);
+      statusArr[iCmd] = runBuiltin(builtin, cmdArgv, &io);
+      if (isTimed) {
+        getrusage(RUSAGE_SELF, &usageAfter);
+        diffRusage(&stageTimeArr[iCmd].usage, &usageAfter, &usageBefore);
+      }
+    } else if (builtin) {
+      uint64_t traceAt = TRACE_NOW();
+      pid_t pid = fork();
+      if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        leaveJobControl();
+        forgetJobs();
+        traceChild();
+        isInteractive = 0;
+        loopDepth = 0; // break and continue only affect this stage
+        int status = 1;
+        if (applyStageIo(&io) == -1)
+          perror("");
+        else if (limits && (failed = applyLimits(limits))) {
+          printf("%s: %s\n", failed, strerror(errno));
+          status = 126;
+        } else
+          status = builtin->func(cmdArgv);
+        fflush(stdout);
+        freeOuter();
+        exit(status);
       }
+      TRACE("fork", traceAt, "pid", (long)pid, cmdArgv[0]);
+      if (pid == -1)
+        perror("");
+      pidArr[iCmd] = pid;
     }
     // ==========
-    // delete ignored chars
+    // last command of -c, exec it in place of the shell without a fork
     // ==========
-    char *lineIgnored = malloc(MAXCHAR); // no final '\n'
-    memset(lineIgnored, 0, MAXCHAR);
-    if (numIgnoredChar > 0) {
-      for (size_t i = 0, j = 0, k = 0; i < lenLineWhole; ++i) {
-        if (j < numIgnoredChar && i == ignoredCharIdx[j])
-          ++j;
-        else if (j >= numIgnoredChar ||
-                 (j < numIgnoredChar && i != ignoredCharIdx[j]))
-          lineIgnored[k++] = lineWhole[i];
+    else if (isTail && numCmd == 1 && !pipeline->isBg && !isTimed) {
+      const char *cmdPath = lookupCmdPath(cmdArgv[0]);
+      if (cmdPath && applyStageIo(&io) != -1 &&
+          !(limits && (failed = applyLimits(limits)))) {
+        // the ring goes with the exec
+        TRACE("exec", TRACE_NOW(), NULL, 0, cmdArgv[0]);
+        traceFlush();
+        execv(cmdPath, cmdArgv);
+        if (errno == ENOEXEC) {
+          execv(SCRIPT_SHELL, scriptArgv(cmdPath, cmdArgv));
+          errno = ENOEXEC;
+        }
       }
-    } else
-      strcpy(lineIgnored, lineWhole);
-    free(lineWhole);
-    free(ignoredCharIdx);
-    // ==========
-    // add spaces to lineIgnored
-    // for convenience in tokenization
-    // ==========
-    char *lineAddSpace = malloc(MAXCHAR); // no final '\n'
-    memset(lineAddSpace, 0, MAXCHAR);
-    size_t lenLineIgnored = strlen(lineIgnored);
-    for (size_t i = 0, j = 0; i < lenLineIgnored; ++i) {
-      if (lineIgnored[i] == '<' || lineIgnored[i] == '>' ||
-          lineIgnored[i] == '|') {
-        lineAddSpace[j++] = ' ';
-        lineAddSpace[j++] = lineIgnored[i];
-        if (lineIgnored[i] == '>' && lineIgnored[i + 1] == '>')
-          lineAddSpace[j++] = lineIgnored[++i];
-        lineAddSpace[j++] = ' ';
-      } else
-        lineAddSpace[j++] = lineIgnored[i];
+      int err = cmdPath ? errno : ENOENT;
+      if (failed)
+        printf("%s: %s\n", failed, strerror(err));
+      else if (err == ENOENT)
+        printf("%s: command not found\n", cmdArgv[0]);
+      else
+        printf("%s: %s\n", cmdArgv[0], strerror(err));
+      freeOuter();
+      exit(err == ENOENT && !failed ? 127 : 126);
     }
-    free(lineIgnored);
     // ==========
-    // tokenize, extract redirection, mark pipe location, deal input error
+    // system call
+    // spawned without copying the shell's address space
     // ==========
-    execParamInitialize();
-    argv = malloc(sizeof(char *) * MAXCHAR);
-    for (size_t i = 0; i < MAXCHAR; ++i)
-      argv[i] = NULL;
-    char *token = strtok(lineAddSpace, " ");
-    while (token) {
-      if (token[0] == '<') {
-        if (hasIRdrct || numPipe > 0) {
-          hasIOError = 1;
-          printf("error: duplicated input redirection\n");
-          break;
-        }
-        hasIRdrct = 1;
-        token = strtok(NULL, " ");
-        strcpy(iFileName, token);
-        token = strtok(NULL, " ");
-      } else if (token[0] == '>') {
-        if (hasORdrct) {
-          hasIOError = 1;
-          printf("error: duplicated output redirection\n");
-          break;
-        }
-        if (strcmp(token, ">>") == 0)
-          hasORdrct = 2;
-        else
-          hasORdrct = 1;
-        token = strtok(NULL, " ");
-        strcpy(oFileName, token);
-        token = strtok(NULL, " ");
-      } else if (token[0] == '|') {
-        token = strtok(NULL, " ");
-        if (argc == 0 || token[0] == '|') {
-          hasIOError = 1;
-          printf("error: missing program\n");
-          break;
-        }
-        if (hasORdrct) {
-          hasIOError = 1;
-          printf("error: duplicated output redirection\n");
-          break;
-        }
-        // meet pipe
-        // leave corresponding token in argv as NULL
-        ++numPipe;
-        ++argc;
+    else {
+      pid_t pid = 0;
+      const char *cmdPath = lookupCmdPath(cmdArgv[0]);
+      traceAt = TRACE_NOW();
+      int err = cmdPath ? launchStage(cmdPath, cmdArgv, limits, &io, &pid,
+                                      &failed)
+                        : ENOENT;
+      // cached path vanished, resolve once more before giving up
+      if (err == ENOENT && cmdPath && cmdPath != cmdArgv[0]) {
+        forgetCmdPath(cmdArgv[0]);
+        if ((cmdPath = lookupCmdPath(cmdArgv[0])))
+          err = launchStage(cmdPath, cmdArgv, limits, &io, &pid, &failed);
+      }
+      TRACE("spawn", traceAt, "pid", err == 0 ? (long)pid : -1L, cmdArgv[0]);
+      if (err == 0)
+        pidArr[iCmd] = pid;
+      else if (err == EAGAIN || err == ENOMEM) {
+        // posix_spawn returns the error, errno is not set
+        printf("%s: %s\n", cmdArgv[0], strerror(err));
+        pidArr[iCmd] = -1; // could not create the child at all
+      } else if (err == ENOENT && !failed) {
+        printf("%s: command not found\n", cmdArgv[0]);
+        statusArr[iCmd] = 127;
       } else {
-        argv[argc] = malloc(MAXCHAR);
-        memset(argv[argc], 0, MAXCHAR);
-        strcpy(argv[argc], token);
-        ++argc;
-        token = strtok(NULL, " ");
+        printf("%s: %s\n", failed ? failed : cmdArgv[0], strerror(err));
+        statusArr[iCmd] = 126;
       }
     }
-    free(lineAddSpace);
-    // ==========
-    // has input error
-    // ==========
-    if (argc == 0 && (hasIRdrct || hasORdrct)) {
-      hasIOError = 1;
-      printf("error: missing program\n");
+    environ = varsEnviron();
+    if (iFd != -1)
+      close(iFd);
+    if (oFd != -1)
+      close(oFd);
+    for (size_t i = 0; i < numSubFds; ++i)
+      close(subFds[i]);
+    // both ends are with the children now
+    if (prevReadFd != -1)
+      close(prevReadFd);
+    if (pipeFd[1] != -1)
+      close(pipeFd[1]);
+    prevReadFd = pipeFd[0];
+    // create child process failed, already reported
+    if (pidArr[iCmd] == -1) {
+      freeOuter();
+      exit(0);
     }
-    if (hasIOError) {
-      freeArgv();
-      free(specialCharInQ);
-      // if finally meet input error, delete bg input stored before
-      if (hasBg) {
-        free(linesBg[numBg]);
-        linesBg[numBg] = NULL;
-      }
-      continue;
+    // the child does the same, whichever comes first, a spawned child is
+    // past its exec by now and refuses
+    if (pidArr[iCmd] > 0 && ttyFd != -1) {
+      if (jobPgid == -1)
+        jobPgid = pidArr[iCmd];
+      setpgid(pidArr[iCmd], jobPgid);
     }
-    // ==========
-    // retrive special chars in quotes
-    // ==========
-    if (numSpecialCharInQ > 0) {
-      for (size_t i = 0, j = 0; j < numSpecialCharInQ; ++i) {
-        if (argv[i]) {
-          size_t lenToken = strlen(argv[i]);
-          for (size_t k = 0; k < lenToken; ++k) {
-            if (argv[i][k] == 13)
-              argv[i][k] = specialCharInQ[j++];
-          }
-        }
+  }
+  // ==========
+  // parent process
+  // ==========
+  // every pipe fd of the parent is closed by now, which has to be ahead of
+  // waitpid: only when ALL REFERENCES to the fd is closed, can the process
+  // ends
+  // background, leave all child processes to the job table
+  if (pipeline->isBg)
+    addJob(pidArr, numCmd, pipeline->line, limitDescs,
+           jobPgid == -1 ? 0 : jobPgid, 0);
+  // no background, wait all child processes
+  // the status of every stage is kept, and with time also its rusage
+  else {
+    int isStopped = 0, isSignaled = 0;
+    for (size_t i = 0; i < numCmd; ++i) {
+      int status;
+      struct rusage *usage = isTimed ? &stageTimeArr[i].usage : NULL;
+      uint64_t traceAt = TRACE_NOW();
+      if (pidArr[i] <= 0 || wait4(pidArr[i], &status, WUNTRACED, usage) <= 0)
+        continue;
+      statusArr[i] = WIFEXITED(status)     ? WEXITSTATUS(status)
+                     : WIFSIGNALED(status) ? 128 + WTERMSIG(status)
+                                           : 128 + WSTOPSIG(status);
+      TRACE("wait", traceAt, "status", statusArr[i],
+            cmds[i].argc > 0 ? cmds[i].argv[0] : NULL);
+      // ctrl+z, the stages not reaped yet go on as a stopped job
+      if (WIFSTOPPED(status) && jobPgid != -1) {
+        for (size_t j = i + 1; j < numCmd; ++j)
+          statusArr[j] = statusArr[i];
+        addJob(pidArr + i, numCmd - i, pipeline->line, limitDescs + i,
+               jobPgid, 1);
+        isStopped = 1;
+        break;
+      }
+      if (WIFSIGNALED(status)) {
+        isSignaled = 1;
+        // ctrl+c only reached the job, stop the list as if the shell got it
+        if (WTERMSIG(status) == SIGINT && jobPgid != -1)
+          ctrlCStatus = CTRLC_EXIT;
       }
     }
-    free(specialCharInQ);
-    // ==========
-    // empty input (only spaces)
-    // ==========
-    if (!argv[0]) {
-      freeArgv();
-      continue;
+    if (jobPgid != -1)
+      takeTerminal(isStopped || isSignaled);
+  }
+  if (isTimed) {
+    double wallSec = wallClock() - timeStart;
+    for (size_t i = 0; i < numCmd; ++i) {
+      stageTimeArr[i].pid = pidArr[i];
+      stageTimeArr[i].status = statusArr[i];
     }
-    // ==========
-    // create pipe fd
-    // ==========
-    size_t numPipeFd = 2 * numPipe;
-    int *pipeFd = malloc(sizeof(int) * numPipeFd);
-    // pipeFd[0]: read end, pipeFd[1]: write end
-    for (size_t i = 0; i < numPipeFd; i += 2) {
-      if (pipe(pipeFd + i) == -1) {
-        perror("");
-        freeArgv();
-        freeOuter();
-        free(pipeFd);
-        exit(0);
+    fflush(stdout);
+    reportTime(stageTimeArr, numCmd, wallSec, pipeline->isTimeJson);
+  }
+  // the status of a pipeline is the status of its last stage
+  int status = pipeline->isBg ? 0 : statusArr[numCmd - 1];
+  arenaRelease(&cmdArena, mark);
+  return status;
+}
+
+// ==========
+// run a list of commands, loops included
+// ctrl+c, break and continue stop the rest of the list
+// ==========
+
+// after the body of a loop, returns 1 if the loop has to stop
+int isLoopDone() {
+  if (ctrlCStatus == CTRLC_EXIT)
+    return 1;
+  if (numLoopExit > 0) {
+    --numLoopExit;
+    return 1;
+  }
+  isLoopContinue = 0;
+  return 0;
+}
+
+// returns the status of the last body run, 0 if there was none
+int runLoop(const Node *node) {
+  int status = 0;
+  ++loopDepth;
+  if (node->type == NODE_FOR) {
+    // a shell variable, exported only if it already was, its value is
+    // written over in place as long as it fits
+    const ForLoop *forLoop = &node->forLoop;
+    ArenaMark mark = arenaMark(&cmdArena);
+    char *const *words = forLoop->words;
+    size_t numWords = forLoop->numWords;
+    if (forLoop->numExpWords > 0)
+      words = expandArgs(forLoop->words, forLoop->numWords, forLoop->expWords,
+                         forLoop->numExpWords, &cmdArena, &numWords);
+    size_t lenName = strlen(forLoop->varName);
+    for (size_t i = 0; i < numWords; ++i) {
+      setVar(forLoop->varName, lenName, words[i], 0);
+      status = runList(forLoop->body);
+      if (isLoopDone())
+        break;
+    }
+    arenaRelease(&cmdArena, mark);
+  } else {
+    while (1) {
+      int condStatus = runList(node->whileLoop.cond);
+      if (numLoopExit > 0 || isLoopContinue) {
+        if (isLoopDone())
+          break;
+        continue;
       }
+      if (condStatus != 0 || ctrlCStatus == CTRLC_EXIT)
+        break;
+      status = runList(node->whileLoop.body);
+      if (isLoopDone())
+        break;
     }
+  }
+  --loopDepth;
+  return status;
+}
+
+int runList(const Node *list) {
+  for (const Node *node = list; node; node = node->next) {
+    if (node->type == NODE_PIPELINE) {
+      int isTail = (isSubshell || (isCmdString && inputAtEnd(&input))) &&
+                   loopDepth == 0 && !node->next;
+      lastStatus = runPipeline(&node->pipeline, isTail);
+    } else
+      lastStatus = runLoop(node);
+    if (ctrlCStatus == CTRLC_EXIT || numLoopExit > 0 || isLoopContinue)
+      break;
+  }
+  return lastStatus;
+}
+
+int main(int argcMain, char **argvMain) {
+  parseMainArgs(argcMain, argvMain);
+  // only helpers return, each is through the startup below before a
+  // request comes
+  if (serverPath)
+    serveRequests(serverPath, numServerHelpers);
+  actionBeforeMainLoop();
+  if (serverPath) {
+    char **clientEnv;
+    inputOpenString(&input, takeRequest(&clientEnv));
+    // the line runs in the environment and the directory of the client,
+    // not in the ones the helper started with
+    freeVars();
+    environ = clientEnv;
+    varsInit();
+    initCdDir();
+  }
+  // ==========
+  // main loop
+  // ==========
+  while (1) {
+    // no prompt nor per-line flush for scripts
+    reapJobs();
+    const char *prompt = "myshell $ ";
+    // the line or the command that ctrl+c interrupted ends here
+    if (ctrlCStatus == CTRLC_EXIT)
+      printf("\n");
+    ctrlCStatus = CTRLC_PARENT;
+    // release the previous command line at once
+    arenaReset(&cmdArena);
     // ==========
-    // locate each cmd
-    // ==========
-    numCmd = numPipe + 1;
-    size_t *cmdNameIdx = malloc(sizeof(size_t) * numCmd);
-    cmdNameIdx[0] = 0;
-    for (size_t i = 0, j = 1; i < argc; ++i) {
-      if (!argv[i])
-        cmdNameIdx[j++] = i + 1;
-    }
+    // receive complete input
+    // lines are lexed as they arrive, a continuation line only feeds the
+    // lexer further and never rescans the earlier ones
+    // a line that was parsed before skips both the lexer and the parser
     // ==========
-    // execute
-    // =========
-    pid_t *pidArr = malloc(sizeof(pid_t) * numCmd);
-    for (size_t iCmd = 0; iCmd < numCmd; ++iCmd) {
-      size_t currCmdIdx = cmdNameIdx[iCmd];
-      // ==========
-      // built-in commands
-      // ==========
-      // exit
-      if (strcmp(argv[currCmdIdx], "exit") == 0) {
-        printf("exit\n");
-        freeArgv();
-        freeOuter();
-        free(pipeFd);
-        free(cmdNameIdx);
-        free(pidArr);
-        exit(0);
-      }
-      // cd
-      else if (strcmp(argv[currCmdIdx], "cd") == 0) {
-        if (!argv[currCmdIdx + 1] ||
-            (strcmp(argv[currCmdIdx + 1], "~") == 0)) // cd || cd ~
-        {
-          if (chdir(homeDir) == -1) {
-            perror("");
-            continue;
-          }
-          strcpy(lastDir, lastDirTmp);
-          strcpy(lastDirTmp, homeDir);
-        } else if (strcmp(argv[currCmdIdx + 1], "-") == 0) // cd -
-        {
-          char cwdTmp[MAXCHAR];
-          memset(cwdTmp, 0, MAXCHAR);
-          if (!getcwd(cwdTmp, MAXCHAR) || chdir(lastDir) == -1) {
-            perror("");
-            continue;
-          }
-          printf("%s\n", lastDir);
-          strcpy(lastDirTmp, lastDir);
-          strcpy(lastDir, cwdTmp);
-        } else // cd dirName
-        {
-          if (chdir(argv[currCmdIdx + 1]) == -1) {
-            printf("%s: No such file or directory\n", argv[currCmdIdx + 1]);
-            continue;
-          }
-          char cwdTmp[MAXCHAR];
-          memset(cwdTmp, 0, MAXCHAR);
-          if (!getcwd(cwdTmp, MAXCHAR)) {
-            perror("");
-            continue;
-          }
-          strcpy(lastDir, lastDirTmp);
-          strcpy(lastDirTmp, cwdTmp);
-        }
-        continue;
-      }
-      // jobs
-      else if (strcmp(argv[currCmdIdx], "jobs") == 0) {
-        for (size_t i = 0; i < numBg; ++i) {
-          // use WNOHANG to return the status of given pid
-          if (waitpid(pidBgArr[i], NULL, WNOHANG) == 0)
-            printf("[%ld] running %s\n", i + 1, linesBg[i]);
-          else
-            printf("[%ld] done %s\n", i + 1, linesBg[i]);
-        }
+    inputParamInitialize();
+    lexerReset(&lexer, &cmdArena);
+    parserReset(&parser, &cmdArena);
+    LexStatus lexStatus = LEX_OK;
+    ParseStatus parseStatus = PARSE_OK;
+    Node *list = NULL;
+    const Node *cachedList = NULL;
+    size_t numLines = 0;
+    while (1) {
+      const char *lineInit;
+      ssize_t lenLineInit = readLine(prompt, &lineInit);
+      // interrupted by ctrl+c
+      if (lenLineInit == INPUT_INTR && ctrlCStatus == CTRLC_EXIT)
+        break;
+      if (lenLineInit == INPUT_INTR)
         continue;
-      }
-      // ==========
-      // system call
-      // ==========
-      pid_t pid = fork();
-      pidArr[iCmd] = pid;
-      // receive background command
-      if (pid > 0 && hasBg && iCmd == 0) {
-        pidBgArr[numBg] = pid;
-        printf("[%ld] %s\n", numBg + 1, linesBg[numBg]);
-        // ++numBg when the program is indeed processing the bg input
-        ++numBg;
-      }
-      // create child process failed
-      if (pid == -1) {
-        perror("");
-        freeArgv();
+      // EOF from ctrl+d or end of script
+      if (lenLineInit == INPUT_EOF) {
+        if (isInteractive)
+          printf("exit\n");
         freeOuter();
-        free(pipeFd);
-        free(cmdNameIdx);
-        free(pidArr);
-        exit(0);
+        exit(lastStatus);
       }
-      // ==========
-      // child process
-      // ==========
-      else if (pid == 0) {
-        ctrlCStatus = CTRLC_CHILD;
-        sigaction(SIGINT, &mySigAction, NULL);
-        // ==========
-        // input redirection
-        // ==========
-        if (iCmd != 0) {
-          if (dup2(pipeFd[2 * iCmd - 2], 0) == -1) {
-            perror("");
-            freeArgv();
-            freeOuter();
-            free(pipeFd);
-            free(cmdNameIdx);
-            free(pidArr);
-            exit(0);
-          }
-        } else if (hasIRdrct) {
-          if ((iFd = open(iFileName, O_RDONLY)) == -1) {
-            if (errno == ENOENT)
-              printf("%s: No such file or directory\n", iFileName);
-            freeArgv();
-            freeOuter();
-            free(pipeFd);
-            free(cmdNameIdx);
-            free(pidArr);
-            exit(0);
-          }
-          if (dup2(iFd, 0) == -1) {
-            perror("");
-            freeArgv();
-            freeOuter();
-            free(pipeFd);
-            free(cmdNameIdx);
-            free(pidArr);
-            exit(0);
-          }
-          close(iFd);
-        }
-        // ==========
-        // output redirection
-        // ==========
-        if (iCmd != numCmd - 1) {
-          if (dup2(pipeFd[2 * iCmd + 1], 1) == -1) {
-            perror("");
-            freeArgv();
-            freeOuter();
-            free(pipeFd);
-            free(cmdNameIdx);
-            free(pidArr);
-            exit(0);
-          }
-        } else if (hasORdrct == 1) {
-          if ((oFd = open(oFileName, O_CREAT | O_TRUNC | O_WRONLY, S_IRWXU)) ==
-              -1) {
-            if (errno == EPERM || errno == EROFS)
-              printf("%s: Permission denied\n", oFileName);
-            freeArgv();
-            freeOuter();
-            free(pipeFd);
-            free(cmdNameIdx);
-            free(pidArr);
-            exit(0);
-          }
-          if (dup2(oFd, 1) == -1) {
-            perror("");
-            freeArgv();
-            freeOuter();
-            free(pipeFd);
-            free(cmdNameIdx);
-            free(pidArr);
-            exit(0);
-          }
-          close(oFd);
-        } else if (hasORdrct == 2) {
-          if ((oFd = open(oFileName, O_CREAT | O_APPEND | O_WRONLY, S_IRWXU)) ==
-              -1) {
-            if (errno == EPERM || errno == EROFS)
-              printf("%s: Permission denied\n", oFileName);
-            perror("");
-            freeArgv();
-            freeOuter();
-            free(pipeFd);
-            free(cmdNameIdx);
-            free(pidArr);
-            exit(0);
-          }
-          if (dup2(oFd, 1) == -1) {
-            perror("");
-            freeArgv();
-            freeOuter();
-            free(pipeFd);
-            free(cmdNameIdx);
-            free(pidArr);
-            exit(0);
-          }
-          close(oFd);
-        }
-        // redirection done, close fd
-        for (size_t i = 0; i < numPipeFd; ++i)
-          close(pipeFd[i]);
-        // ==========
-        // built in pwd
-        // ==========
-        if (strcmp(argv[currCmdIdx], "pwd") == 0) {
-          char cwdTmp[MAXCHAR];
-          if (!getcwd(cwdTmp, MAXCHAR))
-            perror("");
-          else
-            printf("%s\n", cwdTmp);
-          freeArgv();
-          freeOuter();
-          free(pipeFd);
-          free(cmdNameIdx);
-          free(pidArr);
-          exit(0);
-        }
-        // ==========
-        // system call
-        // execvp returns only when error occurs, otherwise auto ends curr
-        // process
-        // ==========
-        if (execvp(argv[currCmdIdx], argv + currCmdIdx) == -1) {
-          printf("%s: command not found\n", argv[currCmdIdx]);
-          freeArgv();
-          freeOuter();
-          free(pipeFd);
-          free(cmdNameIdx);
-          free(pidArr);
-          exit(0);
-        }
+      appendLineWhole(lineInit, (size_t)lenLineInit);
+      if (numLines++ == 0 &&
+          (cachedList = parseCacheFind(lineInit, (size_t)lenLineInit)))
+        break;
+      uint64_t traceAt = TRACE_NOW();
+      lexStatus = lexFeed(&lexer, lineInit, (size_t)lenLineInit);
+      TRACE("lex", traceAt, "tokens", (long)lexer.numTokens, NULL);
+      if (lexStatus == LEX_ERROR)
+        break;
+      if (lexStatus == LEX_OK) {
+        traceAt = TRACE_NOW();
+        parseStatus = parseTokens(&parser, lexer.tokens, lexer.numTokens,
+                                  lineWhole, &list);
+        TRACE("parse", traceAt, "tokens", (long)lexer.numTokens, NULL);
+        if (parseStatus != PARSE_INCOMPLETE)
+          break;
       }
+      // incomplete quotes, redirection, pipe or loop
+      prompt = "> ";
     }
     // ==========
-    // parent process
+    // original complete input received
+    // meet ctrl+c || syntax error || real empty input
     // ==========
-    // should be ahead of waitpid
-    // only when ALL REFERENCES to the fd is closed, can the process ends
-    // so to let child process end,
-    // we must first close references from parent
-    for (size_t i = 0; i < numPipeFd; ++i)
-      close(pipeFd[i]);
-    // no background, wait all child processes
-    if (!hasBg) {
-      for (size_t i = 0; i < numCmd; ++i)
-        waitpid(pidArr[i], NULL, WUNTRACED);
+    if (ctrlCStatus == CTRLC_EXIT)
+      continue;
+    if (isInteractive)
+      addHistory(lineWhole, lenLineWhole);
+    if (lexStatus == LEX_ERROR) {
+      printf("syntax error near unexpected token `%s\'\n",
+             tokenText(lexer.errToken));
+      lastStatus = 2;
+      continue;
+    }
+    if (parseStatus == PARSE_ERROR) {
+      printf("%s\n", parser.errMsg);
+      lastStatus = 2;
+      continue;
     }
-    // ready for next loop
-    freeArgv();
-    free(pipeFd);
-    free(cmdNameIdx);
-    free(pidArr);
+    if (!cachedList && list && numLines == 1)
+      parseCacheAdd(lineWhole, lenLineWhole, list);
+    // ==========
+    // execute
+    // =========
+    uint64_t traceAt = TRACE_NOW();
+    runList(cachedList ? cachedList : list);
+    TRACE("line", traceAt, "status", lastStatus, NULL);
   }
   return 0;
 }
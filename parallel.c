@@ -0,0 +1,439 @@
+#define _GNU_SOURCE // memfd_create
+#include "parallel.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "builtin.h"
+#include "input.h"
+#include "launcher.h"
+#include "pathcache.h"
+#include "zerocopy.h"
+
+#define MAX_FAILED 101
+#define POLL_MS 10 // for children without a pidfd
+// characters that only a shell can make sense of, a line with none of them
+// is split at blanks and spawned directly
+#define SHELL_CHARS "|&;<>()$`'\"\\*?[]~#{}=!\n"
+
+typedef struct {
+  pid_t pid;  // 0 for a free slot
+  int pidFd;  // -1 if pidfd_open() is not available
+  int outFd;  // output kept until the job is done, -1 when ungrouped
+  size_t seq; // of the input line
+} ParJob;
+
+// output of a finished job that waits for the jobs before it, with -k
+typedef struct {
+  size_t seq;
+  int outFd;
+} ParOut;
+
+typedef struct {
+  char **cmdArgv; // command the lines are arguments of, NULL for lines
+  int isShellCmd; // cmdArgv has shell syntax, it is run by a shell
+  int isGrouped, isOrdered;
+  int nullFd; // stdin of the jobs, the input is for the shell alone
+  ParJob *jobs;
+  struct pollfd *pollFds;
+  size_t numSlots, numRunning, numFailed, numStarted;
+  ParOut *outs;
+  size_t numOuts, capOuts, nextOut; // nextOut: seq to print next
+} Parallel;
+
+static int statusOf(int status) {
+  if (WIFEXITED(status))
+    return WEXITSTATUS(status);
+  return 128 + WTERMSIG(status);
+}
+
+static void *allocOrExit(size_t size) {
+  void *ptr = malloc(size ? size : 1);
+  if (!ptr) {
+    perror("");
+    exit(0);
+  }
+  return ptr;
+}
+
+// ==========
+// output
+// ==========
+static void writeOut(int outFd) {
+  if (outFd == -1)
+    return;
+  lseek(outFd, 0, SEEK_SET);
+  fflush(stdout);
+  copyFdAll(outFd, 1);
+  close(outFd);
+}
+
+// with -k the output waits until every job before it is printed
+static void putOut(Parallel *par, size_t seq, int outFd) {
+  if (!par->isOrdered) {
+    writeOut(outFd);
+    return;
+  }
+  if (par->numOuts == par->capOuts) {
+    par->capOuts = par->capOuts ? 2 * par->capOuts : 16;
+    if (!(par->outs = realloc(par->outs, par->capOuts * sizeof(ParOut)))) {
+      perror("");
+      exit(0);
+    }
+  }
+  par->outs[par->numOuts++] = (ParOut){seq, outFd};
+  for (size_t i = 0; i < par->numOuts;) {
+    if (par->outs[i].seq != par->nextOut) {
+      ++i;
+      continue;
+    }
+    writeOut(par->outs[i].outFd);
+    par->outs[i] = par->outs[--par->numOuts];
+    ++par->nextOut;
+    i = 0; // the next one may be anywhere
+  }
+}
+
+// ==========
+// starting jobs
+// ==========
+// argv of the command with each {} replaced by line, or with line appended
+static char **argsWithLine(char **cmdArgv, const char *line) {
+  size_t numArgs = 0, lenLine = strlen(line);
+  int hasSlot = 0;
+  for (; cmdArgv[numArgs]; ++numArgs)
+    hasSlot = hasSlot || strstr(cmdArgv[numArgs], "{}");
+  char **argv = allocOrExit(sizeof(char *) * (numArgs + 2));
+  for (size_t i = 0; i < numArgs; ++i) {
+    const char *arg = cmdArgv[i], *slot;
+    size_t numSlots = 0;
+    for (slot = arg; (slot = strstr(slot, "{}")); slot += 2)
+      ++numSlots;
+    char *out = argv[i] = allocOrExit(strlen(arg) + numSlots * lenLine + 1);
+    while ((slot = strstr(arg, "{}"))) {
+      memcpy(out, arg, (size_t)(slot - arg));
+      out += slot - arg;
+      memcpy(out, line, lenLine);
+      out += lenLine;
+      arg = slot + 2;
+    }
+    strcpy(out, arg);
+  }
+  argv[numArgs] = hasSlot ? NULL : strdup(line);
+  argv[numArgs + 1] = NULL;
+  if (!hasSlot && !argv[numArgs]) {
+    perror("");
+    exit(0);
+  }
+  return argv;
+}
+
+// whether the command has shell syntax outside its {}, e.g. a pipe
+static int isShellTemplate(char **cmdArgv) {
+  for (; *cmdArgv; ++cmdArgv)
+    for (const char *c = *cmdArgv; *c; ++c) {
+      if (c[0] == '{' && c[1] == '}')
+        ++c;
+      else if (strchr(SHELL_CHARS, *c))
+        return 1;
+    }
+  return 0;
+}
+
+// appends str to out in single quotes, so that the shell takes it as it is
+static char *appendQuoted(char *out, const char *str) {
+  *out++ = '\'';
+  for (; *str; ++str) {
+    if (*str == '\'') {
+      memcpy(out, "'\\''", 4);
+      out += 4;
+    } else
+      *out++ = *str;
+  }
+  *out++ = '\'';
+  return out;
+}
+
+// command line for a shell of the command with each {} replaced by line, or
+// with line appended, quoted as one word either way as in argsWithLine; the
+// words of the command are joined as they are, so that their syntax counts
+static char *cmdWithLine(char **cmdArgv, const char *line) {
+  size_t lenCmd = 0, numSlots = 0, lenQuoted = 2;
+  for (const char *c = line; *c; ++c)
+    lenQuoted += *c == '\'' ? 4 : 1;
+  for (size_t i = 0; cmdArgv[i]; ++i) {
+    lenCmd += strlen(cmdArgv[i]) + 1;
+    for (const char *slot = cmdArgv[i]; (slot = strstr(slot, "{}"));
+         slot += 2)
+      ++numSlots;
+  }
+  char *cmd = allocOrExit(lenCmd + (numSlots + 1) * lenQuoted + 1);
+  char *out = cmd;
+  for (size_t i = 0; cmdArgv[i]; ++i) {
+    const char *arg = cmdArgv[i], *slot;
+    if (i > 0)
+      *out++ = ' ';
+    while ((slot = strstr(arg, "{}"))) {
+      memcpy(out, arg, (size_t)(slot - arg));
+      out = appendQuoted(out + (slot - arg), line);
+      arg = slot + 2;
+    }
+    strcpy(out, arg);
+    out += strlen(arg);
+  }
+  if (numSlots == 0) {
+    *out++ = ' ';
+    out = appendQuoted(out, line);
+  }
+  *out = '\0';
+  return cmd;
+}
+
+// argv of a line that is a plain command, NULL if it needs a shell
+static char **argsOfLine(const char *line) {
+  if (strpbrk(line, SHELL_CHARS))
+    return NULL;
+  size_t numWords = 0;
+  for (const char *c = line; *c;) {
+    c += strspn(c, " \t");
+    if (*c)
+      ++numWords;
+    c += strcspn(c, " \t");
+  }
+  char **argv = allocOrExit(sizeof(char *) * (numWords + 1));
+  const char *c = line;
+  for (size_t i = 0; i < numWords; ++i) {
+    c += strspn(c, " \t");
+    size_t lenWord = strcspn(c, " \t");
+    if (!(argv[i] = strndup(c, lenWord))) {
+      perror("");
+      exit(0);
+    }
+    c += lenWord;
+  }
+  argv[numWords] = NULL;
+  // builtins and keywords mean something to the shell only
+  if (numWords == 0 || findBuiltin(argv[0]) || strcmp(argv[0], "for") == 0 ||
+      strcmp(argv[0], "while") == 0) {
+    for (size_t i = 0; i < numWords; ++i)
+      free(argv[i]);
+    free(argv);
+    return NULL;
+  }
+  return argv;
+}
+
+// returns 0 if the job runs, or its exit status if it could not start
+static int startJob(Parallel *par, ParJob *job, const char *line) {
+  char **argv = NULL, *cmd = NULL;
+  if (!par->cmdArgv)
+    argv = argsOfLine(line);
+  else if (par->isShellCmd)
+    cmd = cmdWithLine(par->cmdArgv, line);
+  else
+    argv = argsWithLine(par->cmdArgv, line);
+  char *shellArgv[] = {"myshell", "-c", cmd ? cmd : (char *)line, NULL};
+  // the line goes to a shell of our own, which runs its last command in
+  // place of itself
+  const char *cmdPath = argv ? lookupCmdPath(argv[0]) : "/proc/self/exe";
+  job->outFd = par->isGrouped ? memfd_create("parallel", MFD_CLOEXEC) : -1;
+  StageIo io = {par->nullFd, job->outFd, NULL, 0, 0, -1};
+  job->pidFd = -1;
+  int err = cmdPath ? launchCmd(cmdPath, argv ? argv : shellArgv, &io,
+                                &job->pid)
+                    : ENOENT;
+  int status = 0;
+  if (err) {
+    printf("%s: %s\n", argv ? argv[0] : "myshell",
+           err == ENOENT ? "command not found" : strerror(err));
+    status = err == ENOENT ? 127 : 126;
+    job->pid = 0;
+    if (job->outFd != -1)
+      close(job->outFd);
+    job->outFd = -1;
+  }
+  for (size_t i = 0; argv && argv[i]; ++i)
+    free(argv[i]);
+  free(argv);
+  free(cmd);
+  if (!err)
+    job->pidFd = (int)syscall(SYS_pidfd_open, job->pid, 0);
+  return status;
+}
+
+// ==========
+// waiting for jobs
+// ==========
+static void finishJob(Parallel *par, ParJob *job, int status) {
+  if (status != 0)
+    ++par->numFailed;
+  putOut(par, job->seq, job->outFd);
+  if (job->pidFd != -1)
+    close(job->pidFd);
+  job->pidFd = -1;
+  job->pid = 0;
+  --par->numRunning;
+}
+
+// wait until at least one running job is done
+// returns -1 when interrupted by a signal, e.g. ctrl+c
+static int waitJobs(Parallel *par) {
+  size_t numDone = 0;
+  while (numDone == 0) {
+    int hasNoPidFd = 0;
+    for (size_t i = 0; i < par->numSlots; ++i) {
+      par->pollFds[i].fd = par->jobs[i].pid ? par->jobs[i].pidFd : -1;
+      par->pollFds[i].events = POLLIN;
+      hasNoPidFd = hasNoPidFd || (par->jobs[i].pid && par->jobs[i].pidFd == -1);
+    }
+    if (poll(par->pollFds, par->numSlots, hasNoPidFd ? POLL_MS : -1) == -1 &&
+        errno == EINTR)
+      return -1;
+    for (size_t i = 0; i < par->numSlots; ++i) {
+      ParJob *job = &par->jobs[i];
+      int status;
+      if (job->pid &&
+          (job->pidFd == -1 || (par->pollFds[i].revents & POLLIN)) &&
+          waitpid(job->pid, &status, WNOHANG) == job->pid) {
+        finishJob(par, job, statusOf(status));
+        ++numDone;
+      }
+    }
+  }
+  return 0;
+}
+
+// ==========
+// parallel builtin
+// ==========
+static long parseNumJobs(const char *str) {
+  char *end;
+  long numJobs = strtol(str, &end, 10);
+  if (end == str || *end || numJobs < 0)
+    return -1;
+  if (numJobs == 0)
+    numJobs = sysconf(_SC_NPROCESSORS_ONLN);
+  return numJobs > 0 ? numJobs : 1;
+}
+
+int parallelBuiltin(char **cmdArgv) {
+  Parallel par = {0};
+  par.isGrouped = 1;
+  long numJobs = parseNumJobs("0");
+  const char *fileName = NULL;
+  size_t i = 1;
+  for (; cmdArgv[i] && cmdArgv[i][0] == '-'; ++i) {
+    const char *opt = cmdArgv[i];
+    if (strcmp(opt, "--") == 0) {
+      ++i;
+      break;
+    }
+    if (strncmp(opt, "-j", 2) == 0) {
+      const char *num = opt[2] ? opt + 2 : cmdArgv[++i];
+      if (!num || (numJobs = parseNumJobs(num)) == -1) {
+        printf("parallel: %s: invalid number of jobs\n", num ? num : "");
+        return 2;
+      }
+    } else if (strcmp(opt, "-k") == 0)
+      par.isOrdered = 1;
+    else if (strcmp(opt, "-u") == 0)
+      par.isGrouped = 0;
+    else if (strcmp(opt, "-a") == 0 && cmdArgv[i + 1])
+      fileName = cmdArgv[++i];
+    else {
+      printf("parallel: %s: invalid option\n", opt);
+      printf("usage: parallel [-j N] [-k] [-u] [-a file] [command [arg...]]\n");
+      return 2;
+    }
+  }
+  par.cmdArgv = cmdArgv[i] ? cmdArgv + i : NULL;
+  par.isShellCmd = par.cmdArgv && isShellTemplate(par.cmdArgv);
+  par.isOrdered = par.isOrdered && par.isGrouped;
+  int inFd = fileName ? open(fileName, O_RDONLY | O_CLOEXEC) : 0;
+  if (inFd == -1) {
+    printf("parallel: %s: %s\n", fileName, strerror(errno));
+    return 1;
+  }
+  par.nullFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  par.numSlots = (size_t)numJobs;
+  par.jobs = allocOrExit(sizeof(ParJob) * par.numSlots);
+  par.pollFds = allocOrExit(sizeof(struct pollfd) * par.numSlots);
+  memset(par.jobs, 0, sizeof(ParJob) * par.numSlots);
+  InputReader reader;
+  inputOpenFd(&reader, inFd);
+  // ==========
+  // a new job as soon as a slot is free, until the input runs out
+  // ==========
+  int isIntr = 0;
+  while (!isIntr) {
+    if (par.numRunning == par.numSlots && waitJobs(&par) == -1) {
+      isIntr = 1;
+      break;
+    }
+    const char *line;
+    ssize_t lenLine = inputReadLine(&reader, &line);
+    if (lenLine == INPUT_INTR)
+      isIntr = 1;
+    if (lenLine < 0)
+      break;
+    char *text = strndup(line, (size_t)lenLine);
+    if (!text) {
+      perror("");
+      exit(0);
+    }
+    if (lenLine > 0 && text[lenLine - 1] == '\n')
+      text[lenLine - 1] = '\0';
+    if (!text[0]) {
+      free(text);
+      continue;
+    }
+    ParJob *job = par.jobs;
+    while (job->pid)
+      ++job;
+    job->seq = par.numStarted++;
+    ++par.numRunning;
+    int status = startJob(&par, job, text);
+    free(text);
+    if (!job->pid)
+      finishJob(&par, job, status);
+  }
+  // ==========
+  // the jobs still running, after ctrl+c without their output
+  // ==========
+  while (par.numRunning > 0 && !isIntr)
+    isIntr = waitJobs(&par) == -1;
+  for (size_t j = 0; j < par.numSlots; ++j) {
+    if (!par.jobs[j].pid)
+      continue;
+    kill(par.jobs[j].pid, SIGTERM);
+    waitpid(par.jobs[j].pid, NULL, 0);
+    if (par.jobs[j].pidFd != -1)
+      close(par.jobs[j].pidFd);
+    if (par.jobs[j].outFd != -1)
+      close(par.jobs[j].outFd);
+  }
+  for (size_t j = 0; j < par.numOuts; ++j)
+    if (par.outs[j].outFd != -1)
+      close(par.outs[j].outFd);
+  inputSync(&reader); // unread lines stay for whoever reads next
+  inputClose(&reader);
+  if (fileName)
+    close(inFd);
+  if (par.nullFd != -1)
+    close(par.nullFd);
+  free(par.jobs);
+  free(par.pollFds);
+  free(par.outs);
+  if (isIntr)
+    return 130;
+  return par.numFailed < MAX_FAILED ? (int)par.numFailed : MAX_FAILED;
+}
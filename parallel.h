@@ -0,0 +1,19 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// parallel [-j N] [-k] [-u] [-a file] [command [arg...]]
+// runs one job per input line, from stdin or file, with at most N of them
+// at a time, and starts the next one as soon as any job exits
+// with a command, the line is the argument that replaces each {} in the
+// args, or comes last if there is none, otherwise the line is a command
+// line of its own
+// a command with shell syntax, such as 'echo {} | tr a b', is joined with
+// spaces and run by myshell -c, the line still quoted as one word
+// -j N: jobs at a time, 0 for one per online CPU, which is the default
+// -k: output in the order of the input lines, instead of as jobs finish
+// -u: no grouping, jobs write to stdout as they go
+// returns 0 if every job succeeded, or the number of failed jobs, at most
+// 101, as GNU parallel does
+int parallelBuiltin(char **cmdArgv);
+
+#endif
@@ -0,0 +1,137 @@
+#include "parsecache.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define PARSECACHE_SIZE 64      // entries
+#define PARSECACHE_BUCKETS 128  // power of 2
+#define PARSECACHE_BLOCK 1024   // arena block of an entry, most lines fit
+#define PARSECACHE_SEEN 256     // power of 2
+#define NONE -1
+
+typedef struct {
+  uint64_t hash;
+  char *line; // NULL for a free entry
+  size_t len;
+  Node *list;
+  Arena arena; // holds line and list
+  int prev, next;   // LRU order, head is the most recently used
+  int nextInBucket;
+} CacheEntry;
+
+static CacheEntry entries[PARSECACHE_SIZE];
+static int buckets[PARSECACHE_BUCKETS];
+static int lruHead = NONE, lruTail = NONE;
+static int numEntries;
+// hashes of lines seen once, direct-mapped, a line is only copied into the
+// cache when it comes the second time, so scripts without repeated lines do
+// not pay for it
+static uint64_t seenHash[PARSECACHE_SEEN];
+static int isInit;
+
+static uint64_t hashLine(const char *line, size_t len) {
+  uint64_t h = 14695981039346656037ULL; // FNV-1a
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (unsigned char)line[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static void init(void) {
+  for (int i = 0; i < PARSECACHE_BUCKETS; ++i)
+    buckets[i] = NONE;
+  isInit = 1;
+}
+
+static void unlinkLru(int i) {
+  CacheEntry *entry = &entries[i];
+  if (entry->prev != NONE)
+    entries[entry->prev].next = entry->next;
+  else
+    lruHead = entry->next;
+  if (entry->next != NONE)
+    entries[entry->next].prev = entry->prev;
+  else
+    lruTail = entry->prev;
+}
+
+static void pushLru(int i) {
+  entries[i].prev = NONE;
+  entries[i].next = lruHead;
+  if (lruHead != NONE)
+    entries[lruHead].prev = i;
+  lruHead = i;
+  if (lruTail == NONE)
+    lruTail = i;
+}
+
+static void unlinkBucket(int i) {
+  int *link = &buckets[entries[i].hash & (PARSECACHE_BUCKETS - 1)];
+  while (*link != i)
+    link = &entries[*link].nextInBucket;
+  *link = entries[i].nextInBucket;
+}
+
+const Node *parseCacheFind(const char *line, size_t len) {
+  if (!isInit)
+    return NULL;
+  uint64_t hash = hashLine(line, len);
+  for (int i = buckets[hash & (PARSECACHE_BUCKETS - 1)]; i != NONE;
+       i = entries[i].nextInBucket) {
+    CacheEntry *entry = &entries[i];
+    if (entry->hash == hash && entry->len == len &&
+        memcmp(entry->line, line, len) == 0) {
+      if (lruHead != i) {
+        unlinkLru(i);
+        pushLru(i);
+      }
+      return entry->list;
+    }
+  }
+  return NULL;
+}
+
+void parseCacheAdd(const char *line, size_t len, const Node *list) {
+  uint64_t hash = hashLine(line, len);
+  uint64_t *seen = &seenHash[hash & (PARSECACHE_SEEN - 1)];
+  if (*seen != hash) {
+    *seen = hash;
+    return;
+  }
+  if (!isInit)
+    init();
+  int i;
+  if (numEntries < PARSECACHE_SIZE)
+    i = numEntries++;
+  else {
+    // reuse the least recently used entry, its blocks included
+    i = lruTail;
+    unlinkLru(i);
+    unlinkBucket(i);
+    arenaReset(&entries[i].arena);
+  }
+  CacheEntry *entry = &entries[i];
+  entry->arena.blockSize = PARSECACHE_BLOCK;
+  entry->hash = hash;
+  entry->line = arenaStrndup(&entry->arena, line, len);
+  entry->len = len;
+  entry->list = copyNodes(list, &entry->arena);
+  int *bucket = &buckets[entry->hash & (PARSECACHE_BUCKETS - 1)];
+  entry->nextInBucket = *bucket;
+  *bucket = i;
+  pushLru(i);
+}
+
+void clearParseCache(void) {
+  for (int i = 0; i < numEntries; ++i) {
+    arenaDestroy(&entries[i].arena);
+    entries[i].line = NULL;
+  }
+  numEntries = 0;
+  lruHead = lruTail = NONE;
+  memset(seenHash, 0, sizeof(seenHash));
+  isInit = 0;
+}
@@ -0,0 +1,22 @@
+#ifndef PARSECACHE_H
+#define PARSECACHE_H
+
+#include <stddef.h>
+
+#include "parser.h"
+
+// parsed one-line commands by their raw text, so that a line that comes
+// again, as in scripts and loops typed at the prompt, skips the lexer and
+// the parser
+// the least recently used line is dropped once the cache is full
+
+// the cached tree for line[0, len), or NULL
+// it stays valid until the next parseCacheAdd()
+const Node *parseCacheFind(const char *line, size_t len);
+
+// keep a copy of list for line[0, len), from the second time it is added
+void parseCacheAdd(const char *line, size_t len, const Node *list);
+
+void clearParseCache(void);
+
+#endif
@@ -0,0 +1,624 @@
+#include "parser.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "vars.h"
+
+// position in the tokens of one parse
+typedef struct {
+  Parser *parser;
+  const Token *tokens;
+  size_t numTokens, i;
+  const char *src;
+} Cursor;
+
+static const char *const doWords[] = {"do", NULL};
+static const char *const doneWords[] = {"done", NULL};
+static const char *const reservedWords[] = {"do", "done", NULL};
+
+static int isKeyword(const Token *token, const char *keyword) {
+  return token->type == TOK_WORD && !token->isQuoted && !token->numSubs &&
+         strcmp(token->word, keyword) == 0;
+}
+
+static int isOneOf(const Token *token, const char *const *keywords) {
+  for (; keywords && *keywords; ++keywords)
+    if (isKeyword(token, *keywords))
+      return 1;
+  return 0;
+}
+
+static int isSeparator(TokenType type) {
+  return type == TOK_SEMI || type == TOK_NEWLINE || type == TOK_BG;
+}
+
+static int isRedirection(TokenType type) {
+  return type == TOK_IN || type == TOK_OUT || type == TOK_APPEND ||
+         type == TOK_HEREDOC || type == TOK_HERESTRING;
+}
+
+static ParseStatus syntaxError(Cursor *cur, const Token *token) {
+  const char *text =
+      token->type == TOK_WORD ? token->word : tokenText(token->type);
+  char *msg = arenaAlloc(cur->parser->arena, strlen(text) + 48);
+  sprintf(msg, "syntax error near unexpected token `%s\'", text);
+  cur->parser->errMsg = msg;
+  return PARSE_ERROR;
+}
+
+static ParseStatus error(Cursor *cur, const char *msg) {
+  cur->parser->errMsg = msg;
+  return PARSE_ERROR;
+}
+
+static void skipNewlines(Cursor *cur) {
+  while (cur->i < cur->numTokens && cur->tokens[cur->i].type == TOK_NEWLINE)
+    ++cur->i;
+}
+
+static Node *newNode(Cursor *cur, NodeType type) {
+  Node *node = arenaAlloc(cur->parser->arena, sizeof(Node));
+  memset(node, 0, sizeof(Node));
+  node->type = type;
+  return node;
+}
+
+static int isProcSub(TokenType type) {
+  return type == TOK_PROCSUB_IN || type == TOK_PROCSUB_OUT;
+}
+
+// the list of <(...), >(...) or $(...), lexed and parsed on its own
+static ParseStatus parseSubList(Cursor *cur, const char *str, size_t len,
+                                const char *what, Node **list) {
+  Arena *arena = cur->parser->arena;
+  char *text = arenaAlloc(arena, len + 2);
+  memcpy(text, str, len);
+  strcpy(text + len, "\n");
+  Lexer lexer = {0};
+  Parser parser;
+  lexerReset(&lexer, arena);
+  parserReset(&parser, arena);
+  // line by line, as the lexer takes input
+  LexStatus lexStatus = LEX_OK;
+  for (const char *line = text; *line && lexStatus != LEX_ERROR;) {
+    size_t lenLine = (size_t)(strchr(line, '\n') + 1 - line);
+    lexStatus = lexFeed(&lexer, line, lenLine);
+    line += lenLine;
+  }
+  ParseStatus status = PARSE_ERROR;
+  if (lexStatus == LEX_OK)
+    status = parseTokens(&parser, lexer.tokens, lexer.numTokens, text, list);
+  lexerFree(&lexer);
+  if (status == PARSE_ERROR && parser.errMsg)
+    return error(cur, parser.errMsg);
+  if (status != PARSE_OK) {
+    char *msg = arenaAlloc(arena, strlen(what) + 20);
+    sprintf(msg, "syntax error in %s", what);
+    return error(cur, msg);
+  }
+  return PARSE_OK;
+}
+
+static ParseStatus parseProcSub(Cursor *cur, SimpleCmd *cmd,
+                                const Token *token, size_t argIdx) {
+  Arena *arena = cur->parser->arena;
+  ProcSub *procSubs =
+      arenaAlloc(arena, sizeof(ProcSub) * (cmd->numProcSubs + 1));
+  if (cmd->numProcSubs > 0)
+    memcpy(procSubs, cmd->procSubs, sizeof(ProcSub) * cmd->numProcSubs);
+  cmd->procSubs = procSubs;
+  ProcSub *procSub = &procSubs[cmd->numProcSubs++];
+  procSub->argIdx = argIdx;
+  procSub->isOut = token->type == TOK_PROCSUB_OUT;
+  return parseSubList(cur, token->word, token->len, "process substitution",
+                      &procSub->list);
+}
+
+// an argument that is only known when it runs
+static int isExpArg(const Token *token) {
+  return token->numSubs > 0 || token->numGlobs > 0;
+}
+
+// the word of token with its $(...) parsed, into *word, variables are
+// only looked up and globs only matched when it runs
+static ParseStatus parseExpWord(Cursor *cur, const Token *token,
+                                size_t argIdx, ExpWord *word) {
+  Arena *arena = cur->parser->arena;
+  word->argIdx = argIdx;
+  word->text = token->word;
+  word->isQuoted = token->isQuoted;
+  word->globs = token->globs;
+  word->numGlobs = token->numGlobs;
+  word->numExps = token->numSubs;
+  word->exps = arenaAlloc(arena, sizeof(Expansion) * token->numSubs);
+  for (size_t i = 0; i < token->numSubs; ++i) {
+    const WordSub *sub = &token->subs[i];
+    word->exps[i].offset = sub->offset;
+    word->exps[i].isQuoted = sub->isQuoted;
+    word->exps[i].list = NULL;
+    word->exps[i].varName = sub->isVar ? sub->text : NULL;
+    if (!sub->isVar && parseSubList(cur, sub->text, sub->len,
+                                    "command substitution",
+                                    &word->exps[i].list) == PARSE_ERROR)
+      return PARSE_ERROR;
+  }
+  return PARSE_OK;
+}
+
+// the same for a word that stands alone, such as a redirection target
+static ParseStatus parseOneExpWord(Cursor *cur, const Token *token,
+                                   ExpWord **word) {
+  if (token->numSubs == 0)
+    return PARSE_OK;
+  *word = arenaAlloc(cur->parser->arena, sizeof(ExpWord));
+  return parseExpWord(cur, token, 0, *word);
+}
+
+// NAME=value, with nothing expanded in NAME
+static int isAssignment(const Token *token) {
+  const char *eq = token->type == TOK_WORD ? strchr(token->word, '=') : NULL;
+  if (!eq || !isVarName(token->word, (size_t)(eq - token->word)))
+    return 0;
+  for (size_t i = 0; i < token->numSubs; ++i)
+    if (token->subs[i].offset <= (size_t)(eq - token->word))
+      return 0;
+  return 1;
+}
+
+// prefixes such as nice at tokens[i], before the command of cmd
+// returns the number of tokens they take, 0 if there are none, or -1
+static long parseLimits(Cursor *cur, SimpleCmd *cmd, size_t i, size_t end) {
+  const Token *tokens = cur->tokens;
+  if (tokens[i].isQuoted || tokens[i].numSubs ||
+      !isLimitPrefix(tokens[i].word))
+    return 0;
+  size_t numWords = 0;
+  while (i + numWords < end && tokens[i + numWords].type == TOK_WORD)
+    ++numWords;
+  // what the prefixes take is only known once their words are expanded
+  for (size_t w = 0; w < numWords; ++w)
+    if (tokens[i + w].numSubs) {
+      cmd->isLimitsAtRun = 1;
+      return 0;
+    }
+  char **words = arenaAlloc(cur->parser->arena, sizeof(char *) * numWords);
+  for (size_t w = 0; w < numWords; ++w)
+    words[w] = tokens[i + w].word;
+  StageLimits limits = {0};
+  limits.ioPrio = -1;
+  if (cmd->limits)
+    limits = *cmd->limits;
+  long numTaken = parseLimitPrefix(words, numWords, &limits,
+                                   cur->parser->arena, &cur->parser->errMsg);
+  if (numTaken > 0) {
+    if (!cmd->limits)
+      cmd->limits = arenaAlloc(cur->parser->arena, sizeof(StageLimits));
+    *cmd->limits = limits;
+  }
+  return numTaken;
+}
+
+// ==========
+// pipeline
+// [time [-j]] [prefix...] cmd [< file | << word | <<< word]
+//   | [prefix...] cmd | ... cmd [> file]
+// ==========
+static ParseStatus parsePipeline(Cursor *cur, Node **pNode) {
+  Node *node = newNode(cur, NODE_PIPELINE);
+  Pipeline *pipeline = &node->pipeline;
+  const Token *tokens = cur->tokens;
+  size_t first = cur->i;
+  if (isKeyword(&tokens[cur->i], "time")) {
+    pipeline->isTimed = 1;
+    ++cur->i;
+    if (cur->i < cur->numTokens && tokens[cur->i].type == TOK_WORD &&
+        strcmp(tokens[cur->i].word, "-j") == 0) {
+      pipeline->isTimeJson = 1;
+      ++cur->i;
+    }
+  }
+  // the words of all commands share one argv array, NULL-separated
+  size_t start = cur->i, end = start, numCmd = 1, numExpWords = 0;
+  size_t numAssigns = 0;
+  for (; end < cur->numTokens && !isSeparator(tokens[end].type); ++end) {
+    numCmd += tokens[end].type == TOK_PIPE;
+    numExpWords += isExpArg(&tokens[end]) ? 1 : 0;
+    numAssigns += isAssignment(&tokens[end]) ? 1 : 0;
+  }
+  // and so do the words with expansions, and the assignments
+  Arena *arena = cur->parser->arena;
+  ExpWord *expWords = arenaAlloc(arena, sizeof(ExpWord) * numExpWords);
+  ExpWord *assignWords = arenaAlloc(arena, sizeof(ExpWord) * numExpWords);
+  char **assigns = arenaAlloc(arena, sizeof(char *) * numAssigns);
+  char **words = arenaAlloc(cur->parser->arena,
+                            sizeof(char *) * (end - start + numCmd));
+  SimpleCmd *cmds = arenaAlloc(cur->parser->arena, sizeof(SimpleCmd) * numCmd);
+  memset(cmds, 0, sizeof(SimpleCmd) * numCmd);
+  SimpleCmd *cmd = cmds;
+  cmd->argv = words;
+  cmd->argWords = expWords;
+  cmd->assigns = assigns;
+  cmd->assignWords = assignWords;
+  for (size_t i = start; i < end; ++i) {
+    TokenType type = tokens[i].type;
+    // the target of a redirection is a word, or a <(...) for < and >
+    if (isRedirection(type) && tokens[i + 1].type != TOK_WORD &&
+        (!isProcSub(tokens[i + 1].type) || type == TOK_HEREDOC ||
+         type == TOK_HERESTRING))
+      return syntaxError(cur, &tokens[i + 1]);
+    if (type == TOK_IN || type == TOK_HEREDOC || type == TOK_HERESTRING) {
+      if (cmd->iFileName || cmd->hereDoc || cmd != cmds)
+        return error(cur, "error: duplicated input redirection");
+      if (type == TOK_IN) {
+        cmd->iFileName = tokens[++i].word;
+        if (isProcSub(tokens[i].type) &&
+            parseProcSub(cur, cmd, &tokens[i], PROCSUB_IN_FILE) == PARSE_ERROR)
+          return PARSE_ERROR;
+        if (parseOneExpWord(cur, &tokens[i], &cmd->iFileWord) == PARSE_ERROR)
+          return PARSE_ERROR;
+      } else if (type == TOK_HEREDOC) {
+        cmd->hereDoc = tokens[i].word;
+        cmd->lenHereDoc = tokens[i].len;
+        if (parseOneExpWord(cur, &tokens[i++], &cmd->hereDocWord) ==
+            PARSE_ERROR) // and the delimiter
+          return PARSE_ERROR;
+      } else {
+        // the word and a newline, as in bash
+        const Token *word = &tokens[++i];
+        cmd->hereDoc = arenaAlloc(cur->parser->arena, word->len + 2);
+        memcpy(cmd->hereDoc, word->word, word->len);
+        cmd->hereDoc[word->len] = '\n';
+        cmd->hereDoc[word->len + 1] = '\0';
+        cmd->lenHereDoc = word->len + 1;
+        if (parseOneExpWord(cur, word, &cmd->hereStringWord) == PARSE_ERROR)
+          return PARSE_ERROR;
+      }
+    } else if (type == TOK_OUT || type == TOK_APPEND) {
+      if (cmd->oFileName)
+        return error(cur, "error: duplicated output redirection");
+      cmd->oMode = type == TOK_APPEND ? 2 : 1;
+      cmd->oFileName = tokens[++i].word;
+      if (isProcSub(tokens[i].type) &&
+          parseProcSub(cur, cmd, &tokens[i], PROCSUB_OUT_FILE) == PARSE_ERROR)
+        return PARSE_ERROR;
+      if (parseOneExpWord(cur, &tokens[i], &cmd->oFileWord) == PARSE_ERROR)
+        return PARSE_ERROR;
+    } else if (type == TOK_PIPE) {
+      // no program before this pipe
+      if (cmd->argc == 0 && cmd->numAssigns == 0)
+        return error(cur, "error: missing program");
+      if (cmd->oFileName)
+        return error(cur, "error: duplicated output redirection");
+      *words++ = NULL;
+      expWords += cmd->numArgWords;
+      assignWords += cmd->numAssignWords;
+      assigns += cmd->numAssigns;
+      ++cmd;
+      cmd->argv = words;
+      cmd->argWords = expWords;
+      cmd->assigns = assigns;
+      cmd->assignWords = assignWords;
+    } else if (isProcSub(type)) {
+      if (parseProcSub(cur, cmd, &tokens[i], cmd->argc) == PARSE_ERROR)
+        return PARSE_ERROR;
+      *words++ = tokens[i].word; // replaced by /dev/fd/N when it runs
+      ++cmd->argc;
+    } else {
+      if (cmd->argc == 0 && !cmd->limits && !cmd->isLimitsAtRun &&
+          isAssignment(&tokens[i])) {
+        if (tokens[i].numSubs &&
+            parseExpWord(cur, &tokens[i], cmd->numAssigns,
+                         &cmd->assignWords[cmd->numAssignWords++]) ==
+                PARSE_ERROR)
+          return PARSE_ERROR;
+        cmd->assigns[cmd->numAssigns++] = tokens[i].word;
+        continue;
+      }
+      long numTaken = cmd->argc == 0 ? parseLimits(cur, cmd, i, end) : 0;
+      if (numTaken == -1)
+        return PARSE_ERROR;
+      if (numTaken > 0) {
+        i += (size_t)numTaken - 1;
+        continue;
+      }
+      if (isExpArg(&tokens[i]) &&
+          parseExpWord(cur, &tokens[i], cmd->argc,
+                       &cmd->argWords[cmd->numArgWords++]) == PARSE_ERROR)
+        return PARSE_ERROR;
+      *words++ = tokens[i].word;
+      ++cmd->argc;
+    }
+  }
+  *words = NULL;
+  if (cmd->argc == 0 && cmd->numAssigns == 0 &&
+      (cmds->iFileName || cmds->hereDoc || cmd->oFileName || cmd != cmds ||
+       !pipeline->isTimed))
+    return error(cur, "error: missing program");
+  pipeline->cmds = cmds;
+  pipeline->numCmd = cmd->argc || cmd->numAssigns ? numCmd : 0;
+  size_t textStart = tokens[first].start, textEnd = tokens[end - 1].end;
+  pipeline->line = arenaStrndup(cur->parser->arena, cur->src + textStart,
+                                textEnd - textStart);
+  // shown by jobs on one line, a pipeline may span continuation lines
+  for (char *c = pipeline->line; *c; ++c)
+    if (*c == '\n')
+      *c = ' ';
+  cur->i = end;
+  *pNode = node;
+  return PARSE_OK;
+}
+
+// ==========
+// loops
+// ==========
+static ParseStatus parseList(Cursor *cur, const char *const *endWords,
+                             Node **list);
+
+// keyword that has to come next
+static ParseStatus expect(Cursor *cur, const char *keyword) {
+  skipNewlines(cur);
+  if (cur->i == cur->numTokens)
+    return PARSE_INCOMPLETE;
+  if (!isKeyword(&cur->tokens[cur->i], keyword))
+    return syntaxError(cur, &cur->tokens[cur->i]);
+  ++cur->i;
+  return PARSE_OK;
+}
+
+// list that must not be empty, up to one of endWords
+static ParseStatus parseBody(Cursor *cur, const char *const *endWords,
+                             Node **list) {
+  ParseStatus status = parseList(cur, endWords, list);
+  if (status != PARSE_OK)
+    return status;
+  if (cur->i == cur->numTokens)
+    return PARSE_INCOMPLETE;
+  if (!*list)
+    return syntaxError(cur, &cur->tokens[cur->i]);
+  return PARSE_OK;
+}
+
+// for name [in word...]; do list; done
+static ParseStatus parseFor(Cursor *cur, Node **pNode) {
+  Node *node = newNode(cur, NODE_FOR);
+  ForLoop *forLoop = &node->forLoop;
+  const Token *tokens = cur->tokens;
+  if (++cur->i == cur->numTokens)
+    return PARSE_INCOMPLETE;
+  if (tokens[cur->i].type != TOK_WORD || tokens[cur->i].numSubs ||
+      !isVarName(tokens[cur->i].word, tokens[cur->i].len))
+    return syntaxError(cur, &tokens[cur->i]);
+  forLoop->varName = tokens[cur->i++].word;
+  skipNewlines(cur);
+  if (cur->i == cur->numTokens)
+    return PARSE_INCOMPLETE;
+  if (isKeyword(&tokens[cur->i], "in")) {
+    size_t start = ++cur->i;
+    while (cur->i < cur->numTokens && tokens[cur->i].type == TOK_WORD)
+      ++cur->i;
+    forLoop->numWords = cur->i - start;
+    forLoop->words = arenaAlloc(cur->parser->arena,
+                                sizeof(char *) * (forLoop->numWords + 1));
+    for (size_t i = 0; i < forLoop->numWords; ++i) {
+      forLoop->words[i] = tokens[start + i].word;
+      forLoop->numExpWords += isExpArg(&tokens[start + i]) ? 1 : 0;
+    }
+    forLoop->words[forLoop->numWords] = NULL;
+    forLoop->expWords =
+        arenaAlloc(cur->parser->arena, sizeof(ExpWord) * forLoop->numExpWords);
+    for (size_t i = 0, w = 0; i < forLoop->numWords; ++i)
+      if (isExpArg(&tokens[start + i]) &&
+          parseExpWord(cur, &tokens[start + i], i, &forLoop->expWords[w++]) ==
+              PARSE_ERROR)
+        return PARSE_ERROR;
+    if (cur->i == cur->numTokens)
+      return PARSE_INCOMPLETE;
+    if (tokens[cur->i].type != TOK_SEMI && tokens[cur->i].type != TOK_NEWLINE)
+      return syntaxError(cur, &tokens[cur->i]);
+    ++cur->i;
+  } else if (tokens[cur->i].type == TOK_SEMI)
+    ++cur->i;
+  ParseStatus status = expect(cur, "do");
+  if (status == PARSE_OK)
+    status = parseBody(cur, doneWords, &forLoop->body);
+  if (status == PARSE_OK)
+    status = expect(cur, "done");
+  *pNode = node;
+  return status;
+}
+
+// while list; do list; done
+static ParseStatus parseWhile(Cursor *cur, Node **pNode) {
+  Node *node = newNode(cur, NODE_WHILE);
+  ++cur->i;
+  ParseStatus status = parseBody(cur, doWords, &node->whileLoop.cond);
+  if (status == PARSE_OK)
+    status = expect(cur, "do");
+  if (status == PARSE_OK)
+    status = parseBody(cur, doneWords, &node->whileLoop.body);
+  if (status == PARSE_OK)
+    status = expect(cur, "done");
+  *pNode = node;
+  return status;
+}
+
+// ==========
+// list
+// commands separated by ';', '&' or newlines, up to one of endWords
+// ==========
+static ParseStatus parseList(Cursor *cur, const char *const *endWords,
+                             Node **list) {
+  Node **tail = list;
+  *list = NULL;
+  while (1) {
+    skipNewlines(cur);
+    if (cur->i == cur->numTokens)
+      return PARSE_OK;
+    const Token *token = &cur->tokens[cur->i];
+    if (isOneOf(token, endWords))
+      return PARSE_OK;
+    if ((token->type != TOK_WORD && !isRedirection(token->type)) ||
+        isOneOf(token, reservedWords))
+      return syntaxError(cur, token);
+    Node *node = NULL;
+    ParseStatus status;
+    if (isKeyword(token, "for"))
+      status = parseFor(cur, &node);
+    else if (isKeyword(token, "while"))
+      status = parseWhile(cur, &node);
+    else
+      status = parsePipeline(cur, &node);
+    if (status != PARSE_OK)
+      return status;
+    *tail = node;
+    tail = &node->next;
+    if (cur->i == cur->numTokens)
+      return PARSE_OK;
+    token = &cur->tokens[cur->i];
+    if (token->type == TOK_BG && node->type == NODE_PIPELINE)
+      node->pipeline.isBg = 1;
+    else if (token->type != TOK_SEMI && token->type != TOK_NEWLINE)
+      return syntaxError(cur, token);
+    ++cur->i;
+  }
+}
+
+// ==========
+// api
+// ==========
+void parserReset(Parser *parser, Arena *arena) {
+  parser->arena = arena;
+  parser->numScanned = 0;
+  parser->depth = 0;
+  parser->isCmdStart = 1;
+  parser->isRdrctTarget = 0;
+  parser->errMsg = NULL;
+}
+
+// track open loops over the new tokens only, so that a long loop body does
+// not get parsed again for each of its lines
+static void scanTokens(Parser *parser, const Token *tokens, size_t numTokens) {
+  for (; parser->numScanned < numTokens; ++parser->numScanned) {
+    const Token *token = &tokens[parser->numScanned];
+    if (parser->isRdrctTarget) {
+      parser->isRdrctTarget = 0;
+      continue;
+    }
+    if (token->type == TOK_WORD) {
+      int isCmdWord = parser->isCmdStart && !token->isQuoted && !token->numSubs;
+      parser->isCmdStart = 0;
+      if (!isCmdWord)
+        continue;
+      // a while condition and a loop body start with a command
+      if (strcmp(token->word, "for") == 0)
+        ++parser->depth;
+      else if (strcmp(token->word, "while") == 0) {
+        ++parser->depth;
+        parser->isCmdStart = 1;
+      } else if (strcmp(token->word, "do") == 0)
+        parser->isCmdStart = 1;
+      else if (strcmp(token->word, "done") == 0)
+        --parser->depth;
+    } else {
+      parser->isRdrctTarget = isRedirection(token->type);
+      parser->isCmdStart = isSeparator(token->type);
+    }
+  }
+}
+
+ParseStatus parseTokens(Parser *parser, const Token *tokens, size_t numTokens,
+                        const char *src, Node **list) {
+  scanTokens(parser, tokens, numTokens);
+  if (parser->depth > 0)
+    return PARSE_INCOMPLETE;
+  Cursor cur = {parser, tokens, numTokens, 0, src};
+  return parseList(&cur, NULL, list);
+}
+
+// ==========
+// copy
+// ==========
+static char *copyStr(const char *str, Arena *arena) {
+  return str ? arenaStrndup(arena, str, strlen(str)) : NULL;
+}
+
+static char **copyWords(char *const *words, size_t numWords, Arena *arena) {
+  char **copy = arenaAlloc(arena, sizeof(char *) * (numWords + 1));
+  for (size_t i = 0; i < numWords; ++i)
+    copy[i] = copyStr(words[i], arena);
+  copy[numWords] = NULL;
+  return copy;
+}
+
+static ExpWord *copyExpWords(const ExpWord *words, size_t numWords,
+                             Arena *arena) {
+  if (!words)
+    return NULL;
+  ExpWord *copy = arenaAlloc(arena, sizeof(ExpWord) * numWords);
+  for (size_t i = 0; i < numWords; ++i) {
+    copy[i] = words[i];
+    copy[i].text = copyStr(words[i].text, arena);
+    copy[i].globs = arenaAlloc(arena, sizeof(size_t) * words[i].numGlobs);
+    if (words[i].numGlobs > 0)
+      memcpy(copy[i].globs, words[i].globs, sizeof(size_t) * words[i].numGlobs);
+    copy[i].exps = arenaAlloc(arena, sizeof(Expansion) * words[i].numExps);
+    for (size_t j = 0; j < words[i].numExps; ++j) {
+      copy[i].exps[j] = words[i].exps[j];
+      copy[i].exps[j].list = copyNodes(words[i].exps[j].list, arena);
+      copy[i].exps[j].varName = copyStr(words[i].exps[j].varName, arena);
+    }
+  }
+  return copy;
+}
+
+Node *copyNodes(const Node *list, Arena *arena) {
+  Node *head = NULL, **tail = &head;
+  for (; list; list = list->next) {
+    Node *node = arenaAlloc(arena, sizeof(Node));
+    *node = *list;
+    node->next = NULL;
+    if (node->type == NODE_PIPELINE) {
+      Pipeline *pipeline = &node->pipeline;
+      size_t numCmd = pipeline->numCmd ? pipeline->numCmd : 1;
+      pipeline->cmds = arenaAlloc(arena, sizeof(SimpleCmd) * numCmd);
+      for (size_t i = 0; i < numCmd; ++i) {
+        SimpleCmd *cmd = &pipeline->cmds[i];
+        *cmd = list->pipeline.cmds[i];
+        cmd->argv = copyWords(cmd->argv, cmd->argc, arena);
+        cmd->assigns = copyWords(cmd->assigns, cmd->numAssigns, arena);
+        cmd->assignWords =
+            copyExpWords(cmd->assignWords, cmd->numAssignWords, arena);
+        cmd->iFileName = copyStr(cmd->iFileName, arena);
+        if (cmd->hereDoc)
+          cmd->hereDoc = arenaStrndup(arena, cmd->hereDoc, cmd->lenHereDoc);
+        cmd->oFileName = copyStr(cmd->oFileName, arena);
+        cmd->limits = copyLimits(cmd->limits, arena);
+        cmd->procSubs = arenaAlloc(arena, sizeof(ProcSub) * cmd->numProcSubs);
+        for (size_t j = 0; j < cmd->numProcSubs; ++j) {
+          cmd->procSubs[j] = list->pipeline.cmds[i].procSubs[j];
+          cmd->procSubs[j].list = copyNodes(cmd->procSubs[j].list, arena);
+        }
+        cmd->argWords = copyExpWords(cmd->argWords, cmd->numArgWords, arena);
+        cmd->iFileWord = copyExpWords(cmd->iFileWord, 1, arena);
+        cmd->oFileWord = copyExpWords(cmd->oFileWord, 1, arena);
+        cmd->hereStringWord = copyExpWords(cmd->hereStringWord, 1, arena);
+        cmd->hereDocWord = copyExpWords(cmd->hereDocWord, 1, arena);
+      }
+      pipeline->line = copyStr(pipeline->line, arena);
+    } else if (node->type == NODE_FOR) {
+      ForLoop *forLoop = &node->forLoop;
+      forLoop->varName = copyStr(forLoop->varName, arena);
+      forLoop->words = copyWords(forLoop->words, forLoop->numWords, arena);
+      forLoop->expWords =
+          copyExpWords(forLoop->expWords, forLoop->numExpWords, arena);
+      forLoop->body = copyNodes(forLoop->body, arena);
+    } else {
+      node->whileLoop.cond = copyNodes(node->whileLoop.cond, arena);
+      node->whileLoop.body = copyNodes(node->whileLoop.body, arena);
+    }
+    *tail = node;
+    tail = &node->next;
+  }
+  return head;
+}
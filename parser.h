@@ -0,0 +1,130 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "lexer.h"
+#include "stagelimit.h"
+
+// tokens of a command line turned into a tree that the executor walks and
+// never modifies, so that loop bodies and cached lines run many times from
+// a single parse
+
+typedef struct Node Node;
+
+// <(list) or >(list), runs next to the command, which gets /dev/fd/N for it
+#define PROCSUB_IN_FILE ((size_t)-1)  // < <(list)
+#define PROCSUB_OUT_FILE ((size_t)-2) // > >(list)
+typedef struct {
+  size_t argIdx; // the argument it stands for, or one of the above
+  int isOut;     // >(list), the command writes to it
+  Node *list;
+} ProcSub;
+
+// $(list) or `list`, replaced by the output of list without its trailing
+// newlines, or a variable, replaced by its value
+typedef struct {
+  size_t offset; // in the text of the word, where the value goes
+  int isQuoted;  // inside "", the value is not split into fields
+  Node *list;
+  char *varName; // $NAME, ${NAME}, $? or $$, NULL for a list
+} Expansion;
+
+// a word that is only known when it runs
+typedef struct {
+  size_t argIdx; // the argument it is, for words of an argv
+  char *text;    // what is around the expansions
+  int isQuoted;  // had quotes, so it is a field even if it comes out empty
+  Expansion *exps;
+  size_t numExps;
+  size_t *globs; // offsets of the unquoted '*', '?', '[' and ']' in text
+  size_t numGlobs;
+} ExpWord;
+
+typedef struct {
+  char **assigns;    // NAME=value words in front of the command
+  size_t numAssigns;
+  ExpWord *assignWords; // assignments with expansions, by argIdx
+  size_t numAssignWords;
+  char **argv;       // NULL-terminated
+  size_t argc;
+  char *iFileName;   // < file, first command of a pipeline only
+  char *hereDoc;     // body of << or <<<, in place of iFileName
+  size_t lenHereDoc;
+  char *oFileName;   // > file or >> file, last command of a pipeline only
+  int oMode;         // 1 for '>', 2 for '>>'
+  StageLimits *limits; // from prefixes such as nice, NULL for none
+  int isLimitsAtRun;    // prefixes with expansions, still in argv
+  ProcSub *procSubs;
+  size_t numProcSubs;
+  ExpWord *argWords; // arguments with expansions or globs, by argIdx
+  size_t numArgWords;
+  ExpWord *iFileWord, *oFileWord, *hereStringWord; // NULL if known already
+  ExpWord *hereDocWord; // body of << with expansions, NULL if there are none
+} SimpleCmd;
+
+typedef struct {
+  SimpleCmd *cmds;
+  size_t numCmd; // 0 only for a bare time
+  int isBg;
+  int isTimed, isTimeJson; // time prefix, isTimeJson: time -j
+  char *line;              // source text, shown by jobs
+} Pipeline;
+
+typedef enum { NODE_PIPELINE, NODE_FOR, NODE_WHILE } NodeType;
+
+typedef struct {
+  char *varName;
+  char **words;
+  size_t numWords;
+  ExpWord *expWords; // by argIdx, the index in words, also for globs
+  size_t numExpWords;
+  Node *body;
+} ForLoop;
+
+typedef struct {
+  Node *cond;
+  Node *body;
+} WhileLoop;
+
+// one command of a list, commands are run one after another
+struct Node {
+  NodeType type;
+  Node *next;
+  union {
+    Pipeline pipeline;
+    ForLoop forLoop;
+    WhileLoop whileLoop;
+  };
+};
+
+typedef enum {
+  PARSE_OK,
+  PARSE_INCOMPLETE, // a loop is still open, feed the next line
+  PARSE_ERROR       // see errMsg
+} ParseStatus;
+
+// the parse itself only runs once the loops are closed, before that every
+// call only scans the tokens that are new since the last one
+typedef struct {
+  Arena *arena;
+  size_t numScanned;
+  int depth;      // open for/while loops
+  int isCmdStart; // the next word is in command position
+  int isRdrctTarget;
+  const char *errMsg;
+} Parser;
+
+// start a new command line, nodes are allocated from arena
+void parserReset(Parser *parser, Arena *arena);
+
+// parse tokens[0, numTokens), the whole command line so far
+// src holds the text the token offsets refer to
+ParseStatus parseTokens(Parser *parser, const Token *tokens, size_t numTokens,
+                        const char *src, Node **list);
+
+// deep copy of a list into arena, e.g. to keep it beyond the command line
+Node *copyNodes(const Node *list, Arena *arena);
+
+#endif
@@ -0,0 +1,234 @@
+#include "pathcache.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vars.h"
+
+#define PATHCACHE_INIT_CAP 64
+
+typedef struct {
+  char *name; // NULL for an empty slot
+  char *path;
+  struct timespec dirMtime; // mtime of the PATH directory holding path
+  size_t lenDir;            // path[0, lenDir) is that directory
+  unsigned hits;
+} PathEntry;
+
+// open addressing with linear probing, capacity is a power of 2
+static PathEntry *pathTable;
+static size_t pathCap, pathCount;
+static char *pathEnv;            // PATH the entries were resolved against
+static char pathBuf[PATH_MAX];   // result for names that are not cached
+
+static size_t hashName(const char *name) {
+  uint64_t h = 14695981039346656037ULL; // FNV-1a
+  for (; *name; ++name) {
+    h ^= (unsigned char)*name;
+    h *= 1099511628211ULL;
+  }
+  return (size_t)h;
+}
+
+static PathEntry *findSlot(PathEntry *table, size_t cap, const char *name) {
+  size_t i = hashName(name) & (cap - 1);
+  while (table[i].name && strcmp(table[i].name, name) != 0)
+    i = (i + 1) & (cap - 1);
+  return &table[i];
+}
+
+static void freeEntry(PathEntry *entry) {
+  free(entry->name);
+  free(entry->path);
+  memset(entry, 0, sizeof(PathEntry));
+}
+
+void clearPathCache(void) {
+  for (size_t i = 0; i < pathCap; ++i)
+    freeEntry(&pathTable[i]);
+  free(pathTable);
+  free(pathEnv);
+  pathTable = NULL;
+  pathEnv = NULL;
+  pathCap = 0;
+  pathCount = 0;
+}
+
+static void growTable(void) {
+  size_t newCap = pathCap ? 2 * pathCap : PATHCACHE_INIT_CAP;
+  PathEntry *newTable = calloc(newCap, sizeof(PathEntry));
+  for (size_t i = 0; i < pathCap; ++i) {
+    if (pathTable[i].name)
+      *findSlot(newTable, newCap, pathTable[i].name) = pathTable[i];
+  }
+  free(pathTable);
+  pathTable = newTable;
+  pathCap = newCap;
+}
+
+static void removeEntry(PathEntry *entry) {
+  // backward shift deletion keeps probe sequences intact without tombstones
+  size_t i = (size_t)(entry - pathTable);
+  freeEntry(entry);
+  --pathCount;
+  for (size_t j = (i + 1) & (pathCap - 1); pathTable[j].name;
+       j = (j + 1) & (pathCap - 1)) {
+    size_t home = hashName(pathTable[j].name) & (pathCap - 1);
+    // an entry whose home slot lies cyclically in (i, j] can stay
+    int canStay = i < j ? (i < home && home <= j) : (i < home || home <= j);
+    if (!canStay) {
+      pathTable[i] = pathTable[j];
+      memset(&pathTable[j], 0, sizeof(PathEntry));
+      i = j;
+    }
+  }
+}
+
+// drop everything if PATH has changed since the entries were resolved
+static void checkPathEnv(void) {
+  const char *env = getVar("PATH");
+  if (!env)
+    env = "";
+  if (pathEnv && strcmp(pathEnv, env) == 0)
+    return;
+  clearPathCache();
+  pathEnv = strdup(env);
+}
+
+static int isExecutable(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+         access(path, X_OK) == 0;
+}
+
+// walk PATH, same search order as execvp()
+static PathEntry *resolve(const char *cmdName) {
+  size_t lenName = strlen(cmdName);
+  for (const char *dir = pathEnv; dir;) {
+    const char *dirEnd = strchr(dir, ':');
+    size_t lenDir = dirEnd ? (size_t)(dirEnd - dir) : strlen(dir);
+    const char *nextDir = dirEnd ? dirEnd + 1 : NULL;
+    // empty entry means the current directory
+    const char *dirName = lenDir ? dir : ".";
+    size_t lenDirName = lenDir ? lenDir : 1;
+    if (lenDirName + 1 + lenName + 1 > PATH_MAX) {
+      dir = nextDir;
+      continue;
+    }
+    memcpy(pathBuf, dirName, lenDirName);
+    pathBuf[lenDirName] = '/';
+    memcpy(pathBuf + lenDirName + 1, cmdName, lenName + 1);
+    if (!isExecutable(pathBuf)) {
+      dir = nextDir;
+      continue;
+    }
+    // relative directories depend on the cwd, never cache them
+    if (dirName[0] != '/')
+      return NULL;
+    struct stat st;
+    pathBuf[lenDirName] = '\0';
+    if (stat(pathBuf, &st) == -1)
+      return NULL;
+    pathBuf[lenDirName] = '/';
+    if (2 * (pathCount + 1) > pathCap)
+      growTable();
+    PathEntry *entry = findSlot(pathTable, pathCap, cmdName);
+    entry->name = strdup(cmdName);
+    entry->path = strdup(pathBuf);
+    entry->dirMtime = st.st_mtim;
+    entry->lenDir = lenDirName;
+    entry->hits = 0;
+    ++pathCount;
+    return entry;
+  }
+  pathBuf[0] = '\0';
+  return NULL;
+}
+
+// a directory whose mtime moved may have lost or replaced the command
+static int isStale(PathEntry *entry) {
+  struct stat st;
+  entry->path[entry->lenDir] = '\0';
+  int err = stat(entry->path, &st);
+  entry->path[entry->lenDir] = '/';
+  return err == -1 || st.st_mtim.tv_sec != entry->dirMtime.tv_sec ||
+         st.st_mtim.tv_nsec != entry->dirMtime.tv_nsec;
+}
+
+const char *lookupCmdPath(const char *cmdName) {
+  if (strchr(cmdName, '/'))
+    return cmdName;
+  checkPathEnv();
+  if (pathCap) {
+    PathEntry *entry = findSlot(pathTable, pathCap, cmdName);
+    if (entry->name) {
+      if (!isStale(entry)) {
+        ++entry->hits;
+        return entry->path;
+      }
+      removeEntry(entry);
+    }
+  }
+  PathEntry *entry = resolve(cmdName);
+  if (entry) {
+    ++entry->hits;
+    return entry->path;
+  }
+  return pathBuf[0] ? pathBuf : NULL;
+}
+
+void forgetCmdPath(const char *cmdName) {
+  if (!pathCap)
+    return;
+  PathEntry *entry = findSlot(pathTable, pathCap, cmdName);
+  if (entry->name)
+    removeEntry(entry);
+}
+
+int hashBuiltin(char **cmdArgv) {
+  checkPathEnv();
+  if (!cmdArgv[1]) {
+    if (pathCount == 0) {
+      printf("hash: hash table empty\n");
+      return 0;
+    }
+    printf("hits\tcommand\n");
+    for (size_t i = 0; i < pathCap; ++i) {
+      if (pathTable[i].name)
+        printf("%4u\t%s\n", pathTable[i].hits, pathTable[i].path);
+    }
+    return 0;
+  }
+  if (strcmp(cmdArgv[1], "-r") == 0) {
+    clearPathCache();
+    return 0;
+  }
+  int status = 0;
+  if (strcmp(cmdArgv[1], "-d") == 0) {
+    for (size_t i = 2; cmdArgv[i]; ++i) {
+      if (!pathCap || !findSlot(pathTable, pathCap, cmdArgv[i])->name) {
+        printf("hash: %s: not found\n", cmdArgv[i]);
+        status = 1;
+      } else
+        forgetCmdPath(cmdArgv[i]);
+    }
+    return status;
+  }
+  // hash name...: resolve now without counting a hit
+  for (size_t i = 1; cmdArgv[i]; ++i) {
+    if (strchr(cmdArgv[i], '/'))
+      continue;
+    if (pathCap && findSlot(pathTable, pathCap, cmdArgv[i])->name)
+      forgetCmdPath(cmdArgv[i]);
+    if (!resolve(cmdArgv[i]) && !pathBuf[0]) {
+      printf("hash: %s: not found\n", cmdArgv[i]);
+      status = 1;
+    }
+  }
+  return status;
+}
@@ -0,0 +1,20 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+// resolved command paths, kept in the shell process so that children can
+// execve() directly instead of walking PATH on every command
+
+// returns the path to execute for cmdName, or NULL if it is not in PATH
+// names containing '/' are returned as they are
+// the result stays valid until the next call into the cache
+const char *lookupCmdPath(const char *cmdName);
+
+// drop one entry, e.g. after exec reported ENOENT for it
+void forgetCmdPath(const char *cmdName);
+
+// the hash builtin: hash, hash -r, hash -d name..., hash name...
+int hashBuiltin(char **cmdArgv);
+
+void clearPathCache(void);
+
+#endif
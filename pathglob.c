@@ -0,0 +1,551 @@
+#include "pathglob.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GLOBDIR_MAX 64                 // directories kept between globs
+#define DENTS_BUF_SIZE (256 * 1024)    // bytes asked of each getdents64()
+#define RACY_NSEC (20 * 1000 * 1000LL) // mtime tick, at least a jiffy
+
+// what getdents64() fills in, one after another
+typedef struct {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+} LinuxDirent64;
+
+typedef struct {
+  const char *name;
+  unsigned char type; // d_type, DT_UNKNOWN is replaced once lstat() ran
+} GlobEntry;
+
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime;
+  // modified less than a tick before it was read, a change right after
+  // the read may have left the mtime as it was, so it is read again
+  int isRacy;
+  char *nameBuf;      // all names, each '\0'-terminated
+  GlobEntry *entries; // in the order of the directory, without . and ..
+  size_t numEntries;
+  unsigned long lastUse;
+  int numUsers; // globs walking its entries, it is not dropped or reread
+} GlobDir;
+
+static GlobDir **dirArr;
+static size_t numDirs, capDirs;
+static unsigned long useClock;
+static char *dentsBuf;
+static char **pathArr; // the result of globPaths()
+static size_t numPaths, capPaths;
+
+// one call of globPaths()
+typedef struct {
+  Arena *arena;
+  char **comps; // the pattern split at '/', still escaped
+  size_t numComps;
+  char *path; // directory being walked, "" or ending in '/'
+  size_t lenPath, capPath;
+} Glob;
+
+static void *growArray(void *arr, size_t *cap, size_t need, size_t size) {
+  if (need <= *cap)
+    return arr;
+  size_t newCap = *cap ? *cap : 64;
+  while (newCap < need)
+    newCap *= 2;
+  if (!(arr = realloc(arr, newCap * size))) {
+    perror("");
+    exit(0);
+  }
+  *cap = newCap;
+  return arr;
+}
+
+// ==========
+// matching
+// ==========
+// pat is just after a '[', returns its ']', or NULL if there is none and
+// the '[' is an ordinary character
+static const char *bracketEnd(const char *pat) {
+  const char *p = pat;
+  if (*p == '!' || *p == '^')
+    ++p;
+  if (*p == ']')
+    ++p;
+  for (; *p && *p != ']'; ++p) {
+    if (*p == '\\' && p[1])
+      ++p;
+    else if (*p == '[' && p[1] == ':') {
+      const char *end = strstr(p + 2, ":]");
+      if (end)
+        p = end + 1;
+    }
+  }
+  return *p == ']' ? p : NULL;
+}
+
+static int isInClass(const char *name, size_t len, unsigned char c) {
+  static const char *const names[] = {"alnum", "alpha", "blank", "cntrl",
+                                      "digit", "graph", "lower", "print",
+                                      "punct", "space", "upper", "xdigit"};
+  static int (*const funcs[])(int) = {isalnum, isalpha, isblank, iscntrl,
+                                      isdigit, isgraph, islower, isprint,
+                                      ispunct, isspace, isupper, isxdigit};
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    if (strlen(names[i]) == len && memcmp(names[i], name, len) == 0)
+      return funcs[i](c) != 0;
+  return 0;
+}
+
+// c is in the bracket expression pat[0, end)
+static int isInBracket(const char *pat, const char *end, unsigned char c) {
+  int isNeg = *pat == '!' || *pat == '^', isIn = 0;
+  const char *p = pat + isNeg;
+  while (p < end) {
+    if (p[0] == '[' && p[1] == ':') {
+      const char *classEnd = strstr(p + 2, ":]");
+      if (classEnd && classEnd < end) {
+        isIn |= isInClass(p + 2, (size_t)(classEnd - p - 2), c);
+        p = classEnd + 2;
+        continue;
+      }
+    }
+    if (*p == '\\' && p + 1 < end)
+      ++p;
+    unsigned char low = (unsigned char)*p++, high = low;
+    if (p + 1 < end && *p == '-') {
+      ++p;
+      if (*p == '\\' && p + 1 < end)
+        ++p;
+      high = (unsigned char)*p++;
+    }
+    if (low <= c && c <= high)
+      isIn = 1;
+  }
+  return isIn != isNeg;
+}
+
+// the pattern after its first element, if that matches c, otherwise NULL
+static const char *matchChar(const char *pat, char c) {
+  if (*pat == '\0')
+    return NULL;
+  if (*pat == '?')
+    return pat + 1;
+  if (*pat == '[') {
+    const char *end = bracketEnd(pat + 1);
+    if (end)
+      return isInBracket(pat + 1, end, (unsigned char)c) ? end + 1 : NULL;
+  } else if (*pat == '\\' && pat[1])
+    ++pat;
+  return *pat == c ? pat + 1 : NULL;
+}
+
+// number of characters pat matches, or -1 if it has a '*'
+static long fixedLength(const char *pat) {
+  long len = 0;
+  for (; *pat; ++pat, ++len) {
+    const char *end = *pat == '[' ? bracketEnd(pat + 1) : NULL;
+    if (*pat == '*')
+      return -1;
+    if (end)
+      pat = end;
+    else if (*pat == '\\' && pat[1])
+      ++pat;
+  }
+  return len;
+}
+
+// a '*' takes as little as it can, and one more character each time what
+// follows it fails, only the last '*' is ever backtracked to; the last '*'
+// of the pattern takes all but what the rest needs at once
+static int matchName(const char *pat, const char *name) {
+  const char *starPat = NULL, *starName = NULL;
+  while (*name) {
+    if (*pat == '*') {
+      while (*pat == '*')
+        ++pat;
+      long lenTail = fixedLength(pat);
+      if (lenTail >= 0) {
+        size_t lenName = strlen(name);
+        if (lenName < (size_t)lenTail)
+          return 0;
+        name += lenName - (size_t)lenTail;
+        starPat = NULL;
+        continue;
+      }
+      starPat = pat;
+      starName = name;
+      continue;
+    }
+    const char *next = matchChar(pat, *name);
+    if (next) {
+      pat = next;
+      ++name;
+    } else if (starPat) {
+      pat = starPat;
+      name = ++starName;
+    } else
+      return 0;
+  }
+  while (*pat == '*')
+    ++pat;
+  return *pat == '\0';
+}
+
+// the literal characters that a component pattern starts and ends with,
+// compared before matchName() runs, which most names of a large directory
+// never get to
+typedef struct {
+  const char *pat;
+  size_t lenPrefix;
+  const char *suffix;
+  size_t lenSuffix;
+} CompPattern;
+
+static CompPattern compilePattern(const char *pat) {
+  CompPattern comp = {pat, strcspn(pat, "*?[\\"), NULL, 0};
+  size_t len = strlen(pat), start = len;
+  while (start > comp.lenPrefix && !strchr("*?[]\\", pat[start - 1]))
+    --start;
+  comp.suffix = pat + start;
+  comp.lenSuffix = len - start;
+  return comp;
+}
+
+static int matchComp(const CompPattern *comp, const char *name) {
+  if (strncmp(name, comp->pat, comp->lenPrefix) != 0)
+    return 0;
+  if (comp->lenSuffix > 0) {
+    size_t lenName = strlen(name);
+    if (lenName < comp->lenSuffix ||
+        memcmp(name + lenName - comp->lenSuffix, comp->suffix,
+               comp->lenSuffix) != 0)
+      return 0;
+  }
+  return matchName(comp->pat, name);
+}
+
+int isGlobPattern(const char *pattern) {
+  for (const char *p = pattern; *p; ++p) {
+    if (*p == '\\' && p[1])
+      ++p;
+    else if (*p == '*' || *p == '?' || (*p == '[' && bracketEnd(p + 1)))
+      return 1;
+  }
+  return 0;
+}
+
+// ==========
+// directory cache
+// ==========
+static void forgetDir(GlobDir *dir) {
+  free(dir->nameBuf);
+  free(dir->entries);
+  dir->nameBuf = NULL;
+  dir->entries = NULL;
+  dir->numEntries = 0;
+}
+
+void clearGlobCache(void) {
+  for (size_t i = 0; i < numDirs; ++i) {
+    forgetDir(dirArr[i]);
+    free(dirArr[i]);
+  }
+  free(dirArr);
+  free(dentsBuf);
+  free(pathArr);
+  dirArr = NULL;
+  dentsBuf = NULL;
+  pathArr = NULL;
+  numDirs = 0;
+  capDirs = 0;
+  numPaths = 0;
+  capPaths = 0;
+}
+
+static void readEntries(GlobDir *dir, int dirFd) {
+  if (!dentsBuf && !(dentsBuf = malloc(DENTS_BUF_SIZE))) {
+    perror("");
+    exit(0);
+  }
+  // offsets while nameBuf may still move
+  size_t *offsets = NULL, capOffsets = 0, capEntries = 0, lenBuf = 0,
+         capBuf = 0;
+  long lenRead;
+  while ((lenRead = syscall(SYS_getdents64, dirFd, dentsBuf,
+                            DENTS_BUF_SIZE)) > 0) {
+    for (long pos = 0; pos < lenRead;) {
+      const LinuxDirent64 *dent = (const LinuxDirent64 *)(dentsBuf + pos);
+      pos += dent->d_reclen;
+      const char *name = dent->d_name;
+      if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+        continue;
+      size_t lenName = strlen(name) + 1;
+      dir->nameBuf = growArray(dir->nameBuf, &capBuf, lenBuf + lenName, 1);
+      memcpy(dir->nameBuf + lenBuf, name, lenName);
+      offsets = growArray(offsets, &capOffsets, dir->numEntries + 1,
+                          sizeof(size_t));
+      dir->entries = growArray(dir->entries, &capEntries,
+                               dir->numEntries + 1, sizeof(GlobEntry));
+      offsets[dir->numEntries] = lenBuf;
+      dir->entries[dir->numEntries++] = (GlobEntry){NULL, dent->d_type};
+      lenBuf += lenName;
+    }
+  }
+  for (size_t i = 0; i < dir->numEntries; ++i)
+    dir->entries[i].name = dir->nameBuf + offsets[i];
+  free(offsets);
+}
+
+// the directory that is kept the longest without being used, NULL if
+// every one is in use
+static GlobDir *leastRecentDir(void) {
+  GlobDir *lru = NULL;
+  for (size_t i = 0; i < numDirs; ++i)
+    if (dirArr[i]->numUsers == 0 &&
+        (!lru || dirArr[i]->lastUse < lru->lastUse))
+      lru = dirArr[i];
+  return lru;
+}
+
+// the entries of the directory at path, read only if it has changed, NULL
+// if it cannot be read
+// the directory stays as it is until closeDir()
+static GlobDir *openDir(const char *path) {
+  struct stat st;
+  if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode))
+    return NULL;
+  GlobDir *dir = NULL;
+  for (size_t i = 0; i < numDirs && !dir; ++i)
+    if (dirArr[i]->ino == st.st_ino && dirArr[i]->dev == st.st_dev)
+      dir = dirArr[i];
+  // a glob that is in it already sees one state of it, e.g. through a
+  // symlink to a parent
+  if (dir && (dir->numUsers > 0 ||
+              (!dir->isRacy && st.st_mtim.tv_sec == dir->mtime.tv_sec &&
+               st.st_mtim.tv_nsec == dir->mtime.tv_nsec))) {
+    dir->lastUse = ++useClock;
+    ++dir->numUsers;
+    return dir;
+  }
+  int dirFd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  // what is read is what was opened, path may have changed since stat()
+  if (dirFd == -1 || fstat(dirFd, &st) == -1) {
+    if (dirFd != -1)
+      close(dirFd);
+    return NULL;
+  }
+  if (!dir && numDirs >= GLOBDIR_MAX)
+    dir = leastRecentDir();
+  if (dir)
+    forgetDir(dir);
+  else {
+    dirArr = growArray(dirArr, &capDirs, numDirs + 1, sizeof(GlobDir *));
+    if (!(dir = calloc(1, sizeof(GlobDir)))) {
+      perror("");
+      exit(0);
+    }
+    dirArr[numDirs++] = dir;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  dir->dev = st.st_dev;
+  dir->ino = st.st_ino;
+  dir->mtime = st.st_mtim;
+  dir->isRacy = (long long)(now.tv_sec - st.st_mtim.tv_sec) * 1000000000LL +
+                    (now.tv_nsec - st.st_mtim.tv_nsec) <
+                RACY_NSEC;
+  readEntries(dir, dirFd);
+  close(dirFd);
+  dir->lastUse = ++useClock;
+  dir->numUsers = 1;
+  return dir;
+}
+
+static void closeDir(GlobDir *dir) { --dir->numUsers; }
+
+// ==========
+// walking the pattern
+// ==========
+static void appendPath(Glob *glob, const char *str, size_t len) {
+  glob->path = growArray(glob->path, &glob->capPath, glob->lenPath + len + 1,
+                         1);
+  memcpy(glob->path + glob->lenPath, str, len);
+  glob->lenPath += len;
+  glob->path[glob->lenPath] = '\0';
+}
+
+// path followed by name is a match
+static void addPath(Glob *glob, const char *name) {
+  size_t lenName = strlen(name);
+  char *path = arenaAlloc(glob->arena, glob->lenPath + lenName + 1);
+  memcpy(path, glob->path, glob->lenPath);
+  memcpy(path + glob->lenPath, name, lenName + 1);
+  pathArr = growArray(pathArr, &capPaths, numPaths + 1, sizeof(char *));
+  pathArr[numPaths++] = path;
+}
+
+// type of the entry itself, lstat() only if the file system left it out
+static unsigned char entryType(Glob *glob, GlobEntry *entry) {
+  if (entry->type != DT_UNKNOWN)
+    return entry->type;
+  size_t lenPath = glob->lenPath;
+  appendPath(glob, entry->name, strlen(entry->name));
+  struct stat st;
+  if (lstat(glob->path, &st) == 0)
+    entry->type = S_ISDIR(st.st_mode)   ? DT_DIR
+                  : S_ISLNK(st.st_mode) ? DT_LNK
+                                        : DT_REG;
+  glob->lenPath = lenPath;
+  glob->path[lenPath] = '\0';
+  return entry->type;
+}
+
+// the entry is a directory or a symlink to one, the target of a symlink
+// may change without its directory changing, so that is not kept
+static int isDirEntry(Glob *glob, GlobEntry *entry) {
+  unsigned char type = entryType(glob, entry);
+  if (type != DT_LNK)
+    return type == DT_DIR;
+  size_t lenPath = glob->lenPath;
+  appendPath(glob, entry->name, strlen(entry->name));
+  struct stat st;
+  int isDir = stat(glob->path, &st) == 0 && S_ISDIR(st.st_mode);
+  glob->lenPath = lenPath;
+  glob->path[lenPath] = '\0';
+  return isDir;
+}
+
+// a leading '.' has to be matched by a '.' in the pattern
+static int isHiddenFor(const char *name, const char *pat) {
+  return name[0] == '.' && pat[0] != '.' && (pat[0] != '\\' || pat[1] != '.');
+}
+
+static void walk(Glob *glob, size_t iComp);
+
+// '**' at comps[iComp], no directory or any number of them, symlinks to
+// directories are not followed
+static void walkAnyDirs(Glob *glob, size_t iComp) {
+  int isLast = iComp + 1 == glob->numComps;
+  if (!isLast)
+    walk(glob, iComp + 1);
+  GlobDir *dir = openDir(glob->lenPath ? glob->path : ".");
+  if (!dir)
+    return;
+  size_t lenPath = glob->lenPath;
+  for (size_t i = 0; i < dir->numEntries; ++i) {
+    GlobEntry *entry = &dir->entries[i];
+    if (entry->name[0] == '.')
+      continue;
+    // as the last part of the pattern, everything below
+    if (isLast)
+      addPath(glob, entry->name);
+    if (entryType(glob, entry) != DT_DIR)
+      continue;
+    appendPath(glob, entry->name, strlen(entry->name));
+    appendPath(glob, "/", 1);
+    walkAnyDirs(glob, iComp);
+    glob->lenPath = lenPath;
+    glob->path[lenPath] = '\0';
+  }
+  closeDir(dir);
+}
+
+// match comps[iComp, numComps) below path
+static void walk(Glob *glob, size_t iComp) {
+  const char *comp = glob->comps[iComp];
+  int isLast = iComp + 1 == glob->numComps;
+  size_t lenPath = glob->lenPath;
+  if (comp[0] == '\0') {
+    // "/" in front, "//" in the middle or "/" at the end, the last one
+    // only lets directories through, and they all end in '/' already
+    if (isLast && lenPath > 0)
+      addPath(glob, "");
+    else {
+      if (iComp == 0)
+        appendPath(glob, "/", 1);
+      walk(glob, iComp + 1);
+    }
+  } else if (strcmp(comp, "**") == 0)
+    walkAnyDirs(glob, iComp);
+  else if (!isGlobPattern(comp)) {
+    for (const char *c = comp; *c; ++c) {
+      if (*c == '\\' && c[1])
+        ++c;
+      appendPath(glob, c, 1);
+    }
+    struct stat st;
+    if (!isLast) {
+      appendPath(glob, "/", 1);
+      walk(glob, iComp + 1);
+    } else if (lstat(glob->path, &st) == 0) {
+      glob->lenPath = lenPath;
+      addPath(glob, glob->path + lenPath);
+    }
+  } else {
+    GlobDir *dir = openDir(glob->lenPath ? glob->path : ".");
+    if (!dir)
+      return;
+    CompPattern pattern = compilePattern(comp);
+    for (size_t i = 0; i < dir->numEntries; ++i) {
+      GlobEntry *entry = &dir->entries[i];
+      if (isHiddenFor(entry->name, comp) || !matchComp(&pattern, entry->name))
+        continue;
+      if (isLast)
+        addPath(glob, entry->name);
+      else if (isDirEntry(glob, entry)) {
+        appendPath(glob, entry->name, strlen(entry->name));
+        appendPath(glob, "/", 1);
+        walk(glob, iComp + 1);
+        glob->lenPath = lenPath;
+      }
+    }
+    closeDir(dir);
+  }
+  glob->lenPath = lenPath;
+  glob->path[lenPath] = '\0';
+}
+
+static int comparePaths(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+char **globPaths(const char *pattern, Arena *arena, size_t *numMatches) {
+  Glob glob = {arena, NULL, 1, NULL, 0, 0};
+  size_t maxComps = 1;
+  for (const char *c = pattern; *c; ++c)
+    maxComps += *c == '/';
+  glob.comps = arenaAlloc(arena, sizeof(char *) * maxComps);
+  char *comps = arenaStrndup(arena, pattern, strlen(pattern));
+  glob.comps[0] = comps;
+  for (; *comps; ++comps) {
+    if (*comps == '\\' && comps[1])
+      ++comps;
+    else if (*comps == '/') {
+      *comps = '\0';
+      glob.comps[glob.numComps++] = comps + 1;
+    }
+  }
+  numPaths = 0;
+  appendPath(&glob, "", 0);
+  walk(&glob, 0);
+  free(glob.path);
+  // only the matches are sorted, most globs match a few names of many
+  if (numPaths > 1)
+    qsort(pathArr, numPaths, sizeof(char *), &comparePaths);
+  *numMatches = numPaths;
+  return pathArr;
+}
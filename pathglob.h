@@ -0,0 +1,25 @@
+#ifndef PATHGLOB_H
+#define PATHGLOB_H
+
+#include <stddef.h>
+
+#include "arena.h"
+
+// pathname expansion of '*', '?', '[...]' and '**'
+// directories are read with getdents64() into lists of names that are kept
+// by inode and read again only when their mtime has moved, so the globs of
+// one line or of every iteration of a loop cost one stat() per directory
+// and no readdir(); d_type decides what is a directory, stat() is only
+// needed for symlinks and file systems that do not fill it in
+
+// pattern has a '*', '?' or '[...]' that is not escaped by '\'
+int isGlobPattern(const char *pattern);
+
+// paths that match pattern, where '\' takes the next character as it is,
+// sorted, copied into arena, the number of them goes to *numPaths
+// the array stays valid until the next call
+char **globPaths(const char *pattern, Arena *arena, size_t *numPaths);
+
+void clearGlobCache(void);
+
+#endif
@@ -0,0 +1,352 @@
+#define _GNU_SOURCE // accept4, MSG_CMSG_CLOEXEC
+#include "server.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define NO_HELPER_RETRY_MS 100 // forks failed, try again after this long
+
+typedef struct {
+  pid_t pid;
+  int ctlFd;  // the server's end of the socketpair connections go through
+  int connFd; // the client being served, -1 while idle
+} Helper;
+
+// in the server
+static Helper *helpers;
+static size_t numHelpersAll, capHelpers, numIdle;
+static int listenFd = -1, signalFd = -1;
+static sigset_t helperMask; // the signal mask helpers run with
+// in a helper
+static int ctlFd = -1;
+static char *requestLine; // stays until the helper exits, with its env
+static char **requestEnv;
+
+static void *growArray(void *arr, size_t *cap, size_t need, size_t size) {
+  if (need <= *cap)
+    return arr;
+  size_t newCap = *cap ? *cap : 8;
+  while (newCap < need)
+    newCap *= 2;
+  if (!(arr = realloc(arr, newCap * size))) {
+    perror("");
+    exit(0);
+  }
+  *cap = newCap;
+  return arr;
+}
+
+static int statusOf(int status) {
+  if (WIFEXITED(status))
+    return WEXITSTATUS(status);
+  return 128 + WTERMSIG(status);
+}
+
+// ==========
+// fds over UNIX sockets
+// ==========
+typedef union {
+  char buf[CMSG_SPACE(sizeof(int) * SERVER_NUM_FDS)];
+  struct cmsghdr align;
+} FdControl;
+
+// one byte with fd attached
+static int sendFd(int sock, int fd) {
+  FdControl control;
+  char byte = 0;
+  struct iovec iov = {&byte, 1};
+  struct msghdr msg = {0};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = CMSG_SPACE(sizeof(int));
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  ssize_t lenSent;
+  while ((lenSent = sendmsg(sock, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+    ;
+  return lenSent == 1 ? 0 : -1;
+}
+
+// up to len bytes and the fds sent with them, close-on-exec, those beyond
+// maxFds are closed, the number kept goes to *numFds
+// returns the bytes received, 0 at EOF, -1 on error
+static ssize_t recvFds(int sock, void *data, size_t len, int *fds,
+                       size_t maxFds, size_t *numFds) {
+  FdControl control;
+  struct iovec iov = {data, len};
+  struct msghdr msg = {0};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  ssize_t lenRecv;
+  while ((lenRecv = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) == -1 &&
+         errno == EINTR)
+    ;
+  *numFds = 0;
+  if (lenRecv <= 0)
+    return lenRecv;
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+    size_t num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (size_t i = 0; i < num; ++i) {
+      int fd;
+      memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+      if (*numFds < maxFds)
+        fds[(*numFds)++] = fd;
+      else
+        close(fd);
+    }
+  }
+  return lenRecv;
+}
+
+static int readFull(int fd, void *data, size_t len) {
+  for (size_t done = 0; done < len;) {
+    ssize_t lenRead = read(fd, (char *)data + done, len - done);
+    if (lenRead == -1 && errno == EINTR)
+      continue;
+    if (lenRead <= 0)
+      return -1;
+    done += (size_t)lenRead;
+  }
+  return 0;
+}
+
+// ==========
+// server
+// ==========
+static int listenOn(const char *sockPath) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(sockPath) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, sockPath);
+  // a socket left by a server that is gone is replaced, a live one is not
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+    return -1;
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+    close(fd);
+    errno = EADDRINUSE;
+    return -1;
+  }
+  if (errno == ECONNREFUSED)
+    unlink(sockPath);
+  close(fd);
+  if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+    return -1;
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      listen(fd, SOMAXCONN) == -1) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+  return fd;
+}
+
+// returns 0 in the helper, its pid in the server, -1 if it failed
+static pid_t startHelper(void) {
+  int pair[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) == -1)
+    return -1;
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == -1) {
+    close(pair[0]);
+    close(pair[1]);
+    return -1;
+  }
+  if (pid == 0) {
+    close(pair[0]);
+    close(listenFd);
+    close(signalFd);
+    for (size_t i = 0; i < numHelpersAll; ++i) {
+      close(helpers[i].ctlFd);
+      if (helpers[i].connFd != -1)
+        close(helpers[i].connFd);
+    }
+    free(helpers);
+    helpers = NULL;
+    ctlFd = pair[1];
+    sigprocmask(SIG_SETMASK, &helperMask, NULL);
+    return 0;
+  }
+  close(pair[1]);
+  helpers = growArray(helpers, &capHelpers, numHelpersAll + 1, sizeof(Helper));
+  helpers[numHelpersAll++] = (Helper){pid, pair[0], -1};
+  ++numIdle;
+  return pid;
+}
+
+// fork helpers until one is idle, and if isQuiet until there are numHelpers
+// of them, busy ones included
+// the pool is filled up only when no event is pending, so that forks and
+// the startup of new helpers do not hold up connections and replies
+// returns 0 in a new helper
+static int fillPool(size_t numHelpers, int isQuiet) {
+  while (numIdle == 0 || (isQuiet && numHelpersAll < numHelpers)) {
+    pid_t pid = startHelper();
+    if (pid == 0)
+      return 0;
+    if (pid == -1)
+      break;
+  }
+  return 1;
+}
+
+// hand connFd to an idle helper
+static void serveConn(int connFd) {
+  for (size_t i = 0; i < numHelpersAll; ++i) {
+    // fails for a helper that died and is not reaped yet
+    if (helpers[i].connFd != -1 || sendFd(helpers[i].ctlFd, connFd) == -1)
+      continue;
+    helpers[i].connFd = connFd;
+    --numIdle;
+    return;
+  }
+  close(connFd); // the client sees EOF instead of a reply
+}
+
+// reply to the client of each helper that exited
+static void reapHelpers(void) {
+  int status;
+  struct rusage usage;
+  pid_t pid;
+  while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+    for (size_t i = 0; i < numHelpersAll; ++i) {
+      Helper *helper = &helpers[i];
+      if (helper->pid != pid)
+        continue;
+      if (helper->connFd != -1) {
+        ServerReply reply = {statusOf(status), usage};
+        send(helper->connFd, &reply, sizeof(reply), MSG_NOSIGNAL);
+        close(helper->connFd);
+      } else
+        --numIdle;
+      close(helper->ctlFd);
+      helpers[i] = helpers[--numHelpersAll];
+      break;
+    }
+  }
+}
+
+void serveRequests(const char *sockPath, size_t numHelpers) {
+  if ((listenFd = listenOn(sockPath)) == -1) {
+    printf("myshell: %s: %s\n", sockPath, strerror(errno));
+    exit(1);
+  }
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  sigprocmask(SIG_BLOCK, &mask, &helperMask);
+  if ((signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) {
+    perror("");
+    exit(1);
+  }
+  int isQuiet = 1;
+  while (1) {
+    if (fillPool(numHelpers, isQuiet) == 0)
+      return;
+    // without an idle helper connections wait in the backlog
+    struct pollfd pfds[2] = {{signalFd, POLLIN, 0}, {listenFd, POLLIN, 0}};
+    int timeout = numIdle == 0                  ? NO_HELPER_RETRY_MS
+                  : numHelpersAll < numHelpers ? 0
+                                               : -1;
+    int numReady = poll(pfds, numIdle > 0 ? 2 : 1, timeout);
+    isQuiet = numReady == 0;
+    if (numReady == -1)
+      continue;
+    if (pfds[0].revents & POLLIN) {
+      struct signalfd_siginfo info;
+      while (read(signalFd, &info, sizeof(info)) == sizeof(info))
+        if (info.ssi_signo != SIGCHLD) {
+          // idle helpers exit when their socketpair closes
+          unlink(sockPath);
+          exit(0);
+        }
+      reapHelpers();
+    }
+    if (pfds[1].revents & POLLIN) {
+      int connFd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+      if (connFd != -1)
+        serveConn(connFd);
+    }
+  }
+}
+
+// ==========
+// helper
+// ==========
+const char *takeRequest(char ***env) {
+  char byte;
+  int connFd, fds[SERVER_NUM_FDS];
+  size_t numFds;
+  // EOF when the server is gone
+  if (recvFds(ctlFd, &byte, 1, &connFd, 1, &numFds) != 1 || numFds != 1)
+    exit(0);
+  close(ctlFd);
+  ServerRequest request;
+  ssize_t lenRecv = recvFds(connFd, &request, sizeof(request), fds,
+                            SERVER_NUM_FDS, &numFds);
+  if (lenRecv <= 0 || numFds != SERVER_NUM_FDS ||
+      readFull(connFd, (char *)&request + lenRecv,
+               sizeof(request) - (size_t)lenRecv) == -1)
+    exit(2);
+  // the line, its '\0', then the environment as it came
+  size_t lenData = (size_t)request.lenLine + 1 + request.lenEnv;
+  if (!(requestLine = malloc(lenData))) {
+    perror("");
+    exit(0);
+  }
+  char *envData = requestLine + request.lenLine + 1;
+  if (readFull(connFd, requestLine, request.lenLine) == -1 ||
+      readFull(connFd, envData, request.lenEnv) == -1 ||
+      (request.lenEnv > 0 && envData[request.lenEnv - 1] != '\0'))
+    exit(2);
+  requestLine[request.lenLine] = '\0';
+  close(connFd);
+  size_t numEnv = 0;
+  for (size_t i = 0; i < request.lenEnv; ++i)
+    numEnv += envData[i] == '\0';
+  if (!(requestEnv = malloc(sizeof(char *) * (numEnv + 1)))) {
+    perror("");
+    exit(0);
+  }
+  for (size_t i = 0; i < numEnv; ++i) {
+    requestEnv[i] = envData;
+    envData += strlen(envData) + 1;
+  }
+  requestEnv[numEnv] = NULL;
+  *env = requestEnv;
+  for (int i = 0; i < 3; ++i)
+    if (fds[i] != i)
+      dup2(fds[i], i);
+  if (fchdir(fds[3]) == -1) {
+    printf("myshell: %s\n", strerror(errno));
+    exit(1);
+  }
+  for (size_t i = 0; i < numFds; ++i)
+    if (fds[i] > 2)
+      close(fds[i]);
+  return requestLine;
+}
@@ -0,0 +1,48 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/resource.h>
+
+// myshell --server path: a zygote that keeps helpers forked ahead of time,
+// each one through the startup of the shell and waiting for a command line,
+// so that a client pays for neither the exec nor the startup of a shell
+// the server accepts a connection on a UNIX socket and passes it to an idle
+// helper, which reads the request from it: the command line, with the
+// stdin, stdout, stderr and working directory of the client as SCM_RIGHTS,
+// and the environment of the client, which takes the place of the one the
+// helper started with
+// the helper runs the line as -c does, the last command replacing it, and
+// the server sends back the exit status and rusage that wait4() gives it
+// a helper serves one request, so what a line changes, e.g. a variable or
+// the directory, is never seen by the next one
+
+#define SERVER_HELPERS 4 // helpers kept by default
+
+// request: ServerRequest, then lenLine bytes of command line, then lenEnv
+// bytes of environment, each "NAME=value" with its '\0'; the first byte
+// carries SERVER_NUM_FDS fds: stdin, stdout, stderr and the directory
+#define SERVER_NUM_FDS 4
+typedef struct {
+  uint32_t lenLine, lenEnv;
+} ServerRequest;
+
+// reply, once the line has finished
+typedef struct {
+  int32_t status;      // as $? would show it
+  struct rusage usage; // of the helper and the children it waited for
+} ServerReply;
+
+// listen on sockPath and keep numHelpers helpers, at least one of them idle
+// the server never returns, it exits on SIGINT or SIGTERM, each helper
+// returns as soon as it is forked
+void serveRequests(const char *sockPath, size_t numHelpers);
+
+// in a helper: wait for a request, put the fds of the client in place of
+// 0, 1 and 2 and move to its directory
+// returns the command line, and in *env the environment of the client,
+// NULL-terminated, both stay until the helper exits
+const char *takeRequest(char ***env);
+
+#endif
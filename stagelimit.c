@@ -0,0 +1,232 @@
+#define _GNU_SOURCE // cpu_set_t, sched_setaffinity
+#include "stagelimit.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+#define DEFAULT_NICE 10
+#define DEFAULT_IO_LEVEL 4
+
+_Static_assert(sizeof(cpu_set_t) == sizeof(((StageLimits *)0)->cpuMask),
+               "cpuMask must have the layout of cpu_set_t");
+
+typedef struct {
+  char flag;
+  int resource;
+  rlim_t unit;
+} UlimitFlag;
+
+static const UlimitFlag ulimitFlags[MAX_STAGE_RLIMITS] = {
+    {'c', RLIMIT_CORE, 1024},  {'d', RLIMIT_DATA, 1024},
+    {'f', RLIMIT_FSIZE, 1024}, {'m', RLIMIT_RSS, 1024},
+    {'n', RLIMIT_NOFILE, 1},   {'s', RLIMIT_STACK, 1024},
+    {'t', RLIMIT_CPU, 1},      {'u', RLIMIT_NPROC, 1},
+    {'v', RLIMIT_AS, 1024},
+};
+
+int isLimitPrefix(const char *word) {
+  return strcmp(word, "setaffinity") == 0 || strcmp(word, "nice") == 0 ||
+         strcmp(word, "ionice") == 0 || strcmp(word, "ulimit") == 0;
+}
+
+// returns -1 if str is not a whole number in [min, max]
+static int parseNum(const char *str, long min, long max, long *num) {
+  char *end;
+  errno = 0;
+  *num = strtol(str, &end, 10);
+  if (end == str || *end || errno || *num < min || *num > max)
+    return -1;
+  return 0;
+}
+
+// 0-3,8,10-11
+static int parseCpuList(const char *list, unsigned long *mask) {
+  const size_t bits = 8 * sizeof(unsigned long);
+  const char *c = list;
+  while (1) {
+    char *end;
+    long first = strtol(c, &end, 10), last = first;
+    if (end == c || first < 0 || first >= MAX_CPUS)
+      return -1;
+    c = end;
+    if (*c == '-') {
+      last = strtol(++c, &end, 10);
+      if (end == c || last < first || last >= MAX_CPUS)
+        return -1;
+      c = end;
+    }
+    for (long cpu = first; cpu <= last; ++cpu)
+      mask[(size_t)cpu / bits] |= 1UL << ((size_t)cpu % bits);
+    if (*c == '\0')
+      return 0;
+    if (*c++ != ',')
+      return -1;
+  }
+}
+
+static long fail(Arena *arena, const char **errMsg, const char *name,
+                 const char *arg, const char *what) {
+  char *msg = arenaAlloc(arena, strlen(name) + strlen(arg) + strlen(what) + 5);
+  sprintf(msg, "%s: %s: %s", name, arg, what);
+  *errMsg = msg;
+  return -1;
+}
+
+static void appendDesc(StageLimits *limits, Arena *arena, const char *part) {
+  size_t lenDesc = limits->desc ? strlen(limits->desc) : 0;
+  char *desc = arenaAlloc(arena, lenDesc + strlen(part) + 3);
+  if (limits->desc)
+    sprintf(desc, "%s, %s", limits->desc, part);
+  else
+    strcpy(desc, part);
+  limits->desc = desc;
+}
+
+long parseLimitPrefix(char *const *words, size_t numWords,
+                      StageLimits *limits, Arena *arena, const char **errMsg) {
+  // taken only once a command is known to follow
+  StageLimits next = *limits;
+  const char *name = words[0];
+  char part[64];
+  size_t i = 1;
+  long num;
+  if (strcmp(name, "setaffinity") == 0) {
+    if (numWords < 3)
+      return 0;
+    memset(next.cpuMask, 0, sizeof(next.cpuMask));
+    if (parseCpuList(words[1], next.cpuMask) == -1)
+      return fail(arena, errMsg, name, words[1], "invalid CPU list");
+    next.hasAffinity = 1;
+    char *desc = arenaAlloc(arena, strlen(words[1]) + 13);
+    sprintf(desc, "setaffinity %s", words[1]);
+    appendDesc(&next, arena, desc);
+    i = 2;
+  } else if (strcmp(name, "nice") == 0) {
+    num = DEFAULT_NICE;
+    const char *arg = NULL;
+    if (i + 1 < numWords && strcmp(words[i], "-n") == 0) {
+      arg = words[i + 1];
+      i += 2;
+    } else if (i < numWords && words[i][0] == '-' && words[i][1]) {
+      arg = words[i] + 1;
+      ++i;
+    }
+    if (arg && parseNum(arg, -40, 40, &num) == -1)
+      return fail(arena, errMsg, name, arg, "invalid adjustment");
+    next.hasNice = 1;
+    next.niceInc = (int)num;
+    sprintf(part, "nice -n %ld", num);
+    appendDesc(&next, arena, part);
+  } else if (strcmp(name, "ionice") == 0) {
+    long ioClass = -1, level = -1;
+    for (; i + 1 < numWords; i += 2) {
+      if (strcmp(words[i], "-c") == 0) {
+        if (parseNum(words[i + 1], 0, 3, &ioClass) == -1)
+          return fail(arena, errMsg, name, words[i + 1], "invalid class");
+      } else if (strcmp(words[i], "-n") == 0) {
+        if (parseNum(words[i + 1], 0, 7, &level) == -1)
+          return fail(arena, errMsg, name, words[i + 1], "invalid level");
+      } else
+        break;
+    }
+    if (ioClass == -1 && level == -1)
+      return 0;
+    if (ioClass == -1)
+      ioClass = 2; // best-effort, the only class a level alone makes sense for
+    if (level == -1 || ioClass == 3)
+      level = ioClass == 3 ? 0 : DEFAULT_IO_LEVEL;
+    next.ioPrio = (int)(ioClass << IOPRIO_CLASS_SHIFT | level);
+    sprintf(part, "ionice -c %ld -n %ld", ioClass, level);
+    appendDesc(&next, arena, part);
+  } else if (strcmp(name, "ulimit") == 0) {
+    for (; i + 1 < numWords && words[i][0] == '-' && words[i][1] &&
+           !words[i][2];
+         i += 2) {
+      const UlimitFlag *flag = NULL;
+      for (size_t f = 0; f < MAX_STAGE_RLIMITS; ++f)
+        if (ulimitFlags[f].flag == words[i][1])
+          flag = &ulimitFlags[f];
+      if (!flag)
+        return fail(arena, errMsg, name, words[i], "invalid option");
+      rlim_t value = RLIM_INFINITY;
+      if (strcmp(words[i + 1], "unlimited") != 0) {
+        if (parseNum(words[i + 1], 0, (long)(RLIM_INFINITY / 1024 - 1),
+                     &num) == -1)
+          return fail(arena, errMsg, name, words[i + 1], "invalid number");
+        value = (rlim_t)num * flag->unit;
+      }
+      // a second one for the same resource wins
+      size_t r = 0;
+      while (r < next.numRlimits && next.rlimits[r].resource != flag->resource)
+        ++r;
+      next.rlimits[r] = (StageRlimit){flag->resource, value};
+      if (r == next.numRlimits)
+        ++next.numRlimits;
+      snprintf(part, sizeof(part), "ulimit %s %s", words[i], words[i + 1]);
+      appendDesc(&next, arena, part);
+    }
+    if (i == 1)
+      return 0;
+  }
+  if (i >= numWords)
+    return 0;
+  *limits = next;
+  return (long)i;
+}
+
+long parseLimitPrefixes(char *const *words, size_t numWords,
+                        StageLimits *limits, Arena *arena,
+                        const char **errMsg) {
+  size_t i = 0;
+  while (i < numWords && isLimitPrefix(words[i])) {
+    long numTaken =
+        parseLimitPrefix(words + i, numWords - i, limits, arena, errMsg);
+    if (numTaken == -1)
+      return -1;
+    if (numTaken == 0)
+      break;
+    i += (size_t)numTaken;
+  }
+  return (long)i;
+}
+
+StageLimits *copyLimits(const StageLimits *limits, Arena *arena) {
+  if (!limits)
+    return NULL;
+  StageLimits *copy = arenaAlloc(arena, sizeof(StageLimits));
+  *copy = *limits;
+  copy->desc = arenaStrndup(arena, limits->desc, strlen(limits->desc));
+  return copy;
+}
+
+const char *applyLimits(const StageLimits *limits) {
+  if (limits->hasAffinity) {
+    cpu_set_t cpus;
+    memcpy(&cpus, limits->cpuMask, sizeof(cpus));
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) == -1)
+      return "setaffinity";
+  }
+  if (limits->hasNice) {
+    errno = 0;
+    int prio = getpriority(PRIO_PROCESS, 0);
+    if ((prio == -1 && errno) ||
+        setpriority(PRIO_PROCESS, 0, prio + limits->niceInc) == -1)
+      return "nice";
+  }
+  if (limits->ioPrio != -1 && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+                                      limits->ioPrio) == -1)
+    return "ionice";
+  for (size_t i = 0; i < limits->numRlimits; ++i) {
+    struct rlimit limit = {limits->rlimits[i].value, limits->rlimits[i].value};
+    if (setrlimit(limits->rlimits[i].resource, &limit) == -1)
+      return "ulimit";
+  }
+  return NULL;
+}
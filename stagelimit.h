@@ -0,0 +1,61 @@
+#ifndef STAGELIMIT_H
+#define STAGELIMIT_H
+
+#include <stddef.h>
+#include <sys/resource.h>
+
+#include "arena.h"
+
+// settings a pipeline stage is started with, given by prefixes in front of
+// its command, each stage has its own:
+// setaffinity LIST               CPUs it may run on, e.g. 0-3,8
+// nice [-n N | -N]               niceness added, 10 if no N is given
+// ionice [-c CLASS] [-n LEVEL]   I/O class 1 realtime, 2 best-effort,
+//                                3 idle, LEVEL 0-7 within the class
+// ulimit -X N...                 resource limits as in bash, soft and hard:
+//                                -c -d -f -m -s -v in KB, -n -u counts,
+//                                -t CPU seconds, N may be unlimited
+// a prefix with no command after it is a command of its own
+
+#define MAX_CPUS 1024
+#define MAX_STAGE_RLIMITS 9 // one of each resource ulimit knows
+
+typedef struct {
+  int resource;
+  rlim_t value;
+} StageRlimit;
+
+typedef struct {
+  int hasAffinity;
+  unsigned long cpuMask[MAX_CPUS / (8 * sizeof(unsigned long))];
+  int hasNice, niceInc;
+  int ioPrio; // -1 to keep the shell's
+  StageRlimit rlimits[MAX_STAGE_RLIMITS];
+  size_t numRlimits;
+  char *desc; // the prefixes as applied, shown by jobs -l
+} StageLimits;
+
+// word is the name of a prefix
+int isLimitPrefix(const char *word);
+
+// parse the prefix words[0] and its arguments into *limits, which may hold
+// earlier prefixes of the same stage already, desc is allocated from arena
+// returns the number of words it takes, 0 if no command follows them, or
+// -1 with *errMsg set
+long parseLimitPrefix(char *const *words, size_t numWords,
+                      StageLimits *limits, Arena *arena, const char **errMsg);
+
+// all prefixes at the start of words, as parseLimitPrefix() takes them one
+// by one, for an argv that is only known when it runs
+// returns the number of words they take, or -1 with *errMsg set
+long parseLimitPrefixes(char *const *words, size_t numWords,
+                        StageLimits *limits, Arena *arena,
+                        const char **errMsg);
+
+StageLimits *copyLimits(const StageLimits *limits, Arena *arena);
+
+// apply limits to the calling process, safe between vfork() and exec
+// returns NULL, or the name of the prefix that failed with errno set
+const char *applyLimits(const StageLimits *limits);
+
+#endif
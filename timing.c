@@ -0,0 +1,91 @@
+#include "timing.h"
+
+#include <stdio.h>
+#include <time.h>
+
+double wallClock(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static double toSec(struct timeval tv) {
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static struct timeval subTimeval(struct timeval a, struct timeval b) {
+  struct timeval diff = {a.tv_sec - b.tv_sec, a.tv_usec - b.tv_usec};
+  if (diff.tv_usec < 0) {
+    --diff.tv_sec;
+    diff.tv_usec += 1000000;
+  }
+  return diff;
+}
+
+void diffRusage(struct rusage *diff, const struct rusage *after,
+                const struct rusage *before) {
+  diff->ru_utime = subTimeval(after->ru_utime, before->ru_utime);
+  diff->ru_stime = subTimeval(after->ru_stime, before->ru_stime);
+  diff->ru_maxrss = after->ru_maxrss;
+  diff->ru_majflt = after->ru_majflt - before->ru_majflt;
+  diff->ru_minflt = after->ru_minflt - before->ru_minflt;
+  diff->ru_nvcsw = after->ru_nvcsw - before->ru_nvcsw;
+  diff->ru_nivcsw = after->ru_nivcsw - before->ru_nivcsw;
+}
+
+// command names are arbitrary words, escape them for a JSON string
+static void putJsonStr(const char *str) {
+  fputc('"', stderr);
+  for (; *str; ++str) {
+    unsigned char c = (unsigned char)*str;
+    if (c == '"' || c == '\\')
+      fprintf(stderr, "\\%c", c);
+    else if (c < 0x20)
+      fprintf(stderr, "\\u%04x", c);
+    else
+      fputc(c, stderr);
+  }
+  fputc('"', stderr);
+}
+
+void reportTime(const StageTime *stages, size_t numStages, double wallSec,
+                int isJson) {
+  double userSec = 0, sysSec = 0;
+  for (size_t i = 0; i < numStages; ++i) {
+    userSec += toSec(stages[i].usage.ru_utime);
+    sysSec += toSec(stages[i].usage.ru_stime);
+  }
+  if (isJson) {
+    fprintf(stderr, "{\"real\":%.6f,\"user\":%.6f,\"sys\":%.6f,\"stages\":[",
+            wallSec, userSec, sysSec);
+    for (size_t i = 0; i < numStages; ++i) {
+      const struct rusage *usage = &stages[i].usage;
+      fprintf(stderr, "%s{\"cmd\":", i ? "," : "");
+      putJsonStr(stages[i].cmdName);
+      fprintf(stderr,
+              ",\"pid\":%d,\"status\":%d,\"user\":%.6f,\"sys\":%.6f,"
+              "\"maxrss_kb\":%ld,\"majflt\":%ld,\"minflt\":%ld,"
+              "\"nvcsw\":%ld,\"nivcsw\":%ld}",
+              (int)stages[i].pid, stages[i].status, toSec(usage->ru_utime),
+              toSec(usage->ru_stime), usage->ru_maxrss, usage->ru_majflt,
+              usage->ru_minflt, usage->ru_nvcsw, usage->ru_nivcsw);
+    }
+    fprintf(stderr, "]}\n");
+    return;
+  }
+  fprintf(stderr, "real\t%.3fs\nuser\t%.3fs\nsys\t%.3fs\n", wallSec, userSec,
+          sysSec);
+  if (numStages == 0)
+    return;
+  fprintf(stderr, "%5s %6s %8s %8s %10s %7s %8s %7s %7s  %s\n", "stage",
+          "status", "user", "sys", "maxrss", "majflt", "minflt", "vcsw",
+          "ivcsw", "command");
+  for (size_t i = 0; i < numStages; ++i) {
+    const struct rusage *usage = &stages[i].usage;
+    fprintf(stderr, "%5zu %6d %7.3fs %7.3fs %8ldKB %7ld %8ld %7ld %7ld  %s\n",
+            i + 1, stages[i].status, toSec(usage->ru_utime),
+            toSec(usage->ru_stime), usage->ru_maxrss, usage->ru_majflt,
+            usage->ru_minflt, usage->ru_nvcsw, usage->ru_nivcsw,
+            stages[i].cmdName);
+  }
+}
@@ -0,0 +1,29 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stddef.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+// what the time prefix reports for one stage of a pipeline
+typedef struct {
+  const char *cmdName;
+  pid_t pid; // 0 if it ran in the shell itself or did not start
+  int status;
+  struct rusage usage; // from wait4(), or the shell's own usage delta
+} StageTime;
+
+// seconds of a monotonic clock, for the wall time of a pipeline
+double wallClock(void);
+
+// *diff = *after - *before for the times and counters, ru_maxrss is taken
+// from after as it is not cumulative
+void diffRusage(struct rusage *diff, const struct rusage *after,
+                const struct rusage *before);
+
+// print the report to stderr, totals first and then one row per stage,
+// or a single JSON object on one line if isJson
+void reportTime(const StageTime *stages, size_t numStages, double wallSec,
+                int isJson);
+
+#endif
@@ -0,0 +1,166 @@
+#include "trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_RING 4096     // events, a power of 2
+#define TRACE_DETAIL 32     // bytes of detail kept, with the '\0'
+#define TRACE_BUF 16384     // JSON written per write()
+#define TRACE_EVENT_MAX 512 // JSON of one event, at most
+
+typedef struct {
+  const char *name, *argName;
+  uint64_t start, dur; // ns
+  long arg;
+  char detail[TRACE_DETAIL];
+} TraceEvent;
+
+int isTracing;
+// events [tail, head) are waiting, counters only grow, slot is count %
+// TRACE_RING
+static TraceEvent ring[TRACE_RING];
+static size_t head, tail;
+static int traceFd = -1;
+static char *traceFile;
+static pid_t tracePid;
+static int isNamed; // process_name written for tracePid
+
+uint64_t traceClock(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+void traceEvent(const char *name, uint64_t start, const char *argName,
+                long arg, const char *detail) {
+  uint64_t now = traceClock();
+  if (head - tail == TRACE_RING)
+    traceFlush();
+  TraceEvent *event = &ring[head % TRACE_RING];
+  event->name = name;
+  event->argName = argName;
+  event->start = start;
+  event->dur = now - start;
+  event->arg = arg;
+  event->detail[0] = '\0';
+  if (detail) {
+    strncpy(event->detail, detail, TRACE_DETAIL - 1);
+    event->detail[TRACE_DETAIL - 1] = '\0';
+  }
+  ++head;
+}
+
+// detail as a JSON string body, control characters are dropped
+static size_t escapeJson(char *out, const char *str) {
+  size_t len = 0;
+  for (; *str; ++str) {
+    if (*str == '"' || *str == '\\')
+      out[len++] = '\\';
+    if ((unsigned char)*str >= 0x20)
+      out[len++] = *str;
+  }
+  out[len] = '\0';
+  return len;
+}
+
+static void writeOut(const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t lenWritten = write(traceFd, buf, len);
+    if (lenWritten == -1 && errno == EINTR)
+      continue;
+    if (lenWritten <= 0)
+      return;
+    buf += lenWritten;
+    len -= (size_t)lenWritten;
+  }
+}
+
+void traceFlush(void) {
+  if (traceFd == -1)
+    return;
+  static char buf[TRACE_BUF];
+  size_t len = 0;
+  if (!isNamed && head != tail) {
+    len += (size_t)sprintf(buf,
+                           "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                           "\"args\":{\"name\":\"myshell\"}},\n",
+                           (int)tracePid);
+    isNamed = 1;
+  }
+  for (; tail != head; ++tail) {
+    const TraceEvent *event = &ring[tail % TRACE_RING];
+    char detail[TRACE_DETAIL * 2];
+    escapeJson(detail, event->detail);
+    len += (size_t)sprintf(
+        buf + len,
+        "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,"
+        "\"dur\":%.3f,\"args\":{",
+        event->name, (int)tracePid, (int)tracePid,
+        (double)event->start / 1000, (double)event->dur / 1000);
+    if (event->argName)
+      len += (size_t)sprintf(buf + len, "\"%s\":%ld%s", event->argName,
+                             event->arg, detail[0] ? "," : "");
+    if (detail[0])
+      len += (size_t)sprintf(buf + len, "\"cmd\":\"%s\"", detail);
+    len += (size_t)sprintf(buf + len, "}},\n");
+    // whole events only, so that the lines of processes appending to the
+    // same file never mix
+    if (TRACE_BUF - len < TRACE_EVENT_MAX) {
+      writeOut(buf, len);
+      len = 0;
+    }
+  }
+  writeOut(buf, len);
+}
+
+int traceStart(const char *path) {
+  traceStop();
+  int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd == -1)
+    return -1;
+  if (!(traceFile = strdup(path))) {
+    perror("");
+    exit(0);
+  }
+  traceFd = fd;
+  // the array is opened by whoever finds the file empty
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size == 0)
+    writeOut("[\n", 2);
+  tracePid = getpid();
+  isNamed = 0;
+  head = tail = 0;
+  isTracing = 1;
+  return 0;
+}
+
+void traceInit(void) {
+  const char *path = getenv("MYSHELL_TRACE");
+  if (path && *path && traceStart(path) == -1)
+    printf("myshell: %s: %s\n", path, strerror(errno));
+}
+
+void traceStop(void) {
+  if (traceFd == -1)
+    return;
+  traceFlush();
+  close(traceFd);
+  free(traceFile);
+  traceFd = -1;
+  traceFile = NULL;
+  isTracing = 0;
+}
+
+const char *tracePath(void) { return traceFile; }
+
+void traceChild(void) {
+  tail = head;
+  tracePid = getpid();
+  isNamed = 0;
+}
@@ -0,0 +1,67 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// opt-in tracing of where the shell's own time goes, written as Chrome
+// trace events that Perfetto and chrome://tracing open
+// MYSHELL_TRACE=file in the environment at startup, or set -o trace=file,
+// which exports it, turns it on for this process, and for every myshell
+// started below it through the environment; set +o trace writes what is
+// left, stops and unsets it
+// events are complete ("X") events on CLOCK_MONOTONIC, one track per pid:
+//   read   read() of a block of input, with its bytes
+//   lex    a lexer pass over one line, with the tokens so far
+//   parse  the parser over the tokens of a complete line
+//   line   running one command line
+//   pipe   creating the pipe between two stages
+//   spawn  posix_spawn() or vfork() of a stage, both return only once the
+//          child has exec'd, so this is the time to exec in the child
+//   fork   fork() of a builtin stage or of a subshell
+//   exec   the exec of the last command of -c, in place of the shell
+//   wait   a foreground stage, from the wait until it is reaped
+//   reap   a background stage reaped, with its status
+// events go into a fixed ring of this process, with one writer and no
+// locks, that is appended to the file whenever it fills up and when the
+// process exits or execs; the file is an array that is never closed, which
+// the format allows, so that every process can append to it with O_APPEND
+// a forked child drops the events of its parent and keeps its own
+// while tracing is off every trace point is a load and a branch
+
+extern int isTracing;
+
+// nanoseconds of CLOCK_MONOTONIC, 0 while tracing is off
+#define TRACE_NOW() (isTracing ? traceClock() : 0)
+
+// event name from start to now, argName = arg, and detail, e.g. the command
+// name, which is copied; argName and detail may be NULL
+#define TRACE(name, start, argName, arg, detail)                              \
+  do {                                                                         \
+    if (isTracing)                                                             \
+      traceEvent(name, start, argName, arg, detail);                           \
+  } while (0)
+
+uint64_t traceClock(void);
+void traceEvent(const char *name, uint64_t start, const char *argName,
+                long arg, const char *detail);
+
+// start with MYSHELL_TRACE from the environment, if it is set
+void traceInit(void);
+
+// append events to path, after what is already there
+// returns -1 if the file cannot be opened, with errno set
+int traceStart(const char *path);
+
+// write what is left and stop tracing
+void traceStop(void);
+
+// file of the trace, NULL while tracing is off
+const char *tracePath(void);
+
+// write the events so far, e.g. before an exec
+void traceFlush(void);
+
+// in a forked child: the events so far are the parent's to write
+void traceChild(void);
+
+#endif
@@ -0,0 +1,312 @@
+#include "vars.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VARS_INIT_CAP 256 // power of 2
+#define ENV_INIT_CAP 64
+#define NOT_EXPORTED ((size_t)-1)
+
+extern char **environ;
+
+typedef struct {
+  char *entry; // "NAME=value", NULL for an empty slot
+  size_t lenName;
+  size_t capEntry; // bytes allocated for entry, a new value reuses them
+  size_t envIdx;   // slot in envArr, or NOT_EXPORTED
+} Var;
+
+// open addressing with linear probing, at most half full, capacity is a
+// power of 2
+static Var *varTable;
+static size_t varCap, varCount;
+// what environ points at, the entries of the exported variables in no
+// particular order, NULL-terminated
+static char **envArr;
+static size_t envCount, envCap;
+static char **initialEnviron; // put back by freeVars()
+static char *shellName[] = {"myshell"};
+static char **params = shellName; // $0, $1, ...
+static size_t numParamsSet = 1;   // with $0
+
+static void *allocOrExit(void *ptr) {
+  if (!ptr) {
+    perror("");
+    exit(0);
+  }
+  return ptr;
+}
+
+static size_t hashName(const char *name, size_t len) {
+  uint64_t h = 14695981039346656037ULL; // FNV-1a
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (unsigned char)name[i];
+    h *= 1099511628211ULL;
+  }
+  return (size_t)h;
+}
+
+static Var *findSlot(Var *table, size_t cap, const char *name, size_t len) {
+  size_t i = hashName(name, len) & (cap - 1);
+  while (table[i].entry && (table[i].lenName != len ||
+                            memcmp(table[i].entry, name, len) != 0))
+    i = (i + 1) & (cap - 1);
+  return &table[i];
+}
+
+// the variable name[0, len), NULL if it is not set
+static Var *findVar(const char *name, size_t len) {
+  if (!varTable)
+    return NULL;
+  Var *var = findSlot(varTable, varCap, name, len);
+  return var->entry ? var : NULL;
+}
+
+static void growTable(void) {
+  size_t newCap = varCap ? 2 * varCap : VARS_INIT_CAP;
+  Var *newTable = allocOrExit(calloc(newCap, sizeof(Var)));
+  for (size_t i = 0; i < varCap; ++i)
+    if (varTable[i].entry)
+      *findSlot(newTable, newCap, varTable[i].entry, varTable[i].lenName) =
+          varTable[i];
+  free(varTable);
+  varTable = newTable;
+  varCap = newCap;
+}
+
+// ==========
+// environ, kept up to date one slot at a time
+// ==========
+static void exportVar(Var *var) {
+  if (var->envIdx != NOT_EXPORTED)
+    return;
+  if (envCount + 2 > envCap) {
+    envCap = envCap ? 2 * envCap : ENV_INIT_CAP;
+    envArr = allocOrExit(realloc(envArr, sizeof(char *) * envCap));
+    environ = envArr;
+  }
+  var->envIdx = envCount;
+  envArr[envCount++] = var->entry;
+  envArr[envCount] = NULL;
+}
+
+static void unexportVar(Var *var) {
+  if (var->envIdx == NOT_EXPORTED)
+    return;
+  // the last entry moves into the slot
+  size_t idx = var->envIdx;
+  char *last = envArr[--envCount];
+  envArr[idx] = last;
+  envArr[envCount] = NULL;
+  if (idx != envCount)
+    findVar(last, (size_t)(strchr(last, '=') - last))->envIdx = idx;
+  var->envIdx = NOT_EXPORTED;
+}
+
+// ==========
+// api
+// ==========
+void varsInit(void) {
+  initialEnviron = environ;
+  for (char **env = initialEnviron; env && *env; ++env) {
+    const char *eq = strchr(*env, '=');
+    if (eq && eq > *env)
+      setVar(*env, (size_t)(eq - *env), eq + 1, 1);
+  }
+  // an empty environment, not none
+  if (!envArr) {
+    envCap = ENV_INIT_CAP;
+    envArr = allocOrExit(malloc(sizeof(char *) * envCap));
+    envArr[0] = NULL;
+  }
+  environ = envArr;
+}
+
+const char *getVar(const char *name) {
+  const Var *var = findVar(name, strlen(name));
+  return var ? var->entry + var->lenName + 1 : NULL;
+}
+
+void setVar(const char *name, size_t lenName, const char *value,
+            int isExport) {
+  // only a new name can fill the table up
+  Var *var = findVar(name, lenName);
+  if (!var) {
+    if ((varCount + 1) * 2 > varCap)
+      growTable();
+    var = findSlot(varTable, varCap, name, lenName);
+  }
+  size_t lenValue = strlen(value), lenEntry = lenName + lenValue + 2;
+  if (lenEntry > var->capEntry) {
+    // a new block, value may point into the old one, which is freed only
+    // once value is copied
+    size_t capEntry = var->capEntry * 2 > lenEntry ? var->capEntry * 2
+                                                   : lenEntry;
+    char *entry = allocOrExit(malloc(capEntry));
+    memcpy(entry, name, lenName);
+    entry[lenName] = '=';
+    memcpy(entry + lenName + 1, value, lenValue + 1);
+    if (!var->entry) {
+      var->lenName = lenName;
+      var->envIdx = NOT_EXPORTED;
+      ++varCount;
+    } else if (var->envIdx != NOT_EXPORTED)
+      envArr[var->envIdx] = entry;
+    free(var->entry);
+    var->entry = entry;
+    var->capEntry = capEntry;
+  } else {
+    var->entry[lenName] = '=';
+    memmove(var->entry + lenName + 1, value, lenValue + 1);
+  }
+  if (isExport)
+    exportVar(var);
+}
+
+void unsetVar(const char *name) {
+  Var *var = findVar(name, strlen(name));
+  if (!var)
+    return;
+  unexportVar(var);
+  free(var->entry);
+  memset(var, 0, sizeof(Var));
+  --varCount;
+  // backward shift deletion keeps probe sequences intact without tombstones
+  size_t i = (size_t)(var - varTable);
+  for (size_t j = (i + 1) & (varCap - 1); varTable[j].entry;
+       j = (j + 1) & (varCap - 1)) {
+    size_t home =
+        hashName(varTable[j].entry, varTable[j].lenName) & (varCap - 1);
+    // an entry whose home slot lies cyclically in (i, j] can stay
+    int canStay = i < j ? (i < home && home <= j) : (i < home || home <= j);
+    if (!canStay) {
+      varTable[i] = varTable[j];
+      memset(&varTable[j], 0, sizeof(Var));
+      i = j;
+    }
+  }
+}
+
+char **stageEnviron(char *const *assigns, size_t numAssigns, Arena *arena) {
+  char **env = arenaAlloc(arena, sizeof(char *) * (envCount + numAssigns + 1));
+  memcpy(env, envArr, sizeof(char *) * envCount);
+  size_t numEnv = envCount;
+  for (size_t i = 0; i < numAssigns; ++i) {
+    size_t lenName = (size_t)(strchr(assigns[i], '=') - assigns[i]);
+    const Var *var = findVar(assigns[i], lenName);
+    size_t idx = var ? var->envIdx : NOT_EXPORTED;
+    // or one of the earlier assignments
+    for (size_t j = envCount; j < numEnv && idx == NOT_EXPORTED; ++j)
+      if (strncmp(env[j], assigns[i], lenName + 1) == 0)
+        idx = j;
+    if (idx == NOT_EXPORTED)
+      idx = numEnv++;
+    env[idx] = assigns[i];
+  }
+  env[numEnv] = NULL;
+  return env;
+}
+
+char **varsEnviron(void) { return envArr; }
+
+void setParams(char **newParams, size_t numParams) {
+  params = numParams > 0 ? newParams : shellName;
+  numParamsSet = numParams > 0 ? numParams : 1;
+}
+
+const char *getParam(size_t n) { return n < numParamsSet ? params[n] : NULL; }
+
+size_t getNumParams(void) { return numParamsSet - 1; }
+
+int isVarName(const char *name, size_t len) {
+  if (len == 0 || (!isalpha((unsigned char)name[0]) && name[0] != '_'))
+    return 0;
+  for (size_t i = 1; i < len; ++i)
+    if (!isalnum((unsigned char)name[i]) && name[i] != '_')
+      return 0;
+  return 1;
+}
+
+// ==========
+// export, unset
+// ==========
+static int cmpEntry(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// export NAME="value" for each exported variable, by name, so that the
+// output can be read back in
+static void listExports(void) {
+  char **entries = allocOrExit(malloc(sizeof(char *) * (envCount + 1)));
+  memcpy(entries, envArr, sizeof(char *) * envCount);
+  qsort(entries, envCount, sizeof(char *), cmpEntry);
+  for (size_t i = 0; i < envCount; ++i) {
+    const char *eq = strchr(entries[i], '=');
+    printf("export %.*s=\"", (int)(eq - entries[i]), entries[i]);
+    for (const char *c = eq + 1; *c; ++c) {
+      if (strchr("\"\\$`", *c))
+        putchar('\\');
+      putchar(*c);
+    }
+    printf("\"\n");
+  }
+  free(entries);
+}
+
+int exportBuiltin(char **cmdArgv) {
+  size_t i = 1;
+  if (cmdArgv[i] && strcmp(cmdArgv[i], "-p") == 0)
+    ++i;
+  if (!cmdArgv[i]) {
+    listExports();
+    return 0;
+  }
+  int status = 0;
+  for (; cmdArgv[i]; ++i) {
+    const char *arg = cmdArgv[i], *eq = strchr(arg, '=');
+    size_t lenName = eq ? (size_t)(eq - arg) : strlen(arg);
+    if (!isVarName(arg, lenName)) {
+      printf("export: `%s\': not a valid identifier\n", arg);
+      status = 1;
+    } else if (eq)
+      setVar(arg, lenName, eq + 1, 1);
+    else {
+      Var *var = findVar(arg, lenName);
+      if (var)
+        exportVar(var);
+    }
+  }
+  return status;
+}
+
+int unsetBuiltin(char **cmdArgv) {
+  size_t i = 1;
+  if (cmdArgv[i] && strcmp(cmdArgv[i], "-v") == 0)
+    ++i;
+  int status = 0;
+  for (; cmdArgv[i]; ++i) {
+    if (!isVarName(cmdArgv[i], strlen(cmdArgv[i]))) {
+      printf("unset: `%s\': not a valid identifier\n", cmdArgv[i]);
+      status = 1;
+    } else
+      unsetVar(cmdArgv[i]);
+  }
+  return status;
+}
+
+void freeVars(void) {
+  for (size_t i = 0; i < varCap; ++i)
+    free(varTable[i].entry);
+  free(varTable);
+  free(envArr);
+  varTable = NULL;
+  envArr = NULL;
+  varCap = 0;
+  varCount = 0;
+  envCount = 0;
+  envCap = 0;
+  environ = initialEnviron;
+}
@@ -0,0 +1,54 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include <stddef.h>
+
+#include "arena.h"
+
+// shell variables, in an open-addressed table keyed by name
+// the exported ones are also the environment of every command the shell
+// starts: environ is an array of their "NAME=value" strings that changes
+// along with them, one slot per change, so starting a command never has to
+// build it, however many variables there are
+
+// take over the variables of environ, all of them exported
+void varsInit(void);
+
+// value of name, NULL if it is not set
+const char *getVar(const char *name);
+
+// name[0, lenName) = value, exported if isExport, or if it was already
+void setVar(const char *name, size_t lenName, const char *value,
+            int isExport);
+
+void unsetVar(const char *name);
+
+// environ with the assignments "NAME=value" on top, for one command, in
+// arena
+char **stageEnviron(char *const *assigns, size_t numAssigns, Arena *arena);
+
+// the environment of the shell, to put back after stageEnviron()
+char **varsEnviron(void);
+
+// $0 and the positional parameters $1..., params[0] is $0, the strings
+// are not copied, so they have to live as long as the shell, e.g. argv
+void setParams(char **params, size_t numParams);
+
+// $n, NULL if there is none
+const char *getParam(size_t n);
+
+// $#, the number of parameters after $0
+size_t getNumParams(void);
+
+// name[0, len) is a valid variable name
+int isVarName(const char *name, size_t len);
+
+// export [-p] [name[=value]...]
+int exportBuiltin(char **cmdArgv);
+
+// unset [-v] name...
+int unsetBuiltin(char **cmdArgv);
+
+void freeVars(void);
+
+#endif
@@ -0,0 +1,330 @@
+#define _GNU_SOURCE
+#include "zerocopy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define COPY_CHUNK (1 << 30)     // per syscall for the in-kernel paths
+#define COPY_BUF_SIZE (1 << 17) // for read/write
+
+// errors after which the next, more general path is tried
+static int isUnsupported(int err) {
+  return err == EINVAL || err == EXDEV || err == ENOSYS || err == EOPNOTSUPP ||
+         err == EBADF || err == ESPIPE;
+}
+
+// each path copies until EOF and returns 0, or returns -1 with errno set
+// *copied counts what it moved even on failure, so that the next path only
+// has to continue
+static int copyRange(int inFd, int outFd, off_t *copied) {
+  ssize_t lenCopied;
+  while ((lenCopied = copy_file_range(inFd, NULL, outFd, NULL, COPY_CHUNK,
+                                      0)) > 0)
+    *copied += lenCopied;
+  return lenCopied == 0 ? 0 : -1;
+}
+
+static int copySplice(int inFd, int outFd, off_t *copied) {
+  ssize_t lenCopied;
+  while ((lenCopied = splice(inFd, NULL, outFd, NULL, COPY_CHUNK,
+                             SPLICE_F_MOVE | SPLICE_F_MORE)) > 0)
+    *copied += lenCopied;
+  return lenCopied == 0 ? 0 : -1;
+}
+
+static int copySendfile(int inFd, int outFd, off_t *copied) {
+  ssize_t lenCopied;
+  while ((lenCopied = sendfile(outFd, inFd, NULL, COPY_CHUNK)) > 0)
+    *copied += lenCopied;
+  return lenCopied == 0 ? 0 : -1;
+}
+
+static int copyReadWrite(int inFd, int outFd, off_t *copied) {
+  char *buf = malloc(COPY_BUF_SIZE);
+  if (!buf)
+    return -1;
+  ssize_t lenRead;
+  // EINTR ends the copy too, as in the other paths, so that ctrl+c stops a
+  // cat run by the shell itself
+  while ((lenRead = read(inFd, buf, COPY_BUF_SIZE)) != 0) {
+    if (lenRead == -1) {
+      free(buf);
+      return -1;
+    }
+    for (ssize_t lenDone = 0; lenDone < lenRead;) {
+      ssize_t lenWritten =
+          write(outFd, buf + lenDone, (size_t)(lenRead - lenDone));
+      if (lenWritten == -1) {
+        free(buf);
+        return -1;
+      }
+      lenDone += lenWritten;
+    }
+    *copied += lenRead;
+  }
+  free(buf);
+  return 0;
+}
+
+off_t copyFdAll(int inFd, int outFd) {
+  struct stat inSt, outSt;
+  if (fstat(inFd, &inSt) == -1 || fstat(outFd, &outSt) == -1)
+    return -1;
+  int isInFile = S_ISREG(inSt.st_mode), isOutFile = S_ISREG(outSt.st_mode);
+  int isPipe = S_ISFIFO(inSt.st_mode) || S_ISFIFO(outSt.st_mode);
+  off_t copied = 0;
+  if (isInFile && isOutFile) {
+    if (copyRange(inFd, outFd, &copied) == 0)
+      return copied;
+    if (!isUnsupported(errno))
+      return -1;
+  }
+  if (isPipe) {
+    if (copySplice(inFd, outFd, &copied) == 0)
+      return copied;
+    if (!isUnsupported(errno))
+      return -1;
+  }
+  if (isInFile) {
+    if (copySendfile(inFd, outFd, &copied) == 0)
+      return copied;
+    if (!isUnsupported(errno))
+      return -1;
+  }
+  if (copyReadWrite(inFd, outFd, &copied) == 0)
+    return copied;
+  return -1;
+}
+
+// ==========
+// tee
+// ==========
+typedef struct {
+  int fd;
+  int pipeFd[2]; // fd is no pipe: tee(2) goes here, splice() drains it
+  int isSplice;  // splice() into fd works
+  int isDead;
+  int *err;
+  size_t lenGot; // of the current chunk
+} TeeSink;
+
+typedef struct {
+  int inFd;
+  TeeSink *sinks; // the last one takes the data out of inFd
+  size_t numSinks;
+  char *buf;
+  size_t lenBuf; // also the largest chunk, the size of the pipe of inFd
+  int fatalErr;  // EINTR, EPIPE or an error of inFd, ends the copy
+} TeeCopy;
+
+static void killSink(TeeCopy *copy, TeeSink *sink, int err) {
+  if (err == EPIPE || err == EINTR) {
+    copy->fatalErr = err;
+    return;
+  }
+  sink->isDead = 1;
+  *sink->err = err;
+  if (sink->pipeFd[0] != -1) {
+    close(sink->pipeFd[0]);
+    close(sink->pipeFd[1]);
+    sink->pipeFd[0] = sink->pipeFd[1] = -1;
+  }
+}
+
+// buf[0, len) to sink, returns -1 if the sink is gone
+static int writeSink(TeeCopy *copy, TeeSink *sink, const char *buf,
+                     size_t len) {
+  while (len > 0) {
+    ssize_t lenWritten = write(sink->fd, buf, len);
+    if (lenWritten == -1) {
+      killSink(copy, sink, errno);
+      return -1;
+    }
+    buf += lenWritten;
+    len -= (size_t)lenWritten;
+  }
+  return 0;
+}
+
+// len bytes of the pipe of sink into its fd
+static void drainSinkPipe(TeeCopy *copy, TeeSink *sink, size_t len) {
+  while (len > 0 && !sink->isDead && !copy->fatalErr) {
+    if (sink->isSplice) {
+      ssize_t lenMoved = splice(sink->pipeFd[0], NULL, sink->fd, NULL, len,
+                                SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (lenMoved > 0)
+        len -= (size_t)lenMoved;
+      else if (lenMoved == -1 && isUnsupported(errno))
+        sink->isSplice = 0; // e.g. a file opened with O_APPEND
+      else
+        killSink(copy, sink, lenMoved == -1 ? errno : EIO);
+      continue;
+    }
+    ssize_t lenRead = read(sink->pipeFd[0], copy->buf,
+                           len < copy->lenBuf ? len : copy->lenBuf);
+    if (lenRead <= 0)
+      killSink(copy, sink, lenRead == -1 ? errno : EIO);
+    else if (writeSink(copy, sink, copy->buf, (size_t)lenRead) == 0)
+      len -= (size_t)lenRead;
+  }
+}
+
+// the chunk of len bytes at the head of inFd, that the sinks before the
+// last one have lenGot of, is taken out of inFd and completed
+static void takeChunk(TeeCopy *copy, size_t len) {
+  TeeSink *last = &copy->sinks[copy->numSinks - 1];
+  int isComplete = 1;
+  for (size_t i = 0; i + 1 < copy->numSinks; ++i)
+    isComplete &= copy->sinks[i].isDead || copy->sinks[i].lenGot == len;
+  size_t lenTaken = 0;
+  while (isComplete && !last->isDead && last->isSplice && lenTaken < len) {
+    ssize_t lenMoved = splice(copy->inFd, NULL, last->fd, NULL, len - lenTaken,
+                              SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (lenMoved > 0)
+      lenTaken += (size_t)lenMoved;
+    else if (lenMoved == -1 && isUnsupported(errno) && lenTaken == 0)
+      last->isSplice = 0;
+    else {
+      killSink(copy, last, lenMoved == -1 ? errno : EIO);
+      if (copy->fatalErr)
+        return;
+    }
+  }
+  if (lenTaken == len)
+    return;
+  // what is left goes through the buffer, to the sinks that lack it
+  last->lenGot = lenTaken;
+  while (lenTaken < len) {
+    ssize_t lenRead = read(copy->inFd, copy->buf + lenTaken, len - lenTaken);
+    if (lenRead <= 0) {
+      copy->fatalErr = lenRead == -1 ? errno : EIO;
+      return;
+    }
+    lenTaken += (size_t)lenRead;
+  }
+  for (size_t i = 0; i < copy->numSinks && !copy->fatalErr; ++i) {
+    TeeSink *sink = &copy->sinks[i];
+    if (!sink->isDead && sink->lenGot < len)
+      writeSink(copy, sink, copy->buf + sink->lenGot, len - sink->lenGot);
+  }
+}
+
+// one chunk from the pipe inFd to every sink
+// returns 0 at the end of the input, -1 if tee(2) does not work for it
+static long teeChunk(TeeCopy *copy) {
+  size_t len = 0;
+  int hasLen = 0;
+  for (size_t i = 0; i + 1 < copy->numSinks && !copy->fatalErr; ++i) {
+    TeeSink *sink = &copy->sinks[i];
+    sink->lenGot = 0;
+    if (sink->isDead)
+      continue;
+    int outFd = sink->pipeFd[1] != -1 ? sink->pipeFd[1] : sink->fd;
+    // the first sink decides how much the chunk is, tee(2) always starts
+    // at the head of inFd, so the others get no more than that
+    ssize_t lenTeed = tee(copy->inFd, outFd, hasLen ? len : copy->lenBuf, 0);
+    if (lenTeed == -1 && !hasLen && isUnsupported(errno))
+      return -1;
+    if (lenTeed == -1) {
+      killSink(copy, sink, errno);
+      continue;
+    }
+    if (!hasLen) {
+      if (lenTeed == 0)
+        return 0;
+      len = (size_t)lenTeed;
+      hasLen = 1;
+    }
+    sink->lenGot = (size_t)lenTeed;
+    if (sink->pipeFd[0] != -1)
+      drainSinkPipe(copy, sink, sink->lenGot);
+  }
+  if (copy->fatalErr)
+    return 1;
+  if (!hasLen) {
+    // no other sink is left, the last one takes what there is
+    TeeSink *last = &copy->sinks[copy->numSinks - 1];
+    ssize_t lenMoved = last->isDead || !last->isSplice
+                           ? -1
+                           : splice(copy->inFd, NULL, last->fd, NULL,
+                                    copy->lenBuf,
+                                    SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (lenMoved >= 0)
+      return lenMoved > 0;
+    if (!last->isDead && !isUnsupported(errno)) {
+      killSink(copy, last, errno);
+      return 1;
+    }
+    return -1;
+  }
+  takeChunk(copy, len);
+  return 1;
+}
+
+// the same with read and write, for any inFd
+static void teeReadWrite(TeeCopy *copy) {
+  while (!copy->fatalErr) {
+    ssize_t lenRead = read(copy->inFd, copy->buf, copy->lenBuf);
+    if (lenRead <= 0) {
+      if (lenRead == -1)
+        copy->fatalErr = errno;
+      return;
+    }
+    int isAnyAlive = 0;
+    for (size_t i = 0; i < copy->numSinks && !copy->fatalErr; ++i)
+      if (!copy->sinks[i].isDead)
+        isAnyAlive |= writeSink(copy, &copy->sinks[i], copy->buf,
+                                (size_t)lenRead) == 0;
+    if (!isAnyAlive)
+      return;
+  }
+}
+
+int teeFdAll(int inFd, const int *outFds, int *errs, size_t numOut) {
+  TeeCopy copy = {inFd, calloc(numOut + 1, sizeof(TeeSink)), numOut, NULL,
+             COPY_BUF_SIZE, 0};
+  if (!copy.sinks)
+    return -1;
+  struct stat st;
+  int isPipe = fstat(inFd, &st) == 0 && S_ISFIFO(st.st_mode);
+  long lenPipe = isPipe ? fcntl(inFd, F_GETPIPE_SZ) : -1;
+  if (lenPipe > 0)
+    copy.lenBuf = (size_t)lenPipe;
+  for (size_t i = 0; i < numOut; ++i) {
+    TeeSink *sink = &copy.sinks[i];
+    errs[i] = 0;
+    *sink = (TeeSink){outFds[i], {-1, -1}, 1, 0, &errs[i], 0};
+    // a pipe of the same size takes a whole chunk of inFd at once
+    if (isPipe && i + 1 < numOut &&
+        (fstat(sink->fd, &st) == -1 || !S_ISFIFO(st.st_mode)) &&
+        (pipe2(sink->pipeFd, O_CLOEXEC) == -1 ||
+         fcntl(sink->pipeFd[1], F_SETPIPE_SZ, (int)copy.lenBuf) == -1))
+      isPipe = 0;
+  }
+  if (!(copy.buf = malloc(copy.lenBuf))) {
+    free(copy.sinks);
+    return -1;
+  }
+  long status = 1;
+  while (isPipe && numOut > 0 && !copy.fatalErr && status > 0)
+    status = teeChunk(&copy);
+  if (!isPipe || status == -1)
+    teeReadWrite(&copy);
+  for (size_t i = 0; i < numOut; ++i)
+    if (copy.sinks[i].pipeFd[0] != -1) {
+      close(copy.sinks[i].pipeFd[0]);
+      close(copy.sinks[i].pipeFd[1]);
+    }
+  free(copy.buf);
+  free(copy.sinks);
+  if (copy.fatalErr) {
+    errno = copy.fatalErr;
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef ZEROCOPY_H
+#define ZEROCOPY_H
+
+#include <sys/types.h>
+
+// copy everything from inFd to outFd through the cheapest path the kernel
+// offers for the two fds:
+// copy_file_range for file to file, splice when either end is a pipe,
+// sendfile from a file to anything else, read/write as the last resort
+// returns the number of bytes copied, or -1 with errno set, EINTR when a
+// signal such as ctrl+c cut it short
+off_t copyFdAll(int inFd, int outFd);
+
+// copy everything from inFd to every fd of outFds[0, numOut)
+// from a pipe, tee(2) duplicates the data into each out fd that is a pipe,
+// and into a pipe of its own for any other, which splice() drains into it;
+// the last out fd takes the data itself with splice(), so nothing passes
+// through user space; a read/write loop over one buffer does the rest
+// an out fd that fails is dropped, with its errno in errs[i], 0 for the
+// others, the rest go on
+// returns -1 with errno set if reading inFd fails or an out fd is a closed
+// pipe (EPIPE), as tee would die of SIGPIPE
+int teeFdAll(int inFd, const int *outFds, int *errs, size_t numOut);
+
+#endif